@@ -31,6 +31,31 @@ static const char prog_doc[] = "\n"
  */
 static const char args_doc[] = "";
 
+/**
+ * Keys for options that only have a long name
+ */
+enum
+{
+	OPT_JSON = 0x100,
+	OPT_RATE,
+	OPT_EMULATE,
+	OPT_EMU_LATENCY,
+	OPT_EMU_BANDWIDTH,
+	OPT_SCRIPT,
+	OPT_METRICS_FILE,
+	OPT_METRICS_SOCKET,
+	OPT_METRICS_INTERVAL,
+	OPT_ERRMON,
+	OPT_ERRMON_RECOVER,
+	OPT_GPIO_POLL,
+	OPT_GPIO_SEQ,
+	OPT_GPIO_PWM,
+	OPT_GPIO_CYCLES,
+	OPT_GPIO_MERGE,
+	OPT_IO_URING,
+	OPT_SPEED
+};
+
 /**
  * ARGUMENT OPTIONS - field 1 in struct argp
  * Order: { name, key, arg, flags, doc, group }
@@ -38,12 +63,77 @@ static const char args_doc[] = "";
  */
 static const struct argp_option options[] = {
 	{ "listhids", 'l', 0, 0, "List all HIDs on system and exit", 0 },
+	{ "all", 'a', 0, 0, "Open every CANbus and GPIO module on the system "
+		"and read from all CANbus modules at once", 0 },
 	{ "path", 'p', "PATH", 0, "CANbus module's path, e.g. /dev/hidraw0. "
 		"Specifying this flag forces the program to use this device file "
 		"path instead of searching dynamically. Default=(null)", 0 },
 	{ "timeout", 't', "MSEC", 0, "Milliseconds to wait during read. "
 		"Default=10000", 0 },
 	{ "verbose", 'v', 0, 0, "Print more messages", 0 },
+	{ "rx-thread", 'r', 0, 0, "Drain the CANbus module from a background "
+		"thread during read mode", 0 },
+	{ "supervise", 's', 0, 0, "Reconnect to the CANbus module if it resets "
+		"or re-enumerates during read or write mode, restoring its "
+		"configuration", 0 },
+	{ "filter", 'f', "FILE", 0, "Only show CANbus frames whose IDs match "
+		"the acceptance filter rules in FILE. Send SIGHUP to reload it.", 0 },
+	{ "realtime", 'R', 0, 0, "Timestamp CANbus frames with the wall clock "
+		"(CLOCK_REALTIME) instead of CLOCK_MONOTONIC", 0 },
+	{ "bench", 'b', "MODE", 0, "Run a benchmark and exit. MODE is 'usb' "
+		"(USB echo round trips), 'can' (CAN loopback throughput) or "
+		"'hexfmt' (hex formatting speed, needs no module)", 0 },
+	{ "count", 'n', "N", 0, "Round trips or frames per benchmark. "
+		"Default=10000", 0 },
+	{ "depth", 'd', "N", 0, "USB echo reports in flight during the usb "
+		"benchmark. Default=1", 0 },
+	{ "rate", OPT_RATE, "FPS", 0, "Frames per second to send during the can "
+		"benchmark. Default=0 (flat out)", 0 },
+	{ "json", OPT_JSON, 0, 0, "Print benchmark results as JSON", 0 },
+	{ "script", OPT_SCRIPT, "FILE", 0, "Write every line of FILE to the "
+		"CANbus module and exit, '-' reads stdin. Lines use the write mode "
+		"syntax; '#' starts a comment", 0 },
+	{ "emulate", OPT_EMULATE, 0, 0, "Use emulated CANbus and GPIO modules "
+		"instead of searching for real ones", 0 },
+	{ "emu-latency", OPT_EMU_LATENCY, "USEC", 0, "Delay before each report "
+		"an emulated module sends. Default=0", 0 },
+	{ "emu-bandwidth", OPT_EMU_BANDWIDTH, "BYTES", 0, "Bytes per second "
+		"each way between the host and an emulated module, 64000 for a "
+		"full speed USB interrupt endpoint. Default=0 (unlimited)", 0 },
+	{ "metrics-file", OPT_METRICS_FILE, "PATH", 0, "Keep the modules' "
+		"counters in PATH in the Prometheus text format, e.g. for "
+		"node_exporter's textfile collector", 0 },
+	{ "metrics-socket", OPT_METRICS_SOCKET, "PATH", 0, "Serve the modules' "
+		"counters in the Prometheus text format on a Unix socket at PATH", 0 },
+	{ "metrics-interval", OPT_METRICS_INTERVAL, "MSEC", 0, "Milliseconds "
+		"between --metrics-file updates. Default=15000", 0 },
+	{ "errmon", OPT_ERRMON, "MSEC", 0, "Read the CANbus module's error state "
+		"every MSEC milliseconds in the background and report when it goes "
+		"to warning, error passive or bus-off and back", 0 },
+	{ "errmon-recover", OPT_ERRMON_RECOVER, 0, 0, "With --errmon, recover "
+		"from bus-off by cycling the CANbus module through configuration "
+		"mode. Needs the module to have been configured first", 0 },
+	{ "gpio-poll", OPT_GPIO_POLL, "MIN[,MAX]", 0, "Fastest and slowest GPIO "
+		"pin data polls while watching GPIO inputs, in microseconds. Idle "
+		"pins back off towards MAX. Default=1000,50000", 0 },
+	{ "gpio-seq", OPT_GPIO_SEQ, "FILE", 0, "Play the GPIO output sequence in "
+		"FILE and exit. Lines are 'OFFSET_US MASK VALUE' with MASK and VALUE "
+		"in hex, bit 0 being pin 1, or 'period USEC' to repeat; '#' starts "
+		"a comment", 0 },
+	{ "gpio-pwm", OPT_GPIO_PWM, "MASK,PERIOD_US,DUTY", 0, "Drive the GPIO "
+		"pins in hex MASK with a software PWM of DUTY percent and exit", 0 },
+	{ "gpio-cycles", OPT_GPIO_CYCLES, "N", 0, "Periods to play with "
+		"--gpio-seq or --gpio-pwm, 0 until Ctrl+c. Default=1 for --gpio-seq, "
+		"0 for --gpio-pwm", 0 },
+	{ "gpio-merge", OPT_GPIO_MERGE, "USEC", 0, "Send GPIO sequence steps "
+		"due within USEC of each other in one transaction. Default=0", 0 },
+	{ "io-uring", OPT_IO_URING, 0, 0, "Move CANbus reports with io_uring: "
+		"the reader thread (--rx-thread, --all, --bench can) keeps several "
+		"reads posted and frame batches go out in one system call", 0 },
+	{ "speed", OPT_SPEED, "BPS", 0, "The CANbus module's bus speed, 136000 "
+		"to 1000000. The module can not report it, so the can benchmark "
+		"needs it to put the speed back. Default=0 (leave the speed alone)",
+		0 },
 	{ 0, 0, 0, 0, 0, 0 }
 };
 
@@ -62,6 +152,9 @@ static error_t parser(int key, char *arg, struct argp_state *state)
 	cfg_t *cfg = (cfg_t *)state->input;
 	switch (key)
 	{
+		case 'a': // --all
+			cfg->all_devices = 1;
+			break;
 		case 'l': // --listhids
 			cfg->list_hids = 1;
 			break;
@@ -86,6 +179,93 @@ static error_t parser(int key, char *arg, struct argp_state *state)
 				cfg->timeout_ms = CANBUS_DEFAULT_TIMEOUT_MS;
 			break;
 		}
+		case 'r': // --rx-thread
+			cfg->rx_thread = 1;
+			break;
+		case 's': // --supervise
+			cfg->supervise = 1;
+			break;
+		case 'R': // --realtime
+			cfg->realtime = 1;
+			break;
+		case 'b': // --bench
+			memset(cfg->bench, 0, sizeof(cfg->bench));
+			strncpy(cfg->bench, arg, sizeof(cfg->bench)-1);
+			break;
+		case 'n': // --count
+			cfg->bench_count = strtoul(arg, NULL, 10);
+			break;
+		case 'd': // --depth
+			cfg->bench_depth = atoi(arg);
+			break;
+		case OPT_RATE: // --rate
+			cfg->bench_rate = strtoul(arg, NULL, 10);
+			break;
+		case OPT_JSON: // --json
+			cfg->json = 1;
+			break;
+		case OPT_SCRIPT: // --script
+			memset(cfg->script, 0, sizeof(cfg->script));
+			strncpy(cfg->script, arg, sizeof(cfg->script)-1);
+			break;
+		case OPT_EMULATE: // --emulate
+			cfg->emulate = 1;
+			break;
+		case OPT_EMU_LATENCY: // --emu-latency
+			cfg->emu_latency_us = strtoul(arg, NULL, 10);
+			break;
+		case OPT_EMU_BANDWIDTH: // --emu-bandwidth
+			cfg->emu_bandwidth = strtoul(arg, NULL, 10);
+			break;
+		case OPT_METRICS_FILE: // --metrics-file
+			memset(cfg->metrics_file, 0, sizeof(cfg->metrics_file));
+			strncpy(cfg->metrics_file, arg, sizeof(cfg->metrics_file)-1);
+			break;
+		case OPT_METRICS_SOCKET: // --metrics-socket
+			memset(cfg->metrics_socket, 0, sizeof(cfg->metrics_socket));
+			strncpy(cfg->metrics_socket, arg, sizeof(cfg->metrics_socket)-1);
+			break;
+		case OPT_METRICS_INTERVAL: // --metrics-interval
+			cfg->metrics_interval_ms = atoi(arg);
+			break;
+		case OPT_ERRMON: // --errmon
+			cfg->errmon_interval_ms = atoi(arg);
+			break;
+		case OPT_ERRMON_RECOVER: // --errmon-recover
+			cfg->errmon_recover = 1;
+			break;
+		case OPT_GPIO_POLL: // --gpio-poll
+		{
+			char *endptr;
+			cfg->gpio_min_us = strtoul(arg, &endptr, 10);
+			cfg->gpio_max_us = *endptr == ',' ?
+				strtoul(endptr + 1, NULL, 10) : 0;
+			break;
+		}
+		case OPT_GPIO_SEQ: // --gpio-seq
+			memset(cfg->gpio_seq, 0, sizeof(cfg->gpio_seq));
+			strncpy(cfg->gpio_seq, arg, sizeof(cfg->gpio_seq)-1);
+			break;
+		case OPT_GPIO_PWM: // --gpio-pwm
+			memset(cfg->gpio_pwm, 0, sizeof(cfg->gpio_pwm));
+			strncpy(cfg->gpio_pwm, arg, sizeof(cfg->gpio_pwm)-1);
+			break;
+		case OPT_GPIO_CYCLES: // --gpio-cycles
+			cfg->gpio_cycles = strtoul(arg, NULL, 10);
+			break;
+		case OPT_GPIO_MERGE: // --gpio-merge
+			cfg->gpio_merge_us = strtoul(arg, NULL, 10);
+			break;
+		case OPT_IO_URING: // --io-uring
+			cfg->io_uring = 1;
+			break;
+		case OPT_SPEED: // --speed
+			cfg->bus_speed = strtoul(arg, NULL, 10);
+			break;
+		case 'f': // --filter
+			memset(cfg->filter_path, 0, sizeof(cfg->filter_path));
+			strncpy(cfg->filter_path, arg, sizeof(cfg->filter_path)-1);
+			break;
 		case ARGP_KEY_ARG:
 		case ARGP_KEY_END:
 			break;
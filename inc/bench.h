@@ -0,0 +1,60 @@
+/**
+ * @file bench.h
+ * @date 2026-10-16
+ *
+ * Benchmarks for qualifying gateway images and kernels. Each one prints a
+ * human readable summary, or a single JSON object per run for scripts.
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "canctl.h"
+#include <stdio.h>
+#include <signal.h>
+
+#define BENCH_DEFAULT_COUNT         10000
+#define BENCH_MAX_DEPTH             64 // USB echo reports in flight
+#define BENCH_CAN_ID                0x1bec0000 // Extended ID of test frames
+
+/**
+ * Benchmark parameters
+ */
+typedef struct bench_opts
+{
+	unsigned long count; // Round trips or frames to send
+	int depth; // USB echo reports in flight, 1 to BENCH_MAX_DEPTH
+	unsigned long rate; // CAN frames per second, 0 sends flat out
+	unsigned int speed; // Module's bus speed, 0 if unknown
+	int timeout_ms; // Give up when nothing arrives for this long
+	int json; // Print one JSON object instead of a summary
+	volatile sig_atomic_t *stop; // Ends the run early when nonzero, or NULL
+} bench_opts_t;
+
+/**
+ * Latency summary in microseconds, see bench_percentiles()
+ */
+typedef struct bench_latency
+{
+	double p50;
+	double p90;
+	double p99;
+	double max;
+} bench_latency_t;
+
+void bench_percentiles(uint64_t *samples_ns, size_t n, bench_latency_t *lat);
+int bench_usb_echo(canctl_dev_t *dev, const bench_opts_t *opts, FILE *out);
+int bench_can_loopback(canctl_dev_t *dev, const bench_opts_t *opts,
+	FILE *out);
+int bench_hexfmt(const bench_opts_t *opts, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BENCH_H_
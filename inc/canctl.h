@@ -23,6 +23,19 @@ extern "C"
 #include <linux/hidraw.h>
 #include <sys/ioctl.h>
 #include <stdlib.h> // size_t
+#include <stdint.h>
+#include <time.h> // struct timespec
+
+// libcanctl version, see canctl_version(). The major version changes only
+// when an existing function or structure changes incompatibly; it is the
+// shared library's soname. The minor version changes when functions are
+// added, each in its own node of libcanctl.map.
+#define CANCTL_VERSION_MAJOR        1
+#define CANCTL_VERSION_MINOR        4
+#define CANCTL_VERSION_PATCH        0
+#define CANCTL_VERSION              ((CANCTL_VERSION_MAJOR << 16) | \
+                                     (CANCTL_VERSION_MINOR << 8) | \
+                                     CANCTL_VERSION_PATCH)
 
 // GPIO Interrupt out endpoints
 #define GPIO_OUT_READ_PIN_TYPE      0xb0
@@ -77,6 +90,24 @@ extern "C"
 #define GET_ESTATE_STR(byte, flag) (((byte & flag) == flag) ? "yes" : "no")
 #define GPIO_PIN_COUNT              8 // Number of GPIO pins (8)
 
+// CANBUS_IN_RECV_DATA/CANBUS_OUT_SEND_DATA report layout
+#define CANBUS_REPORT_HEADER_SIZE   2 // Report ID + frame count
+#define CANBUS_FRAME_RECORD_SIZE    14 // SOF/ID size + 4 ID + DLC + 8 data
+#define CANBUS_FRAMES_PER_REPORT    ((CANBUS_MSG_SIZE - \
+	CANBUS_REPORT_HEADER_SIZE) / CANBUS_FRAME_RECORD_SIZE)
+#define CANBUS_FRAME_ID_STD         0x0b // Start of frame, 11-bit ID size
+#define CANBUS_FRAME_ID_EXT         0x1d // Start of frame, 29-bit ID size
+#define CANBUS_FRAME_MAX_DLC        8 // Max data payload per frame
+#define CANBUS_STD_ID_MASK          0x7ff
+#define CANBUS_EXT_ID_MASK          0x1fffffff
+
+// Background receive thread
+#define CANCTL_RING_SIZE            4096 // Frames, must be a power of 2
+#define CANCTL_READER_POLL_MS       100 // How often the reader checks for stop
+#define CANCTL_BACKLOG_SIZE         16 // Data reports held during a command
+#define CANCTL_ASYNC_DEPTH          16 // Commands in flight, see canctl_submit()
+#define CANCTL_HIST_BUCKETS         32 // Log2 microsecond buckets
+
 //GPIO Subcommands and Responses
 #define GPIO_READ_PIN_TYPE_CMD      0x01
 #define GPIO_SET_PIN_TYPE_CMD       0x02
@@ -88,6 +119,9 @@ extern "C"
 
 #define PIN_DATA 1
 #define PIN_TYPE 0
+
+// Bit for GPIO pin 1-8 in the gpio_*_pins() masks
+#define GPIO_PIN_BIT(pin)           ((uint8_t)(1u << ((pin) - 1)))
 #define GET_IOM 1
 #define GET_BOARD_ID 0
 
@@ -132,20 +166,251 @@ typedef enum canbus_cfg
 	CANBUS_CFG_UNKNOWN // This and higher values are never valid
 } canbus_cfg_t;
 
+/**
+ * A single CAN frame as carried in a CANBUS_IN_RECV_DATA or
+ * CANBUS_OUT_SEND_DATA report.
+ */
+typedef struct canbus_frame
+{
+	uint32_t id; // 11-bit or 29-bit identifier
+	uint8_t ext; // Non-zero if @c id is a 29-bit extended identifier
+	uint8_t dlc; // Number of valid bytes in @c data
+	uint8_t data[CANBUS_FRAME_MAX_DLC];
+	struct timespec ts; // Receive time, see canctl_set_clock()
+} canbus_frame_t;
+
+/**
+ * Handle for one open CANbus or GPIO module. Owns the module's fd, timeout,
+ * receive buffers and statistics; see canctl_open() and canctl_attach().
+ */
+typedef struct canctl_dev canctl_dev_t;
+
+/**
+ * Per-module counters and gauges, see canctl_get_stats() and
+ * canctl_stat_descs(). Every field is an unsigned long.
+ */
+typedef struct canctl_stats
+{
+	unsigned long reports_read;
+	unsigned long reports_written;
+	unsigned long timeouts; // Reads and commands that timed out
+	unsigned long unsolicited; // Reports nobody was waiting for
+	unsigned long backlog_overflows; // Data reports lost during a command
+	unsigned long frames_filtered; // Frames dropped by the acceptance filter
+	unsigned long read_errors; // Failed reads, not counting EAGAIN
+	unsigned long write_errors; // Failed writes, not counting timeouts
+	unsigned long short_writes; // Writes that took only part of a report
+	unsigned long command_failures; // Commands that got no reply
+	unsigned long tx_errors; // Gauge: Tx error count, last error state read
+	unsigned long rx_errors; // Gauge: Rx error count, last error state read
+	unsigned long error_flags; // Gauge: canbus_estate_flags_t, last read
+	// Since 1.3: new fields go at the end, see canctl_get_stats()
+	unsigned long io_syscalls; // select/poll/read/write/io_uring_enter calls
+	// Since 1.4
+	unsigned long io_retries; // io_uring reads that found nothing and waited
+} canctl_stats_t;
+
+/**
+ * How reports move between the host and the module, see canctl_set_io()
+ */
+typedef enum canctl_io
+{
+	CANCTL_IO_SYSCALL, // select() and read(), write() per report
+	CANCTL_IO_URING // io_uring, see canctl_set_io()
+} canctl_io_t;
+
+/**
+ * Whether a statistic only goes up or can go either way
+ */
+typedef enum canctl_stat_type
+{
+	CANCTL_STAT_COUNTER,
+	CANCTL_STAT_GAUGE
+} canctl_stat_type_t;
+
+/**
+ * Describes one canctl_stats_t field, so exporters can walk them all
+ */
+typedef struct canctl_stat_desc
+{
+	const char *name; // e.g. "reports_read_total"
+	const char *help; // One line description
+	canctl_stat_type_t type;
+	size_t offset; // Of the field in canctl_stats_t
+} canctl_stat_desc_t;
+
+/**
+ * Receive latency histograms kept per handle, see canctl_get_hist()
+ */
+typedef enum canctl_hist_id
+{
+	CANCTL_HIST_INTERARRIVAL, // Between consecutive reports
+	CANCTL_HIST_SELECT_TO_READ, // From select() waking to read() returning
+	CANCTL_HIST_COUNT
+} canctl_hist_id_t;
+
+/**
+ * Log-bucketed latency histogram. Bucket 0 counts samples under 1 us and
+ * bucket i counts samples from 2^(i-1) to 2^i - 1 us.
+ */
+typedef struct canctl_hist
+{
+	unsigned long count;
+	unsigned long sum_us;
+	unsigned long max_us;
+	unsigned long buckets[CANCTL_HIST_BUCKETS];
+} canctl_hist_t;
+
+/**
+ * Where canctl_dispatch() sent an incoming report
+ */
+typedef enum canctl_route
+{
+	CANCTL_ROUTE_DROP, // Nobody was waiting for this report ID
+	CANCTL_ROUTE_COMMAND, // Filled the pending-command slot
+	CANCTL_ROUTE_DATA, // CAN data, belongs to the caller's data path
+} canctl_route_t;
+
+/**
+ * Fixed-size single-producer/single-consumer ring of decoded frames. The
+ * producer (the reader thread) only advances @c head and the consumer only
+ * advances @c tail, so neither side takes a lock. Each index lives on its
+ * own cache line to keep the two threads from false sharing. The consumer
+ * can copy frames out with canctl_ring_pop() or read them in place with
+ * canctl_ring_peek()/canctl_ring_release() or canctl_ring_consume().
+ */
+typedef struct canctl_ring
+{
+	size_t head __attribute__((aligned(64))); // Next slot to fill
+	size_t tail __attribute__((aligned(64))); // Next slot to drain
+	unsigned long overflows __attribute__((aligned(64))); // Frames dropped
+	unsigned long bad_reports; // Reports that could not be decoded
+	canbus_frame_t slots[CANCTL_RING_SIZE];
+} canctl_ring_t;
+
+/**
+ * Called by canctl_ring_consume() with frames still in place in the ring.
+ * The frames are only valid during the call.
+ * @returns Returns how many of the @c n frames were used. Those are released;
+ * returning fewer than @c n stops canctl_ring_consume() and leaves the rest
+ * queued.
+ */
+typedef size_t (*canctl_ring_cb)(const canbus_frame_t *frames, size_t n,
+	void *arg);
+
+/**
+ * Background reader that drains a CANbus module into a canctl_ring_t.
+ * Opaque; see canctl_reader_start().
+ */
+typedef struct canctl_reader canctl_reader_t;
+
+/**
+ * Called by canctl_complete() when an asynchronous command finishes.
+ * @param dev The module the command was sent to
+ * @param err 0 if the reply arrived, ETIMEDOUT if it did not
+ * @param reply The reply report, NULL on error. Only valid during the call.
+ * @param len Number of bytes in @c reply
+ * @param arg As given to canctl_submit()
+ */
+typedef void (*canctl_async_cb)(canctl_dev_t *dev, int err,
+	const unsigned char *reply, size_t len, void *arg);
+
+/**
+ * What canctl_query_info() found out about one module
+ */
+typedef struct canctl_info
+{
+	int gpio; // Set by the caller: nonzero for a GPIO module
+	int err; // 0 if every query was answered, otherwise the first errno
+	unsigned char fw[CANBUS_FIRMWARE_SIZE];
+	canbus_cfg_t cfg; // CANbus only
+	unsigned char estate[CANBUS_ERROR_STATE_SIZE]; // CANbus only
+	unsigned char board_id; // GPIO only
+	unsigned char sku; // GPIO only
+} canctl_info_t;
+
+/**
+ * Acceptance filter, see canfilter.h
+ */
+typedef struct canfilter canfilter_t;
 
-const unsigned char *canctl_get_firmware_version(int fd);
-canbus_cfg_t canctl_get_config(int fd);
-int canctl_set_config(int fd, canbus_cfg_t cfg, unsigned int speed);
-int canctl_read(int fd, unsigned char *buf, size_t len);
-int canctl_write(int fd, unsigned char *buf, size_t len);
-int canctl_set_led(int fd, canbus_led_t mode);
-void canctl_set_timeout_ms(int ms);
-int canctl_get_timeout_ms(void);
+canctl_dev_t *canctl_open(const char *path);
+unsigned int canctl_version(void);
+canctl_dev_t *canctl_attach(int fd);
+int canctl_reattach(canctl_dev_t *dev, int fd);
+void canctl_close(canctl_dev_t *dev);
+int canctl_get_fd(const canctl_dev_t *dev);
+void canctl_get_stats(canctl_dev_t *dev, canctl_stats_t *stats);
+const canctl_stat_desc_t *canctl_stat_descs(size_t *n);
+int canctl_get_firmware_version(canctl_dev_t *dev, unsigned char *fw);
+canbus_cfg_t canctl_get_config(canctl_dev_t *dev);
+int canctl_set_config(canctl_dev_t *dev, canbus_cfg_t cfg, unsigned int speed);
+int canctl_get_last_config(const canctl_dev_t *dev, canbus_cfg_t *cfg,
+	unsigned int *speed);
+int canctl_read(canctl_dev_t *dev, unsigned char *buf, size_t len);
+int canctl_write(canctl_dev_t *dev, unsigned char *buf, size_t len);
+int canctl_recv(canctl_dev_t *dev, unsigned char *buf, size_t len);
+canctl_route_t canctl_dispatch(canctl_dev_t *dev, const unsigned char *buf,
+	size_t len);
+void canctl_reader_claim(canctl_dev_t *dev);
+void canctl_reader_unclaim(canctl_dev_t *dev);
+int canctl_submit(canctl_dev_t *dev, const unsigned char *tx, size_t txlen,
+	int rx_id, canctl_async_cb cb, void *arg);
+int canctl_complete(canctl_dev_t *dev, int timeout_ms);
+int canctl_cancel(canctl_dev_t *dev);
+int canctl_in_flight(canctl_dev_t *dev);
+int canctl_query_info(canctl_dev_t **devs, canctl_info_t *info, size_t n);
+int canctl_set_led(canctl_dev_t *dev, canbus_led_t mode);
+void canctl_set_timeout_ms(canctl_dev_t *dev, int ms);
+int canctl_get_timeout_ms(const canctl_dev_t *dev);
+int canctl_set_io(canctl_dev_t *dev, canctl_io_t io);
+canctl_io_t canctl_get_io(const canctl_dev_t *dev);
+void canctl_set_clock(canctl_dev_t *dev, clockid_t clock);
+clockid_t canctl_get_clock(const canctl_dev_t *dev);
+int canctl_get_rx_time(const canctl_dev_t *dev, struct timespec *ts);
+void canctl_get_hist(canctl_dev_t *dev, canctl_hist_id_t id,
+	canctl_hist_t *hist);
+void canctl_reset_hist(canctl_dev_t *dev);
+void canctl_hist_add(canctl_hist_t *h, const struct timespec *from,
+	const struct timespec *to);
 const char *canctl_config_to_string(canbus_cfg_t cfg);
-const unsigned char *canctl_get_error_state(int fd);
-int gpio_set_pin(int fd, int op_type, unsigned char *pin_types);
-int gpio_read_pin(int fd, int op_type, unsigned char *pin_types);
-int gpio_get_iom_or_sku(int fd, int op_select, unsigned char *outbuf);
+int canctl_get_error_state(canctl_dev_t *dev, unsigned char *estate);
+int gpio_set_pin(canctl_dev_t *dev, int op_type, unsigned char *pin_types);
+int gpio_read_pin(canctl_dev_t *dev, int op_type, unsigned char *pin_types);
+int gpio_request_pin(canctl_dev_t *dev, int op_type);
+int gpio_parse_pin(const unsigned char *buf, size_t len, int op_type,
+	unsigned char *pin_types);
+int gpio_get_iom_or_sku(canctl_dev_t *dev, int op_select,
+	unsigned char *outbuf);
+int gpio_read_pins(canctl_dev_t *dev, int op_type, uint8_t *mask);
+int gpio_set_pins(canctl_dev_t *dev, int op_type, uint8_t mask);
+int gpio_write_pins(canctl_dev_t *dev, uint8_t mask, uint8_t value);
+int gpio_toggle_pins(canctl_dev_t *dev, uint8_t mask);
+int canctl_decode_report(const unsigned char *buf, size_t len,
+	canbus_frame_t *frames, size_t max, const struct timespec *ts);
+int canctl_encode_frames(unsigned char *buf, size_t len,
+	const canbus_frame_t *frames, size_t n);
+int canctl_send_frames(canctl_dev_t *dev, const canbus_frame_t *frames,
+	size_t n);
+const canfilter_t *canctl_set_filter(canctl_dev_t *dev,
+	const canfilter_t *filter);
+size_t canctl_filter_frames(canctl_dev_t *dev, canbus_frame_t *frames,
+	size_t n);
+void canctl_ring_init(canctl_ring_t *ring);
+size_t canctl_ring_push(canctl_ring_t *ring, const canbus_frame_t *frames,
+	size_t n);
+size_t canctl_ring_pop(canctl_ring_t *ring, canbus_frame_t *frames,
+	size_t max);
+size_t canctl_ring_peek(canctl_ring_t *ring, const canbus_frame_t **frames);
+void canctl_ring_release(canctl_ring_t *ring, size_t n);
+size_t canctl_ring_consume(canctl_ring_t *ring, canctl_ring_cb cb, void *arg,
+	size_t max);
+size_t canctl_ring_count(const canctl_ring_t *ring);
+unsigned long canctl_ring_overflows(const canctl_ring_t *ring);
+canctl_reader_t *canctl_reader_start(canctl_dev_t *dev, canctl_ring_t *ring);
+int canctl_reader_event_fd(const canctl_reader_t *reader);
+int canctl_reader_error(const canctl_reader_t *reader);
+void canctl_reader_stop(canctl_reader_t *reader);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,45 @@
+/**
+ * @file canfilter.h
+ * @date 2026-10-16
+ *
+ * Software acceptance filter. Standard (11-bit) IDs are looked up in a
+ * 2048-bit bitmap; extended (29-bit) IDs in a table of range/mask rules
+ * kept sorted so each lookup is a binary search per distinct mask.
+ *
+ * Filter files hold one rule per line, IDs in hex, '#' starts a comment:
+ *   std 123              accept standard ID 0x123
+ *   std 100-1ff          accept standard IDs 0x100 to 0x1ff
+ *   ext 18fef100         accept extended ID 0x18fef100
+ *   ext 18fe0000-18feffff
+ *   ext 0cf00400/3ffff00 accept extended IDs where (ID & mask) == value
+ * Frames that match no rule are dropped.
+ */
+
+#ifndef CANFILTER_H_
+#define CANFILTER_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "canctl.h"
+
+#define CANFILTER_MAX_EXT_RULES     1024
+
+canfilter_t *canfilter_create(void);
+void canfilter_destroy(canfilter_t *f);
+int canfilter_add_std(canfilter_t *f, uint32_t lo, uint32_t hi);
+int canfilter_add_ext(canfilter_t *f, uint32_t lo, uint32_t hi,
+	uint32_t mask);
+void canfilter_compile(canfilter_t *f);
+canfilter_t *canfilter_load(const char *path, int *errline);
+int canfilter_match(const canfilter_t *f, const canbus_frame_t *frame);
+size_t canfilter_apply(const canfilter_t *f, canbus_frame_t *frames,
+	size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CANFILTER_H_
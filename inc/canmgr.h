@@ -0,0 +1,73 @@
+/**
+ * @file canmgr.h
+ * @date 2026-10-16
+ *
+ * Multi-device manager. Opens every CANbus and GPIO module on the host,
+ * gives each CANbus module its own reader thread and merges their frame
+ * streams into one, tagged with the module each frame came from.
+ */
+
+#ifndef CANMGR_H_
+#define CANMGR_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "canctl.h"
+
+#define CANMGR_MAX_DEVICES          16 // Modules managed at once
+#define CANMGR_PATH_SIZE            64 // e.g. "/dev/hidraw12"
+
+/**
+ * Which kind of module a managed device is
+ */
+typedef enum canmgr_kind
+{
+	CANMGR_KIND_CAN,
+	CANMGR_KIND_GPIO,
+} canmgr_kind_t;
+
+/**
+ * One managed module
+ */
+typedef struct canmgr_device
+{
+	canmgr_kind_t kind;
+	char path[CANMGR_PATH_SIZE];
+	canctl_dev_t *dev;
+	canctl_ring_t *ring; // CAN only, NULL for GPIO
+	canctl_reader_t *reader; // CAN only, NULL until canmgr_start()
+} canmgr_device_t;
+
+/**
+ * A frame from the merged stream, tagged with its source module
+ */
+typedef struct canmgr_frame
+{
+	int src; // Index of the source module, see canmgr_get()
+	canbus_frame_t frame;
+} canmgr_frame_t;
+
+typedef struct canmgr canmgr_t;
+
+canmgr_t *canmgr_create(void);
+void canmgr_destroy(canmgr_t *mgr);
+int canmgr_add(canmgr_t *mgr, const char *path, canmgr_kind_t kind);
+int canmgr_remove(canmgr_t *mgr, int idx);
+int canmgr_find(const canmgr_t *mgr, const char *path);
+int canmgr_open_all(canmgr_t *mgr);
+int canmgr_count(const canmgr_t *mgr);
+const canmgr_device_t *canmgr_get(const canmgr_t *mgr, int idx);
+int canmgr_start(canmgr_t *mgr);
+void canmgr_stop(canmgr_t *mgr);
+int canmgr_read(canmgr_t *mgr, canmgr_frame_t *frames, size_t max,
+	int timeout_ms);
+int canmgr_error(const canmgr_t *mgr, int idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CANMGR_H_
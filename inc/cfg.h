@@ -19,6 +19,33 @@ typedef struct cfg
 	char path[256];
 	long int timeout_ms;
 	int verbose;
+	int rx_thread;
+	int all_devices;
+	int supervise;
+	char filter_path[256];
+	int realtime;
+	char bench[16];
+	unsigned long bench_count;
+	int bench_depth;
+	unsigned long bench_rate;
+	int json;
+	char script[256];
+	int emulate;
+	unsigned int emu_latency_us;
+	unsigned long emu_bandwidth;
+	char metrics_file[256];
+	char metrics_socket[108];
+	int metrics_interval_ms;
+	int errmon_interval_ms;
+	int errmon_recover;
+	unsigned long gpio_min_us;
+	unsigned long gpio_max_us;
+	char gpio_seq[256];
+	char gpio_pwm[64];
+	unsigned long gpio_cycles;
+	unsigned long gpio_merge_us;
+	int io_uring;
+	unsigned int bus_speed;
 } cfg_t;
 
 #ifdef __cplusplus
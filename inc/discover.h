@@ -0,0 +1,72 @@
+/**
+ * @file discover.h
+ * @date 2026-10-16
+ *
+ * Finds CANbus and GPIO modules through udev instead of opening every
+ * /dev/hidraw* node, and watches for modules arriving and leaving.
+ */
+
+#ifndef DISCOVER_H_
+#define DISCOVER_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DISCOVER_MAX_DEVICES        32 // HIDs returned by one query
+#define DISCOVER_PATH_SIZE          64 // e.g. "/dev/hidraw12"
+#define DISCOVER_NAME_SIZE          128 // HID_NAME / HID_PHYS strings
+
+/**
+ * What a discovered HID is
+ */
+typedef enum discover_kind
+{
+	DISCOVER_KIND_OTHER = 0, // Not one of our modules
+	DISCOVER_KIND_CAN,
+	DISCOVER_KIND_GPIO
+} discover_kind_t;
+
+/**
+ * A hidraw device as reported by udev
+ */
+typedef struct discover_device
+{
+	discover_kind_t kind;
+	char devnode[DISCOVER_PATH_SIZE]; // e.g. /dev/hidraw3
+	char name[DISCOVER_NAME_SIZE]; // HID name, e.g. "Microchip ... CANBus"
+	char phys[DISCOVER_NAME_SIZE]; // Physical address, see HIDIOCGRAWPHYS
+	uint16_t bustype; // BUS_USB, BUS_BLUETOOTH, ...
+	uint16_t vendor;
+	uint16_t product;
+} discover_device_t;
+
+/**
+ * What happened to a module, see discover_monitor_read()
+ */
+typedef enum discover_action
+{
+	DISCOVER_ACTION_ADD,
+	DISCOVER_ACTION_REMOVE
+} discover_action_t;
+
+typedef struct discover_monitor discover_monitor_t;
+
+int discover_find(discover_device_t *devs, size_t max, int modules_only);
+const char *discover_kind_to_string(discover_kind_t kind);
+
+discover_monitor_t *discover_monitor_create(void);
+int discover_monitor_fd(const discover_monitor_t *mon);
+int discover_monitor_read(discover_monitor_t *mon, discover_action_t *action,
+	discover_device_t *dev);
+void discover_monitor_destroy(discover_monitor_t *mon);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISCOVER_H_
@@ -0,0 +1,82 @@
+/**
+ * @file emu.h
+ * @date 2026-10-16
+ *
+ * Emulated CANbus or GPIO module. A thread plays the module's firmware on
+ * one end of a SOCK_SEQPACKET socketpair, which keeps report boundaries the
+ * way hidraw does; the other end is handed to canctl_attach(). Replies can
+ * be delayed and the link throttled to model a real USB connection, so the
+ * benchmarks and menus run on machines without the hardware.
+ *
+ * The CANbus module answers the firmware version, configuration, LED, error
+ * status and USB echo commands. Entering configuration mode clears the error
+ * state set by emu_set_error_state(), as a controller reset would. Frames
+ * sent in CANBUS_CFG_LOOPBACK mode come straight back; frames given to
+ * emu_inject() arrive as bus traffic in the normal and listen modes. The
+ * GPIO module answers the firmware version, pin type, pin data, board ID
+ * and SKU commands.
+ */
+
+#ifndef EMU_H_
+#define EMU_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "canctl.h"
+
+#define EMU_QUEUE_SIZE              256 // Reports waiting to be sent
+#define EMU_USB_FS_BANDWIDTH        64000 // 64-byte report per 1 ms frame
+
+/**
+ * Which module to emulate
+ */
+typedef enum emu_kind
+{
+	EMU_KIND_CAN,
+	EMU_KIND_GPIO
+} emu_kind_t;
+
+/**
+ * Emulated module settings, see emu_start()
+ */
+typedef struct emu_opts
+{
+	emu_kind_t kind;
+	unsigned int latency_us; // Delay before each report the module sends
+	unsigned long bandwidth; // Bytes per second each way, 0 for unlimited
+	unsigned char fw[CANBUS_FIRMWARE_SIZE]; // Reported firmware version
+	unsigned char board_id; // GPIO board ID
+	unsigned char sku; // IO module SKU
+} emu_opts_t;
+
+/**
+ * Emulator counters, see emu_get_stats()
+ */
+typedef struct emu_stats
+{
+	unsigned long reports_in; // Reports the host wrote
+	unsigned long reports_out; // Reports sent back to the host
+	unsigned long frames_sent; // Frames put on the emulated bus
+	unsigned long frames_looped; // Frames returned in loopback mode
+	unsigned long overruns; // Reports dropped, the queue or host was full
+} emu_stats_t;
+
+typedef struct emu emu_t;
+
+emu_t *emu_start(const emu_opts_t *opts, int *fd);
+void emu_stop(emu_t *emu);
+int emu_inject(emu_t *emu, const canbus_frame_t *frames, size_t n);
+void emu_set_error_state(emu_t *emu, unsigned char tx_errors,
+	unsigned char rx_errors, unsigned char flags);
+void emu_set_inputs(emu_t *emu, uint8_t levels);
+uint8_t emu_get_outputs(emu_t *emu);
+void emu_get_stats(emu_t *emu, emu_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EMU_H_
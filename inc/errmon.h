@@ -0,0 +1,115 @@
+/**
+ * @file errmon.h
+ * @date 2026-10-16
+ *
+ * CAN error state monitor. A thread samples the CANbus module's Tx/Rx error
+ * counters and CANBUS_ESTATE_* flags every interval, turns them into error
+ * rates, and reports each move between the error active, warning, passive
+ * and bus-off levels through a callback. Optionally it recovers from bus-off
+ * by cycling the module through configuration mode back into the mode it
+ * was in.
+ *
+ * Samples are ordinary commands, so they share the module with the data
+ * path the same way the menu's error status does: received frames keep
+ * flowing to canctl_read() or the reader thread while a sample waits.
+ */
+
+#ifndef ERRMON_H_
+#define ERRMON_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "canctl.h"
+
+#define ERRMON_INTERVAL_MS          1000 // Default time between samples
+#define ERRMON_RECOVER_HOLDOFF_MS   1000 // Default time between recoveries
+
+/**
+ * How far the controller has fallen back, from its error state flags
+ */
+typedef enum errmon_level
+{
+	ERRMON_LEVEL_UNKNOWN = -1, // Not sampled yet
+	ERRMON_LEVEL_ACTIVE = 0, // Error active, all is well
+	ERRMON_LEVEL_WARNING, // An error counter reached the warning limit
+	ERRMON_LEVEL_PASSIVE, // An error counter reached the passive limit
+	ERRMON_LEVEL_BUS_OFF // The transmitter is off the bus
+} errmon_level_t;
+
+/**
+ * One reading of the module's error state
+ */
+typedef struct errmon_sample
+{
+	struct timespec ts; // CLOCK_MONOTONIC
+	unsigned char tx_errors;
+	unsigned char rx_errors;
+	unsigned char flags; // canbus_estate_flags_t
+	errmon_level_t level;
+	double tx_rate; // Change in tx_errors per second since the last sample
+	double rx_rate; // Change in rx_errors per second since the last sample
+} errmon_sample_t;
+
+/**
+ * What the monitor reports through its callback
+ */
+typedef enum errmon_event_type
+{
+	ERRMON_EVENT_LEVEL, // The level changed, see old_level
+	ERRMON_EVENT_RECOVERING, // Bus-off, cycling through configuration mode
+	ERRMON_EVENT_RECOVER_FAILED, // The cycle failed, err says why
+	ERRMON_EVENT_SAMPLE_FAILED // Could not read the error state
+} errmon_event_type_t;
+
+typedef struct errmon_event
+{
+	errmon_event_type_t type;
+	errmon_level_t old_level; // ERRMON_EVENT_LEVEL only
+	errmon_sample_t sample; // The latest good sample
+	int err; // errno, for the failure events
+} errmon_event_t;
+
+/**
+ * Monitor settings, see errmon_start()
+ */
+typedef struct errmon_opts
+{
+	int interval_ms; // Time between samples, 0 for ERRMON_INTERVAL_MS
+	int auto_recover; // Nonzero to recover from bus-off
+	int recover_holdoff_ms; // Least time between recoveries, 0 for default
+} errmon_opts_t;
+
+/**
+ * Monitor counters, see errmon_get_stats()
+ */
+typedef struct errmon_stats
+{
+	unsigned long samples;
+	unsigned long sample_failures;
+	unsigned long transitions; // Level changes
+	unsigned long bus_offs; // Times the module went bus-off
+	unsigned long recoveries; // Configuration mode cycles that worked
+	unsigned long recover_failures;
+} errmon_stats_t;
+
+typedef struct errmon errmon_t;
+typedef void (*errmon_event_cb)(errmon_t *mon, const errmon_event_t *event,
+	void *arg);
+
+errmon_t *errmon_start(canctl_dev_t *dev, const errmon_opts_t *opts,
+	errmon_event_cb cb, void *arg);
+void errmon_stop(errmon_t *mon);
+int errmon_get_sample(errmon_t *mon, errmon_sample_t *sample);
+void errmon_get_stats(errmon_t *mon, errmon_stats_t *stats);
+int errmon_recover(errmon_t *mon);
+errmon_level_t errmon_level_from_flags(unsigned char flags);
+const char *errmon_level_to_string(errmon_level_t level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ERRMON_H_
@@ -0,0 +1,60 @@
+/**
+ * @file evloop.h
+ * @date 2026-10-16
+ *
+ * Single-threaded event loop built on epoll(7) and timerfd(2). It lets one
+ * wait service the CANbus and GPIO modules, stdin and any number of timers,
+ * dispatching each ready event to the handler registered for it.
+ */
+
+#ifndef EVLOOP_H_
+#define EVLOOP_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#define EVLOOP_MAX_HANDLERS         32 // fds + timers watched at once
+#define EVLOOP_MAX_EVENTS           16 // Events dispatched per epoll_wait()
+
+typedef struct evloop evloop_t;
+
+/**
+ * Called when a watched file descriptor is ready.
+ * @param loop The loop dispatching the event
+ * @param fd The ready file descriptor
+ * @param events EPOLLIN, EPOLLOUT, EPOLLERR, ... as returned by epoll_wait()
+ * @param arg The pointer given to evloop_add_fd()
+ */
+typedef void (*evloop_fd_cb)(evloop_t *loop, int fd, uint32_t events,
+	void *arg);
+
+/**
+ * Called when a timer expires.
+ * @param loop The loop dispatching the event
+ * @param id The timer's ID as returned by evloop_add_timer()
+ * @param arg The pointer given to evloop_add_timer()
+ */
+typedef void (*evloop_timer_cb)(evloop_t *loop, int id, void *arg);
+
+evloop_t *evloop_create(void);
+void evloop_destroy(evloop_t *loop);
+int evloop_add_fd(evloop_t *loop, int fd, uint32_t events, evloop_fd_cb cb,
+	void *arg);
+int evloop_del_fd(evloop_t *loop, int fd);
+int evloop_add_timer(evloop_t *loop, int interval_ms, int repeat,
+	evloop_timer_cb cb, void *arg);
+int evloop_del_timer(evloop_t *loop, int id);
+int evloop_run_once(evloop_t *loop, int timeout_ms);
+int evloop_run(evloop_t *loop);
+void evloop_stop(evloop_t *loop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EVLOOP_H_
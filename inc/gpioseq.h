@@ -0,0 +1,80 @@
+/**
+ * @file gpioseq.h
+ * @date 2026-10-16
+ *
+ * Timed GPIO output sequences, e.g. lamp patterns, relay timing or software
+ * PWM. A sequence is a list of (time offset, pin mask, value) steps that
+ * can repeat with a fixed period. gpioseq_play() sleeps to each absolute
+ * CLOCK_MONOTONIC deadline and drives the pins with gpio_write_pins().
+ *
+ * Steps due within the merge window of each other share one set pin data
+ * transaction, and transactions that would not change any pin are skipped.
+ * The result tells how late each transaction completed against its
+ * deadline, which is the achievable timing on this module and host.
+ */
+
+#ifndef GPIOSEQ_H_
+#define GPIOSEQ_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "canctl.h"
+#include <signal.h>
+
+/**
+ * One step: at @c offset_us into the period, set the pins in @c mask to the
+ * matching bits of @c value. Bit 0 is pin 1.
+ */
+typedef struct gpioseq_step
+{
+	unsigned long offset_us;
+	uint8_t mask;
+	uint8_t value;
+} gpioseq_step_t;
+
+/**
+ * Playback settings, see gpioseq_play()
+ */
+typedef struct gpioseq_opts
+{
+	unsigned long cycles; // Times to play the sequence, 0 until stopped
+	unsigned long merge_us; // Steps this close share a transaction
+	volatile sig_atomic_t *stop; // Ends playback early when nonzero, or NULL
+} gpioseq_opts_t;
+
+/**
+ * What playback achieved
+ */
+typedef struct gpioseq_result
+{
+	unsigned long cycles; // Periods played in full
+	unsigned long steps; // Steps played
+	unsigned long transactions; // Set pin data reports sent
+	unsigned long skipped; // Batches that would not have changed any pin
+	unsigned long late; // Batches still waiting on the previous one when due
+	double elapsed_s;
+	canctl_hist_t error; // Deadline to transaction complete
+} gpioseq_result_t;
+
+typedef struct gpioseq gpioseq_t;
+
+gpioseq_t *gpioseq_create(void);
+void gpioseq_destroy(gpioseq_t *seq);
+int gpioseq_add(gpioseq_t *seq, unsigned long offset_us, uint8_t mask,
+	uint8_t value);
+int gpioseq_add_pwm(gpioseq_t *seq, uint8_t mask, unsigned long period_us,
+	unsigned int duty_pct);
+void gpioseq_set_period(gpioseq_t *seq, unsigned long period_us);
+unsigned long gpioseq_get_period(const gpioseq_t *seq);
+uint8_t gpioseq_get_mask(const gpioseq_t *seq);
+int gpioseq_play(canctl_dev_t *dev, gpioseq_t *seq, const gpioseq_opts_t *opts,
+	gpioseq_result_t *res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GPIOSEQ_H_
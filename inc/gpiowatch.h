@@ -0,0 +1,81 @@
+/**
+ * @file gpiowatch.h
+ * @date 2026-10-16
+ *
+ * GPIO input change detection. The GPIO module has no interrupt report, so
+ * a thread polls the pin data and diffs each snapshot against the last one
+ * as a bitmask. Every changed pin becomes a time stamped edge event, handed
+ * to a callback or queued for gpiowatch_read().
+ *
+ * The poll interval adapts: any edge snaps it to the minimum, and each run
+ * of idle polls doubles it up to the maximum. Busy pins are sampled at the
+ * full rate while idle ones cost little USB bandwidth or CPU.
+ */
+
+#ifndef GPIOWATCH_H_
+#define GPIOWATCH_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "canctl.h"
+
+#define GPIOWATCH_MIN_INTERVAL_US   1000 // Default fastest poll
+#define GPIOWATCH_MAX_INTERVAL_US   50000 // Default slowest poll
+#define GPIOWATCH_IDLE_POLLS        8 // Default idle polls before backing off
+#define GPIOWATCH_QUEUE_SIZE        256 // Events held for gpiowatch_read()
+
+/**
+ * One input edge. Bit 0 of a mask is pin 1.
+ */
+typedef struct gpiowatch_event
+{
+	struct timespec ts; // CLOCK_MONOTONIC, when the poll saw the edge
+	unsigned long window_us; // The edge happened at most this long before ts
+	int pin; // 1 to GPIO_PIN_COUNT
+	int level; // The pin's new level, 0 or 1
+	uint8_t levels; // Every pin's level in the same snapshot
+} gpiowatch_event_t;
+
+/**
+ * Watcher settings, see gpiowatch_start(). Zeroes pick the defaults.
+ */
+typedef struct gpiowatch_opts
+{
+	unsigned long min_interval_us;
+	unsigned long max_interval_us;
+	unsigned int idle_polls; // Polls without an edge before backing off
+	uint8_t mask; // Pins to watch, 0 for all of them
+} gpiowatch_opts_t;
+
+/**
+ * Watcher counters, see gpiowatch_get_stats()
+ */
+typedef struct gpiowatch_stats
+{
+	unsigned long polls;
+	unsigned long poll_failures;
+	unsigned long events;
+	unsigned long overflows; // Events lost because the queue was full
+	unsigned long interval_us; // Current poll interval
+} gpiowatch_stats_t;
+
+typedef struct gpiowatch gpiowatch_t;
+typedef void (*gpiowatch_cb)(gpiowatch_t *w, const gpiowatch_event_t *event,
+	void *arg);
+
+gpiowatch_t *gpiowatch_start(canctl_dev_t *dev, const gpiowatch_opts_t *opts,
+	gpiowatch_cb cb, void *arg);
+void gpiowatch_stop(gpiowatch_t *w);
+int gpiowatch_event_fd(gpiowatch_t *w);
+size_t gpiowatch_read(gpiowatch_t *w, gpiowatch_event_t *events, size_t max);
+int gpiowatch_error(gpiowatch_t *w);
+void gpiowatch_get_stats(gpiowatch_t *w, gpiowatch_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GPIOWATCH_H_
@@ -0,0 +1,48 @@
+/**
+ * @file hex.h
+ * @date 2026-10-16
+ *
+ * Table-driven hex formatting for reports and frames. Each function renders
+ * into a caller buffer without touching stdio, so a whole report or frame
+ * can be handed to the stream in a single fwrite().
+ *
+ * The parsers go the other way in one pass without allocating. Bytes are
+ * hex, with or without 0x, separated by spaces, tabs or commas:
+ *   ec 00                a report
+ *   0xca,0x01,0x0b       also a report
+ *   123: de ad be ef     a CAN frame with standard ID 0x123
+ *   18fef100: 01 02      a CAN frame with an extended ID
+ * IDs above 0x7ff or written with more than 3 digits are extended.
+ */
+
+#ifndef HEX_H_
+#define HEX_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "canctl.h"
+
+#define HEX_ROW_BYTES               16 // Bytes per hex_format_rows() row
+#define HEX_ROW_SIZE(pad)           ((pad) + 44 + 3 * HEX_ROW_BYTES + 1)
+#define HEX_FRAME_SIZE              96 // Enough for any hex_format_frame()
+
+size_t hex_format_bytes(char *out, size_t size, const unsigned char *buf,
+	size_t len);
+size_t hex_format_rows(char *out, size_t size, const unsigned char *buf,
+	size_t len, size_t base, unsigned int pad);
+size_t hex_format_frame(char *out, size_t size, const canbus_frame_t *frame);
+int hex_parse_bytes(const char *s, size_t len, unsigned char *out, size_t max,
+	size_t *errpos);
+int hex_parse_frame(const char *s, size_t len, canbus_frame_t *frame,
+	size_t *errpos);
+int hex_is_frame(const char *s, size_t len);
+const char *hex_error_to_string(int err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEX_H_
@@ -0,0 +1,44 @@
+/**
+ * @file metrics.h
+ * @date 2026-10-16
+ *
+ * Exports the counters of canctl_get_stats() in the Prometheus text format,
+ * one series per module labelled device="...". A thread rewrites a
+ * node_exporter textfile every interval, replacing it atomically, and
+ * answers connections on a Unix socket with a fresh snapshot, e.g.
+ *   socat - UNIX-CONNECT:/run/canctl.prom.sock
+ * The error gauges show the last canctl_get_error_state() call; the exporter
+ * never sends commands to the modules itself.
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "canctl.h"
+
+#define METRICS_PREFIX              "canctl_"
+#define METRICS_MAX_DEVICES         32
+#define METRICS_LABEL_SIZE          64
+#define METRICS_INTERVAL_MS         15000 // Default textfile refresh
+
+typedef struct metrics metrics_t;
+
+metrics_t *metrics_create(void);
+void metrics_destroy(metrics_t *m);
+int metrics_add_device(metrics_t *m, canctl_dev_t *dev, const char *label);
+int metrics_remove_device(metrics_t *m, const canctl_dev_t *dev);
+size_t metrics_format(metrics_t *m, char *buf, size_t size);
+int metrics_write_textfile(metrics_t *m, const char *path);
+int metrics_start(metrics_t *m, const char *textfile, const char *sockpath,
+	int interval_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_H_
@@ -0,0 +1,55 @@
+/**
+ * @file session.h
+ * @date 2026-10-16
+ *
+ * Supervised session on a CANbus module. If the module resets or
+ * re-enumerates, the session finds it again by its physical address,
+ * restores its configuration and bus speed, and carries on. Reports written
+ * while the module is gone stay queued and are sent once it is back.
+ */
+
+#ifndef SESSION_H_
+#define SESSION_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "canctl.h"
+
+#define SESSION_TX_QUEUE_SIZE       64 // Reports held while disconnected
+#define SESSION_RETRY_MS            250 // Time between reconnect attempts
+#define SESSION_PHYS_SIZE           128
+
+/**
+ * What a session reports through its notify callback
+ */
+typedef enum session_event
+{
+	SESSION_EVENT_LOST, // The module went away, reconnecting
+	SESSION_EVENT_RESTORED, // The module is back and reconfigured
+	SESSION_EVENT_GAVE_UP // The module did not come back in time
+} session_event_t;
+
+typedef struct session session_t;
+typedef void (*session_notify_cb)(session_t *s, session_event_t event,
+	void *arg);
+
+session_t *session_create(canctl_dev_t *dev, int reconnect_ms);
+void session_destroy(session_t *s);
+void session_set_notify(session_t *s, session_notify_cb cb, void *arg);
+int session_read(session_t *s, unsigned char *buf, size_t len);
+int session_write(session_t *s, const unsigned char *buf, size_t len);
+int session_send_frames(session_t *s, const canbus_frame_t *frames,
+	size_t n);
+int session_flush(session_t *s);
+size_t session_pending(const session_t *s);
+int session_recover(session_t *s);
+unsigned long session_reconnects(const session_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SESSION_H_
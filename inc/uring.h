@@ -0,0 +1,63 @@
+/**
+ * @file uring.h
+ * @date 2026-10-16
+ *
+ * io_uring I/O for a module's file descriptor, driven through the raw
+ * system calls so no liburing is needed. A receive ring keeps several reads
+ * posted on the fd at once: reports land in its buffers without a read()
+ * each, and reports that are already complete are picked up from shared
+ * memory without entering the kernel at all. On a non-blocking file such as
+ * hidraw, reads that find nothing are parked behind a single poll instead
+ * of being retried, so an idle module costs one wakeup per report rather
+ * than one per posted read. A transmit ring hands a whole
+ * batch of reports to the kernel in one system call, linked so they go out
+ * in order.
+ *
+ * Each ring is either a receive ring or a transmit ring and is used by one
+ * thread at a time. Where the kernel or the headers lack io_uring,
+ * uring_available() is 0 and uring_create() fails with ENOSYS, so callers
+ * can fall back to plain read() and write().
+ */
+
+#ifndef URING_H_
+#define URING_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "canctl.h"
+#include <sys/uio.h> // struct iovec
+
+#define URING_READ_DEPTH            8 // Reads a receive ring keeps posted
+#define URING_WRITE_BATCH           32 // Most reports per uring_write() batch
+
+/**
+ * Ring counters, see uring_get_stats()
+ */
+typedef struct uring_stats
+{
+	unsigned long enters; // io_uring_enter() system calls
+	unsigned long completions; // Completions reaped
+	unsigned long reads; // Reads that returned a report
+	unsigned long writes; // Writes that sent a whole report
+	unsigned long retries; // Reads the kernel bounced with EAGAIN and parked
+} uring_stats_t;
+
+typedef struct uring uring_t;
+
+int uring_available(void);
+uring_t *uring_create(int fd, unsigned int nreads);
+void uring_destroy(uring_t *u);
+int uring_read(uring_t *u, unsigned char *buf, size_t len, int timeout_ms);
+int uring_drain(uring_t *u, unsigned char *buf, size_t len);
+int uring_write(uring_t *u, const struct iovec *iov, size_t n,
+	int timeout_ms);
+void uring_get_stats(const uring_t *u, uring_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // URING_H_
@@ -0,0 +1,627 @@
+/**
+ * @file bench.c
+ * @date 2026-10-16
+ */
+
+#include "bench.h"
+#include "hex.h"
+#include <poll.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/**
+ * @returns Returns the current CLOCK_MONOTONIC time in nanoseconds
+ */
+static uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+} // bench_now_ns()
+
+/**
+ * qsort() comparator for uint64_t
+ */
+static int bench_cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x < y ? -1 : x > y);
+} // bench_cmp_u64()
+
+/**
+ * Sorts the samples and picks the nearest-rank percentiles.
+ * @param samples_ns Latency samples in nanoseconds, sorted in place
+ * @param n Number of samples
+ * @param lat Filled with the percentiles in microseconds, all 0 if n is 0
+ */
+void bench_percentiles(uint64_t *samples_ns, size_t n, bench_latency_t *lat)
+{
+	memset(lat, 0, sizeof(*lat));
+	if (n == 0)
+		return;
+	qsort(samples_ns, n, sizeof(samples_ns[0]), bench_cmp_u64);
+	lat->p50 = samples_ns[(n - 1) * 50 / 100] / 1000.0;
+	lat->p90 = samples_ns[(n - 1) * 90 / 100] / 1000.0;
+	lat->p99 = samples_ns[(n - 1) * 99 / 100] / 1000.0;
+	lat->max = samples_ns[n - 1] / 1000.0;
+} // bench_percentiles()
+
+/**
+ * Fills a USB echo report. The sequence number goes in bytes 1-4 and the
+ * rest is a pattern derived from it, so a corrupted or misrouted echo can
+ * be told apart from a good one.
+ * @param buf CANBUS_MSG_SIZE byte report to fill
+ * @param seq Sequence number of this round trip
+ */
+static void bench_fill_echo(unsigned char *buf, uint32_t seq)
+{
+	buf[0] = CANBUS_OUT_USB_TEST;
+	buf[1] = (seq >> 24) & 0xff;
+	buf[2] = (seq >> 16) & 0xff;
+	buf[3] = (seq >> 8) & 0xff;
+	buf[4] = (seq >> 0) & 0xff;
+	for (int i = 5; i < CANBUS_MSG_SIZE; i++)
+		buf[i] = (unsigned char)(seq * 31 + i);
+} // bench_fill_echo()
+
+/**
+ * Runs the CANBUS_OUT_USB_TEST echo @c opts->count times with up to
+ * @c opts->depth reports in flight, and reports round-trip latency
+ * percentiles and reports per second. Nothing else may read from the
+ * module while this runs.
+ * @param dev The CANbus module's handle
+ * @param opts Benchmark parameters
+ * @param out Stream to print the results to
+ * @returns Returns 0 on success, -1 on error
+ */
+int bench_usb_echo(canctl_dev_t *dev, const bench_opts_t *opts, FILE *out)
+{
+	unsigned char tx[CANBUS_MSG_SIZE], rx[CANBUS_MSG_SIZE];
+	uint64_t sent_ns[BENCH_MAX_DEPTH];
+	uint64_t *lat_ns, start, elapsed;
+	unsigned long sent = 0, done = 0, mismatched = 0, timeouts = 0;
+	struct pollfd pfd;
+	bench_latency_t lat;
+	int depth = opts->depth, rc = 0, nbytes;
+
+	if (depth < 1)
+		depth = 1;
+	else if (depth > BENCH_MAX_DEPTH)
+		depth = BENCH_MAX_DEPTH;
+	if (opts->count == 0 ||
+		(lat_ns = malloc(opts->count * sizeof(*lat_ns))) == NULL)
+		return (-1); // @todo Return a better error indicator
+	pfd.fd = canctl_get_fd(dev);
+	pfd.events = POLLIN;
+
+	start = bench_now_ns();
+	while (done < opts->count && !(opts->stop != NULL && *opts->stop))
+	{
+		// Keep the pipeline full
+		while (sent < opts->count && sent - done < (unsigned long)depth)
+		{
+			bench_fill_echo(tx, sent);
+			sent_ns[sent % depth] = bench_now_ns();
+			if (canctl_write(dev, tx, sizeof(tx)) != sizeof(tx))
+			{
+				rc = -1;
+				goto out;
+			}
+			sent++;
+		}
+
+		if ((nbytes = poll(&pfd, 1, opts->timeout_ms)) == 0)
+		{
+			// The echoes in flight are not coming back
+			timeouts += sent - done;
+			break;
+		}
+		else if (nbytes < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			rc = -1;
+			break;
+		}
+		if ((nbytes = canctl_recv(dev, rx, sizeof(rx))) < 0)
+		{
+			if (errno == EAGAIN)
+				continue;
+			rc = -1;
+			break;
+		}
+		if (nbytes < 5 || rx[0] != CANBUS_IN_USB_TEST)
+			continue; // Not an echo, e.g. CAN traffic
+
+		// Echoes come back in order, so this must be the oldest one
+		bench_fill_echo(tx, done);
+		if (nbytes != CANBUS_MSG_SIZE || memcmp(tx, rx, nbytes) != 0)
+			mismatched++;
+		lat_ns[done] = bench_now_ns() - sent_ns[done % depth];
+		done++;
+	}
+	elapsed = bench_now_ns() - start;
+
+	bench_percentiles(lat_ns, done, &lat);
+	if (opts->json)
+		fprintf(out, "{\"bench\":\"usb_echo\",\"count\":%lu,\"depth\":%d,"
+			"\"completed\":%lu,\"mismatched\":%lu,\"timeouts\":%lu,"
+			"\"elapsed_s\":%.6f,\"reports_per_s\":%.1f,"
+			"\"latency_us\":{\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,"
+			"\"max\":%.1f}}\n",
+			opts->count, depth, done, mismatched, timeouts, elapsed / 1e9,
+			elapsed ? done * 1e9 / elapsed : 0.0,
+			lat.p50, lat.p90, lat.p99, lat.max);
+	else
+	{
+		fprintf(out, "USB echo: %lu of %lu round trips, depth %d, %.3f s\n",
+			done, opts->count, depth, elapsed / 1e9);
+		fprintf(out, "  Reports/s:    %.1f\n",
+			elapsed ? done * 1e9 / elapsed : 0.0);
+		fprintf(out, "  Latency (us): p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+			lat.p50, lat.p90, lat.p99, lat.max);
+		fprintf(out, "  Mismatched:   %lu\n", mismatched);
+		fprintf(out, "  Timed out:    %lu\n", timeouts);
+	}
+	if (mismatched > 0 || timeouts > 0)
+		rc = -1;
+
+out:
+	free(lat_ns);
+	return (rc);
+} // bench_usb_echo()
+
+/**
+ * Puts @c n sequence-numbered test frames starting at @c seq into
+ * @c frames. Bytes 0-3 hold the sequence number and bytes 4-7 its
+ * complement, so corruption is caught on receive.
+ */
+static void bench_fill_frames(canbus_frame_t *frames, uint32_t seq, size_t n)
+{
+	for (size_t i = 0; i < n; i++, seq++)
+	{
+		memset(&frames[i], 0, sizeof(frames[i]));
+		frames[i].id = BENCH_CAN_ID;
+		frames[i].ext = 1;
+		frames[i].dlc = 8;
+		for (int b = 0; b < 4; b++)
+		{
+			frames[i].data[b] = (seq >> (24 - 8 * b)) & 0xff;
+			frames[i].data[b + 4] = ~frames[i].data[b];
+		}
+	}
+} // bench_fill_frames()
+
+/**
+ * Puts the module back the way bench_can_loopback() found it.
+ * @param dev The CANbus module's handle
+ * @param cfg The configuration mode to restore
+ * @param speed The bus speed to restore, 0 if unknown to leave the speed alone
+ * @returns Returns 0 on success, -1 on error
+ */
+static int bench_restore(canctl_dev_t *dev, canbus_cfg_t cfg,
+	unsigned int speed)
+{
+	// Going through configuration mode sets the speed as well
+	if (speed == 0)
+		return (canctl_set_config(dev, cfg, 0));
+	if (canctl_set_config(dev, CANBUS_CFG_CONFIGURATION, speed) < 0)
+		return (-1);
+	if (cfg != CANBUS_CFG_CONFIGURATION &&
+		canctl_set_config(dev, cfg, 0) < 0)
+		return (-1);
+	return (0);
+} // bench_restore()
+
+/**
+ * Puts the module in CANBUS_CFG_LOOPBACK and streams @c opts->count
+ * sequence-numbered frames at @c opts->rate frames per second (or flat out
+ * if 0) while a reader thread collects what loops back. Reports frames per
+ * second, loss, reordering, duplicates, corruption and send-to-receive
+ * latency, then restores the module's original configuration.
+ * @param dev The CANbus module's handle
+ * @param opts Benchmark parameters
+ * @param out Stream to print the results to
+ * @returns Returns 0 on success, -1 on error or if any frame was lost
+ */
+int bench_can_loopback(canctl_dev_t *dev, const bench_opts_t *opts,
+	FILE *out)
+{
+	canctl_ring_t *ring = NULL;
+	canctl_reader_t *reader = NULL;
+	canbus_frame_t frames[64];
+	unsigned char *seen = NULL;
+	uint64_t *sent_ns = NULL, *lat_ns = NULL;
+	uint64_t start, now, send_end = 0, elapsed, wait_ns;
+	unsigned long sent = 0, received = 0, reordered = 0, duplicates = 0;
+	unsigned long corrupted = 0, last_seq = 0;
+	canbus_cfg_t orig, last_cfg;
+	unsigned int orig_speed = opts->speed;
+	clockid_t orig_clock = canctl_get_clock(dev);
+	bench_latency_t lat;
+	canctl_stats_t stats_before, stats_after;
+	unsigned long syscalls, retries;
+	struct pollfd pfd;
+	uint64_t events;
+	size_t n;
+	int rc = -1;
+
+	if (opts->count == 0 || opts->count > UINT32_MAX)
+		return (-1); // @todo Return a better error indicator
+
+	// Remember how to put the module back. The module can not report its
+	// bus speed, so use the last one set through this handle, else the
+	// caller's. With neither, switch modes without touching the speed.
+	if ((orig = canctl_get_config(dev)) == (canbus_cfg_t)-1)
+		return (-1);
+	if (canctl_get_last_config(dev, &last_cfg, &orig_speed) < 0 ||
+		orig_speed == 0)
+		orig_speed = opts->speed;
+	if (orig_speed == 0)
+	{
+		// Configuration mode can only be entered with a speed
+		if (orig == CANBUS_CFG_CONFIGURATION)
+		{
+			fprintf(stderr, "ERROR: The CANbus module is in configuration "
+				"mode at an unknown bus speed, pass it with --speed\n");
+			return (-1); // @todo Return a better error indicator
+		}
+		fprintf(stderr, "WARNING: The CANbus bus speed is unknown, running "
+			"the loopback test at the module's current speed. Pass it with "
+			"--speed to set it\n");
+	}
+
+	if ((ring = malloc(sizeof(*ring))) == NULL ||
+		(seen = calloc(opts->count, 1)) == NULL ||
+		(sent_ns = malloc(opts->count * sizeof(*sent_ns))) == NULL ||
+		(lat_ns = malloc(opts->count * sizeof(*lat_ns))) == NULL)
+		goto out;
+
+	if ((orig_speed != 0 && canctl_set_config(dev,
+		CANBUS_CFG_CONFIGURATION, orig_speed) < 0) ||
+		canctl_set_config(dev, CANBUS_CFG_LOOPBACK, 0) < 0)
+		goto restore;
+	// Latency is measured against the receive stamps
+	canctl_set_clock(dev, CLOCK_MONOTONIC);
+	if ((reader = canctl_reader_start(dev, ring)) == NULL)
+		goto restore;
+	pfd.fd = canctl_reader_event_fd(reader);
+	pfd.events = POLLIN;
+
+	rc = 0;
+	canctl_get_stats(dev, &stats_before);
+	start = bench_now_ns();
+	while (!(opts->stop != NULL && *opts->stop))
+	{
+		now = bench_now_ns();
+		wait_ns = (uint64_t)opts->timeout_ms * 1000000ULL;
+		if (sent < opts->count)
+		{
+			// Frames due by now: all of them when flat out
+			unsigned long due = opts->count;
+			if (opts->rate > 0)
+				due = (now - start) * opts->rate / 1000000000ULL + 1;
+			// Several reports per send, so a backend that batches them
+			// has something to batch
+			n = due > sent ? due - sent : 0;
+			if (n > sizeof(frames) / sizeof(frames[0]))
+				n = sizeof(frames) / sizeof(frames[0]);
+			if (n > opts->count - sent)
+				n = opts->count - sent;
+
+			if (n > 0)
+			{
+				bench_fill_frames(frames, sent, n);
+				for (size_t i = 0; i < n; i++)
+					sent_ns[sent + i] = now;
+				if (canctl_send_frames(dev, frames, n) != (int)n)
+				{
+					rc = -1;
+					break;
+				}
+				sent += n;
+				if (sent == opts->count)
+					send_end = bench_now_ns();
+				wait_ns = 0;
+			}
+			else
+				wait_ns = start + sent * 1000000000ULL / opts->rate - now;
+		}
+		else if (received >= sent)
+			break; // Everything came back
+
+		// Wait for loopback frames, or until the next frame is due. Frames
+		// that fall behind schedule are caught up in the next passes.
+		pfd.revents = 0;
+		if (wait_ns > 0 &&
+			poll(&pfd, 1, (wait_ns + 999999) / 1000000) == 0 &&
+			sent == opts->count)
+			break; // The rest is not coming back
+		if (pfd.revents & POLLIN)
+		{
+			ssize_t nbytes = read(pfd.fd, &events, sizeof(events));
+			(void)nbytes; // Failure means it was already cleared
+		}
+
+		while ((n = canctl_ring_pop(ring, frames, 64)) > 0)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				const uint8_t *d = frames[i].data;
+				unsigned long seq = (unsigned long)d[0] << 24 |
+					d[1] << 16 | d[2] << 8 | d[3];
+
+				if (frames[i].id != BENCH_CAN_ID || frames[i].dlc != 8 ||
+					seq >= sent || (d[4] ^ d[0]) != 0xff ||
+					(d[5] ^ d[1]) != 0xff || (d[6] ^ d[2]) != 0xff ||
+					(d[7] ^ d[3]) != 0xff)
+				{
+					corrupted++;
+					continue;
+				}
+				if (seen[seq])
+				{
+					duplicates++;
+					continue;
+				}
+				seen[seq] = 1;
+				if (received > 0 && seq < last_seq)
+					reordered++;
+				last_seq = seq;
+				lat_ns[received++] = (uint64_t)frames[i].ts.tv_sec *
+					1000000000ULL + frames[i].ts.tv_nsec - sent_ns[seq];
+			}
+		}
+		if (canctl_reader_error(reader) != 0)
+		{
+			rc = -1;
+			break;
+		}
+	}
+	elapsed = bench_now_ns() - start;
+	if (send_end == 0)
+		send_end = bench_now_ns();
+	// Reader thread and sends alike, the I/O cost of moving the frames
+	canctl_get_stats(dev, &stats_after);
+	syscalls = stats_after.io_syscalls - stats_before.io_syscalls;
+	retries = stats_after.io_retries - stats_before.io_retries;
+
+	bench_percentiles(lat_ns, received, &lat);
+	if (opts->json)
+		fprintf(out, "{\"bench\":\"can_loopback\",\"count\":%lu,"
+			"\"rate\":%lu,\"sent\":%lu,\"received\":%lu,\"lost\":%lu,"
+			"\"reordered\":%lu,\"duplicates\":%lu,\"corrupted\":%lu,"
+			"\"elapsed_s\":%.6f,\"tx_frames_per_s\":%.1f,"
+			"\"rx_frames_per_s\":%.1f,\"io_syscalls\":%lu,\"io_retries\":%lu,"
+			"\"latency_us\":{\"p50\":%.1f,"
+			"\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f}}\n",
+			opts->count, opts->rate, sent, received, sent - received,
+			reordered, duplicates, corrupted, elapsed / 1e9,
+			sent * 1e9 / (send_end - start), received * 1e9 / elapsed,
+			syscalls, retries, lat.p50, lat.p90, lat.p99, lat.max);
+	else
+	{
+		fprintf(out, "CAN loopback: %lu of %lu frames sent, %s, %.3f s\n",
+			sent, opts->count, opts->rate ? "paced" : "flat out",
+			elapsed / 1e9);
+		if (opts->rate)
+			fprintf(out, "  Target rate:  %lu frames/s\n", opts->rate);
+		fprintf(out, "  Tx frames/s:  %.1f\n",
+			sent * 1e9 / (send_end - start));
+		fprintf(out, "  Rx frames/s:  %.1f\n", received * 1e9 / elapsed);
+		fprintf(out, "  Received:     %lu\n", received);
+		fprintf(out, "  Lost:         %lu\n", sent - received);
+		fprintf(out, "  Reordered:    %lu\n", reordered);
+		fprintf(out, "  Duplicates:   %lu\n", duplicates);
+		fprintf(out, "  Corrupted:    %lu\n", corrupted);
+		fprintf(out, "  Latency (us): p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+			lat.p50, lat.p90, lat.p99, lat.max);
+		fprintf(out, "  I/O syscalls: %lu (%.2f per frame, %s)\n", syscalls,
+			sent ? (double)syscalls / sent : 0.0,
+			canctl_get_io(dev) == CANCTL_IO_URING ? "io_uring" : "read/write");
+		if (canctl_get_io(dev) == CANCTL_IO_URING)
+			fprintf(out, "  I/O retries:  %lu (%.2f per frame)\n", retries,
+				sent ? (double)retries / sent : 0.0);
+		if (canctl_ring_overflows(ring) > 0)
+			fprintf(out, "  Ring overflows: %lu\n",
+				canctl_ring_overflows(ring));
+	}
+	if (received < sent || corrupted > 0)
+		rc = -1;
+
+restore:
+	canctl_reader_stop(reader);
+	canctl_set_clock(dev, orig_clock);
+	if (bench_restore(dev, orig, orig_speed) < 0)
+	{
+		fprintf(stderr, "WARNING: Could not restore the CANbus "
+			"configuration to %s\n", canctl_config_to_string(orig));
+		rc = -1;
+	}
+out:
+	free(lat_ns);
+	free(sent_ns);
+	free(seen);
+	free(ring);
+	return (rc);
+} // bench_can_loopback()
+
+/**
+ * The per-byte printf() rendering print_bytes() used before hex.h, kept as
+ * the baseline for bench_hexfmt().
+ */
+static void bench_legacy_rows(FILE *fs, const unsigned char *buf, size_t len,
+	int pad)
+{
+	size_t nrows = (len + 15) / 16;
+
+	for (size_t r = 0; r < nrows; r++)
+	{
+		fprintf(fs, "%*s[%02ld-%02ld] ", pad, "", r * 16, r * 16 + 15);
+		for (size_t i = r * 16; i < len && i < r * 16 + 16; i++)
+			fprintf(fs, "%02x ", buf[i]);
+		fprintf(fs, "\n");
+	}
+} // bench_legacy_rows()
+
+/**
+ * The fprintf() rendering print_frame() used before hex.h, kept as the
+ * baseline for bench_hexfmt().
+ */
+static void bench_legacy_frame(FILE *fs, const canbus_frame_t *frame)
+{
+	fprintf(fs, "  (%ld.%06ld) %*s%0*x [%d]", (long)frame->ts.tv_sec,
+		frame->ts.tv_nsec / 1000, frame->ext ? 0 : 5, "",
+		frame->ext ? 8 : 3, frame->id, frame->dlc);
+	for (int i = 0; i < frame->dlc; i++)
+		fprintf(fs, " %02x", frame->data[i]);
+	fprintf(fs, "\n");
+} // bench_legacy_frame()
+
+/**
+ * Renders one report with hex_format_rows() and its frames with
+ * hex_format_frame(), the way print_bytes() and print_frame() do.
+ */
+static void bench_table_report(FILE *fs, const unsigned char *buf,
+	const canbus_frame_t *frames, size_t nframes)
+{
+	char out[HEX_ROW_SIZE(2) * (CANBUS_MSG_SIZE / HEX_ROW_BYTES)];
+	char line[HEX_FRAME_SIZE];
+
+	fwrite(out, 1, hex_format_rows(out, sizeof(out), buf, CANBUS_MSG_SIZE, 0,
+		2), fs);
+	for (size_t i = 0; i < nframes; i++)
+		fwrite(line, 1, hex_format_frame(line, sizeof(line), &frames[i]), fs);
+} // bench_table_report()
+
+/**
+ * Renders one report and its frames the way main.c used to.
+ */
+static void bench_legacy_report(FILE *fs, const unsigned char *buf,
+	const canbus_frame_t *frames, size_t nframes)
+{
+	bench_legacy_rows(fs, buf, CANBUS_MSG_SIZE, 2);
+	for (size_t i = 0; i < nframes; i++)
+		bench_legacy_frame(fs, &frames[i]);
+} // bench_legacy_report()
+
+/**
+ * Checks that both renderings of a report produce the same text.
+ * @returns Returns 1 if they match, 0 if not, -1 on error
+ */
+static int bench_hexfmt_same(const unsigned char *buf,
+	const canbus_frame_t *frames, size_t nframes)
+{
+	char *a = NULL, *b = NULL;
+	size_t alen = 0, blen = 0;
+	FILE *fa, *fb;
+	int rc = -1;
+
+	if ((fa = open_memstream(&a, &alen)) == NULL)
+		return (-1);
+	if ((fb = open_memstream(&b, &blen)) != NULL)
+	{
+		bench_legacy_report(fa, buf, frames, nframes);
+		bench_table_report(fb, buf, frames, nframes);
+		fclose(fb);
+		fflush(fa);
+		rc = alen == blen && memcmp(a, b, alen) == 0;
+	}
+	fclose(fa);
+	free(a);
+	free(b);
+	return (rc);
+} // bench_hexfmt_same()
+
+/**
+ * Renders @c opts->count reports, each as hex rows followed by its four
+ * decoded frames, through the old per-byte printf() path and through
+ * hex.h, into /dev/null. Reports the time per report for both and the
+ * speedup. Needs no module.
+ * @param opts Benchmark parameters, only @c count, @c json and @c stop
+ * are used
+ * @param out Stream to print the results to
+ * @returns Returns 0 on success, -1 on error or if the outputs differ
+ */
+int bench_hexfmt(const bench_opts_t *opts, FILE *out)
+{
+	unsigned char buf[CANBUS_MSG_SIZE];
+	canbus_frame_t frames[CANBUS_FRAMES_PER_REPORT];
+	uint64_t start, legacy_ns = 0, table_ns = 0;
+	unsigned long done = 0;
+	FILE *sink;
+	int same;
+
+	if (opts->count == 0)
+		return (-1); // @todo Return a better error indicator
+
+	// A typical report: four extended frames with varied payloads
+	bench_fill_frames(frames, 0x12345678, CANBUS_FRAMES_PER_REPORT);
+	frames[1].ext = 0; // And a short standard one
+	frames[1].id = 0x123;
+	frames[1].dlc = 3;
+	for (int i = 0; i < CANBUS_FRAMES_PER_REPORT; i++)
+		clock_gettime(CLOCK_REALTIME, &frames[i].ts);
+	if (canctl_encode_frames(buf, sizeof(buf), frames,
+		CANBUS_FRAMES_PER_REPORT) < 0)
+		return (-1);
+	if ((same = bench_hexfmt_same(buf, frames,
+		CANBUS_FRAMES_PER_REPORT)) < 0)
+		return (-1);
+	if ((sink = fopen("/dev/null", "w")) == NULL)
+		return (-1);
+
+	// Alternate the two in batches so both see the same cache and CPU
+	// frequency conditions
+	while (done < opts->count && !(opts->stop != NULL && *opts->stop))
+	{
+		unsigned long batch = opts->count - done < 1000 ?
+			opts->count - done : 1000;
+
+		start = bench_now_ns();
+		for (unsigned long i = 0; i < batch; i++)
+		{
+			buf[2] = (unsigned char)i;
+			bench_legacy_report(sink, buf, frames, CANBUS_FRAMES_PER_REPORT);
+		}
+		fflush(sink);
+		legacy_ns += bench_now_ns() - start;
+
+		start = bench_now_ns();
+		for (unsigned long i = 0; i < batch; i++)
+		{
+			buf[2] = (unsigned char)i;
+			bench_table_report(sink, buf, frames, CANBUS_FRAMES_PER_REPORT);
+		}
+		fflush(sink);
+		table_ns += bench_now_ns() - start;
+		done += batch;
+	}
+	fclose(sink);
+	if (done == 0)
+		return (-1);
+
+	if (opts->json)
+		fprintf(out, "{\"bench\":\"hexfmt\",\"count\":%lu,"
+			"\"identical\":%s,\"printf_ns_per_report\":%.1f,"
+			"\"table_ns_per_report\":%.1f,\"speedup\":%.2f}\n",
+			done, same ? "true" : "false", (double)legacy_ns / done,
+			(double)table_ns / done, (double)legacy_ns / table_ns);
+	else
+	{
+		fprintf(out, "Hex formatting: %lu reports of %d bytes + %d frames\n",
+			done, CANBUS_MSG_SIZE, CANBUS_FRAMES_PER_REPORT);
+		fprintf(out, "  printf (ns/report): %.1f\n",
+			(double)legacy_ns / done);
+		fprintf(out, "  table (ns/report):  %.1f\n", (double)table_ns / done);
+		fprintf(out, "  Speedup:            %.2fx\n",
+			(double)legacy_ns / table_ns);
+		fprintf(out, "  Identical output:   %s\n", same ? "yes" : "NO");
+	}
+	return (same ? 0 : -1);
+} // bench_hexfmt()
@@ -4,48 +4,639 @@
  */
 
 #include "canctl.h"
+#include "canfilter.h"
+#include "uring.h"
 #include <stdio.h>
 #include <sys/time.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stddef.h> // offsetof()
+#include <sys/eventfd.h>
 
-static int _timeout_ms = CANBUS_DEFAULT_TIMEOUT_MS;
-void canctl_set_timeout_ms(int ms) { _timeout_ms = ms; }
-int canctl_get_timeout_ms(void) { return (_timeout_ms); }
+/**
+ * Everything one module needs: its fd, timeout, statistics and the report
+ * demultiplexer. Nothing in this file keeps state outside of a handle, so
+ * separate handles can be driven from separate threads without locking.
+ *
+ * The demultiplexer routes incoming reports by report ID. A command (see
+ * canctl_command()) registers the report ID it waits for in the
+ * pending-command slot; any report that does not match it goes to the data
+ * path instead of being thrown away. While a reader thread owns the fd it
+ * does all the reading and the command only waits on @c cond for its slot
+ * to be filled. The same goes while canctl_read() waits on the fd, so a
+ * command issued from another thread does not steal its data.
+ *
+ * Asynchronous commands (see canctl_submit()) queue up behind each other in
+ * @c async instead. A reply completes the oldest queued command waiting for
+ * its report ID, which is the one the module answers first since it handles
+ * commands in order. They are checked before the pending-command slot: a
+ * blocking command holds @c cmd_lock until its reply arrives, so whatever is
+ * queued was sent before it.
+ */
+struct canctl_dev
+{
+	int fd;
+	int timeout_ms; // Read/command timeout, negative waits forever
+	canctl_stats_t stats; // Updated with relaxed atomics
+
+	// Last successful canctl_set_config(), reapplied after a reconnect
+	int cfg_known;
+	canbus_cfg_t last_cfg;
+	unsigned int last_speed; // 0 until a CONFIGURATION mode speed was set
+
+	// Acceptance filter, swapped with canctl_set_filter(). Receive paths
+	// count themselves in filter_users while they hold the pointer.
+	const canfilter_t *filter;
+	unsigned int filter_users;
+
+	// I/O backend, see canctl_set_io(). The transmit ring is set up on
+	// first use and only touched with tx_lock held.
+	canctl_io_t io;
+	pthread_mutex_t tx_lock;
+	uring_t *tx_ring;
+
+	// Receive timing, written only by whoever reads the fd
+	clockid_t clock; // Clock for frame timestamps, see canctl_set_clock()
+	int rx_seen; // rx_ts and rx_mono are valid
+	struct timespec rx_ts; // When the last report was read, on @c clock
+	struct timespec rx_mono; // The same moment on CLOCK_MONOTONIC
+	canctl_hist_t hist[CANCTL_HIST_COUNT]; // Updated with relaxed atomics
+
+	pthread_mutex_t lock; // Protects everything below
+	pthread_cond_t cond; // Signalled when the pending slot is filled or a
+	                     // canctl_read() stops reading
+	pthread_mutex_t cmd_lock; // Serializes commands, one slot per module
+	int reader_active; // A reader thread owns the fd
+	int sync_readers; // canctl_read() calls and claims waiting on the fd
+
+	// Last pin data written to the GPIO module, so gpio_write_pins() can
+	// change some pins without reading the others first
+	pthread_mutex_t gpio_lock; // Makes read-modify-write atomic
+	int gpio_out_known;
+	uint8_t gpio_out;
+
+	// Pending-command slot
+	int pending; // A command is waiting for its reply
+	int pending_id;
+	int done;
+	int resp_len;
+	unsigned char resp[CANBUS_MSG_SIZE];
+
+	// Asynchronous commands in flight, oldest at as_tail
+	struct
+	{
+		int rx_id;
+		int done;
+		int64_t deadline_ns; // CLOCK_MONOTONIC, negative waits forever
+		canctl_async_cb cb;
+		void *arg;
+		int len;
+		unsigned char resp[CANBUS_MSG_SIZE];
+	} async[CANCTL_ASYNC_DEPTH];
+	size_t as_head, as_tail;
+
+	// Data reports read by a command, waiting for canctl_read()
+	struct
+	{
+		int len;
+		struct timespec ts; // When the command read it
+		unsigned char buf[CANBUS_MSG_SIZE];
+	} backlog[CANCTL_BACKLOG_SIZE];
+	size_t bl_head, bl_tail;
+};
+
+#define CANCTL_STAT_ADD(dev, field, n) \
+	__atomic_fetch_add(&(dev)->stats.field, (n), __ATOMIC_RELAXED)
+#define CANCTL_STAT_SET(dev, field, v) \
+	__atomic_store_n(&(dev)->stats.field, (v), __ATOMIC_RELAXED)
+
+/**
+ * Reports the version of the library actually loaded, which can differ from
+ * the CANCTL_VERSION a program was built against as long as the major
+ * version matches.
+ * @returns Returns the version as CANCTL_VERSION encodes it
+ */
+unsigned int canctl_version(void)
+{
+	return (CANCTL_VERSION);
+} // canctl_version()
+
+/**
+ * Wraps an already open module file descriptor in a new handle. The handle
+ * takes ownership of @c fd and closes it in canctl_close().
+ * @param fd The module's file descriptor, opened read/write and non-blocking
+ * @returns Returns the new handle on success, NULL on error
+ */
+canctl_dev_t *canctl_attach(int fd)
+{
+	canctl_dev_t *dev;
+	pthread_condattr_t attr;
+
+	if (fd < 0)
+		return (NULL); // @todo Return a better error indicator
+	if ((dev = calloc(1, sizeof(*dev))) == NULL)
+		return (NULL);
+	dev->fd = fd;
+	dev->timeout_ms = CANBUS_DEFAULT_TIMEOUT_MS;
+	dev->clock = CLOCK_MONOTONIC;
+	pthread_mutex_init(&dev->lock, NULL);
+	pthread_mutex_init(&dev->cmd_lock, NULL);
+	pthread_mutex_init(&dev->gpio_lock, NULL);
+	pthread_mutex_init(&dev->tx_lock, NULL);
+
+	// Command timeouts are measured on CLOCK_MONOTONIC so they are immune
+	// to wall clock changes
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&dev->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	return (dev);
+} // canctl_attach()
+
+/**
+ * Opens the module at @c path (e.g. /dev/hidraw0) in non-blocking mode.
+ * @param path The module's device file path
+ * @returns Returns the new handle on success, NULL on error (errno is set)
+ */
+canctl_dev_t *canctl_open(const char *path)
+{
+	canctl_dev_t *dev;
+	int fd, err;
+
+	if ((fd = open(path, O_RDWR|O_NONBLOCK|O_CLOEXEC)) < 0)
+		return (NULL);
+	if ((dev = canctl_attach(fd)) == NULL)
+	{
+		err = errno;
+		close(fd);
+		errno = err;
+	}
+	return (dev);
+} // canctl_open()
+
+/**
+ * Closes the module's file descriptor and frees the handle. Any reader
+ * thread on the handle must have been stopped first. Commands still in
+ * flight from canctl_submit() are dropped without running their callbacks.
+ * @param dev The handle to close, may be NULL
+ */
+void canctl_close(canctl_dev_t *dev)
+{
+	if (dev == NULL)
+		return;
+	uring_destroy(dev->tx_ring);
+	close(dev->fd);
+	pthread_cond_destroy(&dev->cond);
+	pthread_mutex_destroy(&dev->tx_lock);
+	pthread_mutex_destroy(&dev->gpio_lock);
+	pthread_mutex_destroy(&dev->cmd_lock);
+	pthread_mutex_destroy(&dev->lock);
+	free(dev);
+} // canctl_close()
+
+/**
+ * Swaps the handle's file descriptor for a newly opened one, e.g. after the
+ * module re-enumerated. The old fd is closed. Statistics, timeout, the last
+ * configuration and data reports not yet read are kept. A command running
+ * in another thread (e.g. errmon.h) finishes first, so it is never left
+ * reading a closed fd, or a new file that reused its number.
+ * @param dev The module's handle
+ * @param fd The module's new file descriptor, opened read/write and
+ * non-blocking. The handle takes ownership of it.
+ * @returns Returns 0 on success, -1 on error (errno is EBUSY if a reader
+ * thread owns the handle)
+ */
+int canctl_reattach(canctl_dev_t *dev, int fd)
+{
+	if (dev == NULL || fd < 0)
+		return (-1); // @todo Return a better error indicator
+
+	// A blocking command reads the fd with dev->lock dropped, but holds
+	// cmd_lock throughout
+	pthread_mutex_lock(&dev->cmd_lock);
+	pthread_mutex_lock(&dev->lock);
+	if (dev->reader_active)
+	{
+		pthread_mutex_unlock(&dev->lock);
+		pthread_mutex_unlock(&dev->cmd_lock);
+		errno = EBUSY;
+		return (-1);
+	}
+	// The transmit ring belongs to the old fd; the next send sets up a new one
+	pthread_mutex_lock(&dev->tx_lock);
+	uring_destroy(dev->tx_ring);
+	dev->tx_ring = NULL;
+	close(dev->fd);
+	dev->fd = fd;
+	pthread_mutex_unlock(&dev->tx_lock);
+	dev->gpio_out_known = 0; // A reset module starts with fresh outputs
+	pthread_mutex_unlock(&dev->lock);
+	pthread_mutex_unlock(&dev->cmd_lock);
+	return (0);
+} // canctl_reattach()
+
+/**
+ * @param dev The module's handle
+ * @returns Returns the module's file descriptor, e.g. for an event loop
+ */
+int canctl_get_fd(const canctl_dev_t *dev)
+{
+	return (dev == NULL ? -1 : dev->fd);
+} // canctl_get_fd()
+
+void canctl_set_timeout_ms(canctl_dev_t *dev, int ms) { dev->timeout_ms = ms; }
+int canctl_get_timeout_ms(const canctl_dev_t *dev) { return (dev->timeout_ms); }
+
+/**
+ * Selects the clock frames are stamped with. CLOCK_MONOTONIC (the default)
+ * is right for jitter analysis and replay; CLOCK_REALTIME lines frames up
+ * with other hosts' logs. The histograms always use CLOCK_MONOTONIC.
+ * @param dev The module's handle
+ * @param clock CLOCK_MONOTONIC or CLOCK_REALTIME
+ */
+void canctl_set_clock(canctl_dev_t *dev, clockid_t clock)
+{
+	dev->clock = clock;
+} // canctl_set_clock()
+
+/**
+ * @param dev The module's handle
+ * @returns Returns the clock frames are stamped with
+ */
+clockid_t canctl_get_clock(const canctl_dev_t *dev)
+{
+	return (dev->clock);
+} // canctl_get_clock()
+
+/**
+ * Selects how reports move to and from the module. CANCTL_IO_URING keeps
+ * several reads posted for the reader thread (see canctl_reader_start())
+ * and sends the reports of one canctl_send_frames() call in batches, so
+ * both take far fewer system calls per report. Commands and canctl_read()
+ * keep using plain system calls either way. Takes effect for reader
+ * threads started afterwards.
+ * @param dev The module's handle
+ * @param io The backend
+ * @returns Returns 0 on success, -1 on error (errno is ENOSYS if this
+ * kernel or build has no io_uring)
+ */
+int canctl_set_io(canctl_dev_t *dev, canctl_io_t io)
+{
+	if (dev == NULL || (io != CANCTL_IO_SYSCALL && io != CANCTL_IO_URING))
+		return (-1); // @todo Return a better error indicator
+	if (io == CANCTL_IO_URING && !uring_available())
+	{
+		errno = ENOSYS;
+		return (-1);
+	}
+	dev->io = io;
+	return (0);
+} // canctl_set_io()
+
+/**
+ * @param dev The module's handle
+ * @returns Returns the I/O backend chosen with canctl_set_io()
+ */
+canctl_io_t canctl_get_io(const canctl_dev_t *dev)
+{
+	return (dev->io);
+} // canctl_get_io()
+
+/**
+ * Gets the moment the report last returned by canctl_read() or
+ * canctl_recv() was read, on the clock chosen with canctl_set_clock().
+ * Pass it to canctl_decode_report() to stamp the report's frames.
+ * @param dev The module's handle
+ * @param ts Where to store the time
+ * @returns Returns 0 on success, -1 if nothing was read yet
+ */
+int canctl_get_rx_time(const canctl_dev_t *dev, struct timespec *ts)
+{
+	if (!dev->rx_seen)
+		return (-1);
+	*ts = dev->rx_ts;
+	return (0);
+} // canctl_get_rx_time()
+
+/**
+ * Adds one sample to a histogram. Bucket 0 counts samples under 1 us and
+ * bucket i counts samples from 2^(i-1) to 2^i - 1 us.
+ * Safe to call from several threads at once.
+ * @param h The histogram
+ * @param from Start of the interval
+ * @param to End of the interval
+ */
+void canctl_hist_add(canctl_hist_t *h, const struct timespec *from,
+	const struct timespec *to)
+{
+	long long us = (to->tv_sec - from->tv_sec) * 1000000LL +
+		(to->tv_nsec - from->tv_nsec) / 1000;
+	unsigned long max;
+	int bucket;
+
+	if (us < 0)
+		us = 0;
+	bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+	if (bucket >= CANCTL_HIST_BUCKETS)
+		bucket = CANCTL_HIST_BUCKETS - 1;
+
+	__atomic_fetch_add(&h->buckets[bucket], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->sum_us, us, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+	while ((unsigned long)us > max &&
+		!__atomic_compare_exchange_n(&h->max_us, &max, us, 1,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+} // canctl_hist_add()
+
+/**
+ * Copies one of the handle's receive latency histograms.
+ * @param dev The module's handle
+ * @param id Which histogram to copy
+ * @param hist Filled with a snapshot of the histogram
+ */
+void canctl_get_hist(canctl_dev_t *dev, canctl_hist_id_t id,
+	canctl_hist_t *hist)
+{
+	unsigned long *dst = (unsigned long *)hist;
+	unsigned long *src = (unsigned long *)&dev->hist[id];
+
+	for (size_t i = 0; i < sizeof(*hist) / sizeof(unsigned long); i++)
+		dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+} // canctl_get_hist()
+
+/**
+ * Clears all of the handle's receive latency histograms.
+ * @param dev The module's handle
+ */
+void canctl_reset_hist(canctl_dev_t *dev)
+{
+	for (int id = 0; id < CANCTL_HIST_COUNT; id++)
+	{
+		unsigned long *h = (unsigned long *)&dev->hist[id];
+
+		for (size_t i = 0; i < sizeof(canctl_hist_t) / sizeof(h[0]); i++)
+			__atomic_store_n(&h[i], 0, __ATOMIC_RELAXED);
+	}
+} // canctl_reset_hist()
+
+/**
+ * Records that a report was just read: stamps it and feeds the
+ * inter-arrival histogram.
+ * @param dev The module's handle
+ */
+static void canctl_stamp(canctl_dev_t *dev)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (dev->rx_seen)
+		canctl_hist_add(&dev->hist[CANCTL_HIST_INTERARRIVAL], &dev->rx_mono,
+			&now);
+	dev->rx_mono = now;
+	if (dev->clock == CLOCK_MONOTONIC)
+		dev->rx_ts = now;
+	else
+		clock_gettime(dev->clock, &dev->rx_ts);
+	dev->rx_seen = 1;
+} // canctl_stamp()
+
+/**
+ * Copies the first @c nfields counters of the handle's statistics.
+ * @param dev The module's handle
+ * @param stats Filled with a snapshot of the counters
+ * @param nfields Number of canctl_stats_t fields the caller's struct has
+ */
+static void canctl_copy_stats(canctl_dev_t *dev, canctl_stats_t *stats,
+	size_t nfields)
+{
+	unsigned long *dst = (unsigned long *)stats;
+	unsigned long *src = (unsigned long *)&dev->stats;
+
+	for (size_t i = 0; i < nfields; i++)
+		dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+} // canctl_copy_stats()
+
+/**
+ * Copies the handle's statistics.
+ * @param dev The module's handle
+ * @param stats Filled with a snapshot of the counters
+ */
+void canctl_get_stats(canctl_dev_t *dev, canctl_stats_t *stats)
+{
+	canctl_copy_stats(dev, stats, sizeof(*stats) / sizeof(unsigned long));
+} // canctl_get_stats()
+
+#define CANCTL_STAT_DESC(field, name, type, help) \
+	{ name, help, type, offsetof(canctl_stats_t, field) }
+
+// Every canctl_stats_t field, in order
+static const canctl_stat_desc_t canctl_stat_table[] = {
+	CANCTL_STAT_DESC(reports_read, "reports_read_total", CANCTL_STAT_COUNTER,
+		"Reports read from the module"),
+	CANCTL_STAT_DESC(reports_written, "reports_written_total",
+		CANCTL_STAT_COUNTER, "Reports written to the module"),
+	CANCTL_STAT_DESC(timeouts, "timeouts_total", CANCTL_STAT_COUNTER,
+		"Reads, writes and commands that timed out"),
+	CANCTL_STAT_DESC(unsolicited, "unsolicited_reports_total",
+		CANCTL_STAT_COUNTER, "Reports nobody was waiting for"),
+	CANCTL_STAT_DESC(backlog_overflows, "backlog_overflows_total",
+		CANCTL_STAT_COUNTER, "Data reports lost while a command waited"),
+	CANCTL_STAT_DESC(frames_filtered, "frames_filtered_total",
+		CANCTL_STAT_COUNTER, "Frames dropped by the acceptance filter"),
+	CANCTL_STAT_DESC(read_errors, "read_errors_total", CANCTL_STAT_COUNTER,
+		"Failed reads"),
+	CANCTL_STAT_DESC(write_errors, "write_errors_total", CANCTL_STAT_COUNTER,
+		"Failed writes"),
+	CANCTL_STAT_DESC(short_writes, "short_writes_total", CANCTL_STAT_COUNTER,
+		"Writes that took only part of a report"),
+	CANCTL_STAT_DESC(command_failures, "command_failures_total",
+		CANCTL_STAT_COUNTER, "Commands that got no reply"),
+	CANCTL_STAT_DESC(tx_errors, "tx_errors", CANCTL_STAT_GAUGE,
+		"CAN Tx error count at the last error state read"),
+	CANCTL_STAT_DESC(rx_errors, "rx_errors", CANCTL_STAT_GAUGE,
+		"CAN Rx error count at the last error state read"),
+	CANCTL_STAT_DESC(error_flags, "error_flags", CANCTL_STAT_GAUGE,
+		"CAN error state flags at the last error state read"),
+	CANCTL_STAT_DESC(io_syscalls, "io_syscalls_total", CANCTL_STAT_COUNTER,
+		"System calls made to move reports"),
+	CANCTL_STAT_DESC(io_retries, "io_retries_total", CANCTL_STAT_COUNTER,
+		"io_uring reads that found no report and had to wait for one"),
+};
+
+/**
+ * Lists the fields of canctl_stats_t with their names and types.
+ * @param n Set to the number of descriptors
+ * @returns Returns the descriptors, in field order
+ */
+const canctl_stat_desc_t *canctl_stat_descs(size_t *n)
+{
+	*n = sizeof(canctl_stat_table) / sizeof(canctl_stat_table[0]);
+	return (canctl_stat_table);
+} // canctl_stat_descs()
+
+#ifdef CANCTL_SHARED
+// Programs built against 1.0 have a canctl_stats_t that ends at error_flags,
+// and those built against 1.3 one that ends at io_syscalls. They resolve
+// canctl_get_stats and canctl_stat_descs at CANCTL_1.0 or CANCTL_1.3,
+// which stick to those fields.
+#define CANCTL_STATS_1_0 \
+	(offsetof(canctl_stats_t, io_syscalls) / sizeof(unsigned long))
+#define CANCTL_STATS_1_3 \
+	(offsetof(canctl_stats_t, io_retries) / sizeof(unsigned long))
+
+void canctl_get_stats_1_0(canctl_dev_t *dev, canctl_stats_t *stats);
+const canctl_stat_desc_t *canctl_stat_descs_1_0(size_t *n);
+void canctl_get_stats_1_3(canctl_dev_t *dev, canctl_stats_t *stats);
+const canctl_stat_desc_t *canctl_stat_descs_1_3(size_t *n);
+__asm__(".symver canctl_get_stats_1_0,canctl_get_stats@CANCTL_1.0");
+__asm__(".symver canctl_stat_descs_1_0,canctl_stat_descs@CANCTL_1.0");
+__asm__(".symver canctl_get_stats_1_3,canctl_get_stats@CANCTL_1.3");
+__asm__(".symver canctl_stat_descs_1_3,canctl_stat_descs@CANCTL_1.3");
+
+/**
+ * canctl_get_stats() for programs built against 1.0.
+ */
+void canctl_get_stats_1_0(canctl_dev_t *dev, canctl_stats_t *stats)
+{
+	canctl_copy_stats(dev, stats, CANCTL_STATS_1_0);
+} // canctl_get_stats_1_0()
+
+/**
+ * canctl_stat_descs() for programs built against 1.0.
+ */
+const canctl_stat_desc_t *canctl_stat_descs_1_0(size_t *n)
+{
+	*n = CANCTL_STATS_1_0;
+	return (canctl_stat_table);
+} // canctl_stat_descs_1_0()
+
+/**
+ * canctl_get_stats() for programs built against 1.3.
+ */
+void canctl_get_stats_1_3(canctl_dev_t *dev, canctl_stats_t *stats)
+{
+	canctl_copy_stats(dev, stats, CANCTL_STATS_1_3);
+} // canctl_get_stats_1_3()
+
+/**
+ * canctl_stat_descs() for programs built against 1.3.
+ */
+const canctl_stat_desc_t *canctl_stat_descs_1_3(size_t *n)
+{
+	*n = CANCTL_STATS_1_3;
+	return (canctl_stat_table);
+} // canctl_stat_descs_1_3()
+#endif // CANCTL_SHARED
 
 /**
- * Write data to the device at file descriptor @c fd. Assume device is
- * already open and is non-blocking. Assume @c buf has already been
- * set to @c len bytes.
- * @param fd CANbus module's file descriptor
+ * Write data to the module. Assume device is already open and is
+ * non-blocking. Assume @c buf has already been set to @c len bytes.
+ * @param dev The module's handle
  * @param buf Data to write to the device
  * @param len Length of buffer @c buf
  * @returns Returns number of bytes written on success, -1 on error
+ * (errno is ETIMEDOUT if the module took no report within the timeout)
  */
-int canctl_write(int fd, unsigned char *buf, size_t len)
+int canctl_write(canctl_dev_t *dev, unsigned char *buf, size_t len)
 {
-	if (buf == NULL)
+	struct pollfd pfd;
+	int nbytes, rc;
+
+	if (dev == NULL || buf == NULL)
 		return (-1); // @todo Return a better error indicator
-	return (write(fd, buf, len)); // @todo Return a better error indicator
+
+	// hidraw writes wait for the report to go out even on a non-blocking
+	// fd. Sockets, like the emulator's (see emu.h), say EAGAIN instead, so
+	// wait for room the same way.
+	for (;;)
+	{
+		CANCTL_STAT_ADD(dev, io_syscalls, 1);
+		if ((nbytes = write(dev->fd, buf, len)) >= 0 || errno != EAGAIN)
+			break;
+		pfd.fd = dev->fd;
+		pfd.events = POLLOUT;
+		CANCTL_STAT_ADD(dev, io_syscalls, 1);
+		if ((rc = poll(&pfd, 1, dev->timeout_ms)) < 0)
+			break;
+		if (rc == 0)
+		{
+			CANCTL_STAT_ADD(dev, timeouts, 1);
+			errno = ETIMEDOUT;
+			return (-1);
+		}
+	}
+	if (nbytes < 0)
+		CANCTL_STAT_ADD(dev, write_errors, 1);
+	else
+	{
+		CANCTL_STAT_ADD(dev, reports_written, 1);
+		if ((size_t)nbytes != len)
+			CANCTL_STAT_ADD(dev, short_writes, 1);
+	}
+	return (nbytes); // @todo Return a better error indicator
 } // canctl_write()
 
 /**
- * Reads data from the device at file descriptor @c fd. Assume device
- * is already open and is non-blocking. Assume @c buf has already been
- * set to @c len bytes and its memory is cleared.
- * @param fd CANbus module's file descriptor
+ * Reads one report from the module without waiting. Meant for callers that
+ * already know the fd is readable, e.g. from an event loop, and so do not
+ * need canctl_read()'s select() per report. Such callers should hold
+ * canctl_reader_claim() while they watch the fd.
+ * @param dev The module's handle
  * @param buf Buffer to read data into
  * @param len Length of buffer @c buf
  * @returns Returns the number of bytes read on success, -1 on error
+ * (errno is EAGAIN if no report was waiting)
+ */
+int canctl_recv(canctl_dev_t *dev, unsigned char *buf, size_t len)
+{
+	int nbytes;
+
+	if (dev == NULL || buf == NULL)
+		return (-1); // @todo Return a better error indicator
+	if (len > CANBUS_MSG_SIZE)
+		return (-1); // @todo Return a better error indicator
+	CANCTL_STAT_ADD(dev, io_syscalls, 1);
+	if ((nbytes = read(dev->fd, buf, len)) >= 0)
+	{
+		CANCTL_STAT_ADD(dev, reports_read, 1);
+		canctl_stamp(dev);
+	}
+	else if (errno != EAGAIN)
+		CANCTL_STAT_ADD(dev, read_errors, 1);
+	return (nbytes);
+} // canctl_recv()
+
+/**
+ * Waits up to @c timeout_ms for the module to become readable and reads one
+ * report from it.
+ * @param dev The module's handle
+ * @param buf Buffer to read data into
+ * @param len Length of buffer @c buf
+ * @param timeout_ms Milliseconds to wait, or negative to wait forever
+ * @returns Returns the number of bytes read on success, 0 on timeout,
+ * -1 on error
  */
-int canctl_read(int fd, unsigned char *buf, size_t len)
+static int canctl_read_timeout(canctl_dev_t *dev, unsigned char *buf,
+	size_t len, int timeout_ms)
 {
-	int rc;
+	int rc, nbytes;
 	fd_set rdset;
-	struct timeval tv = { .tv_sec = 0, .tv_usec = _timeout_ms * 1000 };
-	struct timeval *tvptr = _timeout_ms < 0 ? NULL : &tv;
+	struct timespec woke;
+	struct timeval tv = {
+		.tv_sec = timeout_ms / 1000,
+		.tv_usec = (timeout_ms % 1000) * 1000
+	};
+	struct timeval *tvptr = timeout_ms < 0 ? NULL : &tv;
 
 	if (buf == NULL)
 		return (-1); // @todo Return a better error indicator
@@ -54,77 +645,880 @@ int canctl_read(int fd, unsigned char *buf, size_t len)
 
 	// Set up the variables for the select() call
 	FD_ZERO(&rdset);
-	FD_SET(fd, &rdset);
+	FD_SET(dev->fd, &rdset);
 
 	// Wait for the file descriptor to become readable, or timeout
-	if ((rc = select(fd+1, &rdset, NULL, NULL, tvptr)) < 0)
+	CANCTL_STAT_ADD(dev, io_syscalls, 1);
+	if ((rc = select(dev->fd+1, &rdset, NULL, NULL, tvptr)) < 0)
 		return (-1); // @todo Return a better error indicator
 	else if (rc == 0)
-		return (0); // @todo Return a better error indicator
-	else if (FD_ISSET(fd, &rdset))
-		return (read(fd, buf, len));
+		return (0); // Callers decide whether this counts as a timeout
+	else if (FD_ISSET(dev->fd, &rdset))
+	{
+		// How long the read itself takes once select() says it won't block
+		clock_gettime(CLOCK_MONOTONIC, &woke);
+		if ((nbytes = canctl_recv(dev, buf, len)) >= 0)
+			canctl_hist_add(&dev->hist[CANCTL_HIST_SELECT_TO_READ], &woke,
+				&dev->rx_mono);
+		return (nbytes);
+	}
 
 	// NOTE: THIS SHOULD NEVER HAPPEN
 	return (-1); // @todo Return a better error indicator
+} // canctl_read_timeout()
+
+/**
+ * Routes one report that was just read from the module. If a command is
+ * waiting for this report ID, the report fills its slot. Otherwise
+ * CANBUS_IN_RECV_DATA reports belong to the data path and everything else
+ * is unsolicited.
+ * @param dev The module the report was read from
+ * @param buf The report
+ * @param len Number of valid bytes in @c buf
+ * @returns Returns CANCTL_ROUTE_COMMAND if the report completed a pending
+ * command, CANCTL_ROUTE_DATA if the caller should treat it as CAN data, or
+ * CANCTL_ROUTE_DROP if nobody wants it
+ */
+canctl_route_t canctl_dispatch(canctl_dev_t *dev, const unsigned char *buf,
+	size_t len)
+{
+	if (dev == NULL || buf == NULL || len == 0)
+		return (CANCTL_ROUTE_DROP);
+
+	pthread_mutex_lock(&dev->lock);
+	for (size_t i = dev->as_tail; i != dev->as_head; i++)
+	{
+		size_t slot = i % CANCTL_ASYNC_DEPTH;
+
+		if (dev->async[slot].rx_id != buf[0] || dev->async[slot].done)
+			continue;
+		if (len > sizeof(dev->async[slot].resp))
+			len = sizeof(dev->async[slot].resp);
+		memcpy(dev->async[slot].resp, buf, len);
+		dev->async[slot].len = len;
+		dev->async[slot].done = 1;
+		pthread_cond_broadcast(&dev->cond);
+		pthread_mutex_unlock(&dev->lock);
+		return (CANCTL_ROUTE_COMMAND);
+	}
+	if (dev->pending && dev->pending_id == buf[0] && !dev->done)
+	{
+		if (len > sizeof(dev->resp))
+			len = sizeof(dev->resp);
+		memcpy(dev->resp, buf, len);
+		dev->resp_len = len;
+		dev->done = 1;
+		pthread_cond_broadcast(&dev->cond);
+		pthread_mutex_unlock(&dev->lock);
+		return (CANCTL_ROUTE_COMMAND);
+	}
+	pthread_mutex_unlock(&dev->lock);
+
+	if (buf[0] == CANBUS_IN_RECV_DATA)
+		return (CANCTL_ROUTE_DATA);
+	CANCTL_STAT_ADD(dev, unsolicited, 1);
+	return (CANCTL_ROUTE_DROP);
+} // canctl_dispatch()
+
+/**
+ * Queues a data report that a command read while waiting for its reply, so
+ * the next canctl_read() returns it. Must hold dev->lock.
+ */
+static void canctl_backlog_push(canctl_dev_t *dev, const unsigned char *buf,
+	int len)
+{
+	size_t slot;
+
+	if (dev->bl_head - dev->bl_tail >= CANCTL_BACKLOG_SIZE)
+	{
+		CANCTL_STAT_ADD(dev, backlog_overflows, 1);
+		return;
+	}
+	slot = dev->bl_head++ % CANCTL_BACKLOG_SIZE;
+	dev->backlog[slot].len = len;
+	dev->backlog[slot].ts = dev->rx_ts;
+	memcpy(dev->backlog[slot].buf, buf, len);
+} // canctl_backlog_push()
+
+/**
+ * Pops the oldest backlogged data report.
+ * @returns Returns the report length, or -1 if the backlog is empty
+ */
+static int canctl_backlog_pop(canctl_dev_t *dev, unsigned char *buf,
+	size_t len)
+{
+	size_t slot;
+	int n = -1;
+
+	pthread_mutex_lock(&dev->lock);
+	if (dev->bl_head != dev->bl_tail)
+	{
+		slot = dev->bl_tail++ % CANCTL_BACKLOG_SIZE;
+		n = dev->backlog[slot].len;
+		if ((size_t)n > len)
+			n = len;
+		memcpy(buf, dev->backlog[slot].buf, n);
+		dev->rx_ts = dev->backlog[slot].ts; // Keep its original stamp
+	}
+	pthread_mutex_unlock(&dev->lock);
+	return (n);
+} // canctl_backlog_pop()
+
+/**
+ * Installs a new acceptance filter on the handle. The swap is atomic: a
+ * receive path uses either the old or the new filter for a whole report,
+ * never a mix. When this returns no receive path uses the old filter any
+ * more, so the caller may free it.
+ * @param dev The CANbus module's handle
+ * @param filter The compiled filter, or NULL to accept every frame
+ * @returns Returns the previous filter, which may be NULL
+ */
+const canfilter_t *canctl_set_filter(canctl_dev_t *dev,
+	const canfilter_t *filter)
+{
+	const canfilter_t *old;
+
+	old = __atomic_exchange_n(&dev->filter, filter, __ATOMIC_SEQ_CST);
+	// Wait out anyone who may have loaded the old pointer; they only hold
+	// it for the handful of frames in one report
+	while (__atomic_load_n(&dev->filter_users, __ATOMIC_SEQ_CST) != 0)
+		sched_yield();
+	return (old);
+} // canctl_set_filter()
+
+/**
+ * Applies the handle's acceptance filter to freshly decoded frames.
+ * @param dev The CANbus module's handle
+ * @param frames The frames to filter in place
+ * @param n Number of frames in @c frames
+ * @returns Returns the number of frames kept at the start of @c frames
+ */
+size_t canctl_filter_frames(canctl_dev_t *dev, canbus_frame_t *frames,
+	size_t n)
+{
+	size_t kept;
+
+	__atomic_add_fetch(&dev->filter_users, 1, __ATOMIC_SEQ_CST);
+	kept = canfilter_apply(__atomic_load_n(&dev->filter, __ATOMIC_SEQ_CST),
+		frames, n);
+	__atomic_sub_fetch(&dev->filter_users, 1, __ATOMIC_RELEASE);
+	if (kept != n)
+		CANCTL_STAT_ADD(dev, frames_filtered, n - kept);
+	return (kept);
+} // canctl_filter_frames()
+
+/**
+ * Reads data from the module. Assume device is already open and is
+ * non-blocking. Assume @c buf has already been set to @c len bytes and
+ * its memory is cleared.
+ * @param dev The module's handle
+ * @param buf Buffer to read data into
+ * @param len Length of buffer @c buf
+ * @returns Returns the number of bytes read on success, -1 on error
+ */
+int canctl_read(canctl_dev_t *dev, unsigned char *buf, size_t len)
+{
+	struct timespec start, now;
+	int nbytes, timeout_ms;
+
+	if (dev == NULL || buf == NULL)
+		return (-1); // @todo Return a better error indicator
+
+	// Hand replies to a command waiting in another thread (e.g. errmon.h)
+	// and keep waiting for data
+	pthread_mutex_lock(&dev->lock);
+	dev->sync_readers++;
+	pthread_mutex_unlock(&dev->lock);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	timeout_ms = dev->timeout_ms;
+	for (;;)
+	{
+		// Data that arrived while a command was waiting for its reply
+		// comes first. A command that was already reading the fd when this
+		// call started can also take a report from under it (EAGAIN): data
+		// it took is parked in the backlog, for anything else keep waiting.
+		if ((nbytes = canctl_backlog_pop(dev, buf, len)) >= 0)
+			break;
+		nbytes = canctl_read_timeout(dev, buf, len, timeout_ms);
+		if ((nbytes >= 0 || errno != EAGAIN) && (nbytes <= 0 ||
+			canctl_dispatch(dev, buf, nbytes) != CANCTL_ROUTE_COMMAND))
+			break;
+		if (dev->timeout_ms < 0)
+			continue;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timeout_ms = dev->timeout_ms - ((now.tv_sec - start.tv_sec) * 1000 +
+			(now.tv_nsec - start.tv_nsec) / 1000000L);
+		if (timeout_ms < 0)
+			timeout_ms = 0;
+	}
+	pthread_mutex_lock(&dev->lock);
+	dev->sync_readers--;
+	pthread_cond_broadcast(&dev->cond); // A waiting command reads for itself
+	pthread_mutex_unlock(&dev->lock);
+	if (nbytes == 0)
+		CANCTL_STAT_ADD(dev, timeouts, 1);
+	return (nbytes);
 } // canctl_read()
 
 /**
- * Gets the firmware version from the CANbus or GPIO module. The returned
- * buffer will be CANBUS_FIRMWARE_SIZE bytes long.
- * @param fd The CANbus module's already open file descriptor
- * @returns Returns a pointer to firmware buffer on success, NULL on error.
+ * Tells the handle that the caller reads the module itself, e.g. with
+ * canctl_recv() from an event loop, and passes every report to
+ * canctl_dispatch(). Until canctl_reader_unclaim(), commands from other
+ * threads wait for their reply to be dispatched instead of reading the fd
+ * and keeping the data reports they come across from the caller.
+ * @param dev The module's handle
+ */
+void canctl_reader_claim(canctl_dev_t *dev)
+{
+	if (dev == NULL)
+		return;
+	pthread_mutex_lock(&dev->lock);
+	dev->sync_readers++;
+	pthread_mutex_unlock(&dev->lock);
+} // canctl_reader_claim()
+
+/**
+ * Ends a canctl_reader_claim(). A command still waiting reads for itself.
+ * @param dev The module's handle
+ */
+void canctl_reader_unclaim(canctl_dev_t *dev)
+{
+	if (dev == NULL)
+		return;
+	pthread_mutex_lock(&dev->lock);
+	dev->sync_readers--;
+	pthread_cond_broadcast(&dev->cond);
+	pthread_mutex_unlock(&dev->lock);
+} // canctl_reader_unclaim()
+
+/**
+ * Writes a command report and waits for the reply with report ID @c rx_id.
+ * Reports with other IDs that arrive in the meantime are routed through
+ * canctl_dispatch(): CAN data is kept for canctl_read() (or the reader
+ * thread's ring) instead of being mistaken for the reply and lost.
+ * @param dev The module's handle
+ * @param tx The command report
+ * @param txlen Number of bytes in @c tx
+ * @param rx_id Report ID of the expected reply
+ * @param rx Buffer for the reply, may be the same as @c tx
+ * @param rxlen Length of buffer @c rx
+ * @returns Returns the reply length on success, -1 on error or timeout
  */
-const unsigned char *canctl_get_firmware_version(int fd)
+static int canctl_command(canctl_dev_t *dev, unsigned char *tx, int txlen,
+	int rx_id, unsigned char *rx, size_t rxlen)
 {
-	static unsigned char fw[CANBUS_FIRMWARE_SIZE];
 	unsigned char buf[CANBUS_MSG_SIZE];
+	struct timespec deadline, now;
+	int rc, nbytes, remaining_ms, len = -1;
+	int timeout_ms;
 
-	// Clear memory to be safe
-	memset(fw, 0, sizeof(fw));
-	memset(buf, 0, sizeof(buf));
+	if (dev == NULL)
+		return (-1); // @todo Return a better error indicator
+	timeout_ms = dev->timeout_ms;
+	pthread_mutex_lock(&dev->cmd_lock);
 
-	// Write
-	buf[0] = CANBUS_OUT_FW_VERSION;
-	buf[1] = 0; // Data payload is empty
-	if (canctl_write(fd, buf, 2) != 2)
-		return (NULL);
+	// Claim the pending-command slot before the reply can possibly arrive
+	pthread_mutex_lock(&dev->lock);
+	dev->pending = 1;
+	dev->pending_id = rx_id;
+	dev->done = 0;
+	pthread_mutex_unlock(&dev->lock);
+
+	if (canctl_write(dev, tx, txlen) != txlen)
+		goto out; // @todo Return a better error indicator
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&dev->lock);
+	while (!dev->done)
+	{
+		if (dev->reader_active || dev->sync_readers > 0)
+		{
+			// Someone else is reading; they fill the slot for us
+			if (timeout_ms < 0)
+				rc = pthread_cond_wait(&dev->cond, &dev->lock);
+			else
+				rc = pthread_cond_timedwait(&dev->cond, &dev->lock,
+					&deadline);
+			if (rc == ETIMEDOUT)
+			{
+				CANCTL_STAT_ADD(dev, timeouts, 1);
+				break;
+			}
+			continue;
+		}
+
+		// Nobody else is reading this fd, so read it ourselves
+		pthread_mutex_unlock(&dev->lock);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		remaining_ms = (deadline.tv_sec - now.tv_sec) * 1000 +
+			(deadline.tv_nsec - now.tv_nsec) / 1000000L;
+		if (timeout_ms < 0)
+			remaining_ms = -1;
+		else if (remaining_ms < 0)
+			remaining_ms = 0;
+		nbytes = canctl_read_timeout(dev, buf, sizeof(buf), remaining_ms);
+		if (nbytes > 0 &&
+			canctl_dispatch(dev, buf, nbytes) == CANCTL_ROUTE_DATA)
+		{
+			pthread_mutex_lock(&dev->lock);
+			canctl_backlog_push(dev, buf, nbytes);
+			continue;
+		}
+		pthread_mutex_lock(&dev->lock);
+		if (nbytes < 0 && errno == EAGAIN)
+			continue; // Another thread read the report first
+		if (nbytes < 0)
+			break; // Read error
+		if (nbytes == 0 && !dev->done)
+		{
+			CANCTL_STAT_ADD(dev, timeouts, 1);
+			break;
+		}
+	}
+	if (dev->done)
+	{
+		len = dev->resp_len;
+		if ((size_t)len > rxlen)
+			len = rxlen;
+		memset(rx, 0, rxlen);
+		memcpy(rx, dev->resp, len);
+	}
+	pthread_mutex_unlock(&dev->lock);
+
+out:
+	pthread_mutex_lock(&dev->lock);
+	dev->pending = 0;
+	pthread_mutex_unlock(&dev->lock);
+	pthread_mutex_unlock(&dev->cmd_lock);
+	if (len < 0)
+		CANCTL_STAT_ADD(dev, command_failures, 1);
+	return (len);
+} // canctl_command()
+
+/**
+ * @returns Returns the current CLOCK_MONOTONIC time in nanoseconds
+ */
+static int64_t canctl_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec);
+} // canctl_now_ns()
+
+/**
+ * Writes a command report without waiting for its reply. Several commands
+ * can be in flight at once, so talking to a module costs one round trip for
+ * the whole batch instead of one per command. Run canctl_complete() to
+ * collect the replies. A reply completes the oldest command in flight that
+ * waits for its report ID; a reply that arrives after its command timed out
+ * can complete a later command with the same ID, as with canctl_command().
+ * @param dev The module's handle
+ * @param tx The command report
+ * @param txlen Number of bytes in @c tx
+ * @param rx_id Report ID of the expected reply
+ * @param cb Called from canctl_complete() with the reply or the error. May
+ * be NULL.
+ * @param arg Passed to @c cb
+ * @returns Returns 0 on success, -1 on error (errno is EAGAIN if
+ * CANCTL_ASYNC_DEPTH commands are already in flight, EIO for a short write)
+ */
+int canctl_submit(canctl_dev_t *dev, const unsigned char *tx, size_t txlen,
+	int rx_id, canctl_async_cb cb, void *arg)
+{
+	unsigned char buf[CANBUS_MSG_SIZE];
+	size_t slot;
+	int timeout_ms, nbytes, err;
+
+	if (dev == NULL || tx == NULL || txlen == 0 || txlen > sizeof(buf))
+		return (-1); // @todo Return a better error indicator
+	memcpy(buf, tx, txlen);
+	timeout_ms = dev->timeout_ms;
+
+	// Keep blocking commands out until this one is queued and sent, so
+	// everything in flight predates any pending-command slot
+	pthread_mutex_lock(&dev->cmd_lock);
+	pthread_mutex_lock(&dev->lock);
+	if (dev->as_head - dev->as_tail >= CANCTL_ASYNC_DEPTH)
+	{
+		pthread_mutex_unlock(&dev->lock);
+		pthread_mutex_unlock(&dev->cmd_lock);
+		errno = EAGAIN;
+		return (-1);
+	}
+	// Queue it before the reply can possibly arrive
+	slot = dev->as_head++ % CANCTL_ASYNC_DEPTH;
+	dev->async[slot].rx_id = rx_id;
+	dev->async[slot].done = 0;
+	dev->async[slot].deadline_ns = timeout_ms < 0 ? -1 :
+		canctl_now_ns() + timeout_ms * 1000000LL;
+	dev->async[slot].cb = cb;
+	dev->async[slot].arg = arg;
+	dev->async[slot].len = 0;
+	pthread_mutex_unlock(&dev->lock);
+
+	if ((nbytes = canctl_write(dev, buf, txlen)) != (int)txlen)
+	{
+		// Nobody could have queued behind it while cmd_lock is held. A
+		// short write leaves errno as it was.
+		err = nbytes < 0 ? errno : EIO;
+		pthread_mutex_lock(&dev->lock);
+		dev->as_head--;
+		pthread_mutex_unlock(&dev->lock);
+		pthread_mutex_unlock(&dev->cmd_lock);
+		CANCTL_STAT_ADD(dev, command_failures, 1);
+		errno = err;
+		return (-1);
+	}
+	pthread_mutex_unlock(&dev->cmd_lock);
+	return (0);
+} // canctl_submit()
+
+/**
+ * A finished asynchronous command, copied out of the queue so its callback
+ * can run without dev->lock held
+ */
+typedef struct canctl_async_done
+{
+	canctl_async_cb cb;
+	void *arg;
+	int err;
+	int len;
+	unsigned char resp[CANBUS_MSG_SIZE];
+} canctl_async_done_t;
+
+/**
+ * Collects replies to commands sent with canctl_submit() and runs their
+ * callbacks in the order the commands were submitted. Waits until at least
+ * one command finished (got its reply or timed out), @c timeout_ms passed,
+ * or nothing is in flight. Like a blocking command, it reads the module
+ * itself unless a reader thread or canctl_read() already does.
+ * @param dev The module's handle
+ * @param timeout_ms Milliseconds to wait, 0 to only collect what already
+ * arrived, or negative to wait until a command finishes
+ * @returns Returns the number of callbacks run, 0 if none finished in time,
+ * -1 on a read error
+ */
+int canctl_complete(canctl_dev_t *dev, int timeout_ms)
+{
+	canctl_async_done_t done[CANCTL_ASYNC_DEPTH];
+	unsigned char buf[CANBUS_MSG_SIZE];
+	int64_t limit_ns, now_ns, wake_ns;
+	struct timespec wake;
+	size_t ndone = 0, slot;
+	int nbytes, wait_ms, last = 0, rc = 0;
+
+	if (dev == NULL)
+		return (-1); // @todo Return a better error indicator
+	limit_ns = timeout_ms < 0 ? -1 : canctl_now_ns() + timeout_ms * 1000000LL;
+
+	pthread_mutex_lock(&dev->lock);
+	while (dev->as_tail != dev->as_head)
+	{
+		// Retire finished commands, oldest first
+		now_ns = canctl_now_ns();
+		while (dev->as_tail != dev->as_head)
+		{
+			slot = dev->as_tail % CANCTL_ASYNC_DEPTH;
+			if (!dev->async[slot].done &&
+				(dev->async[slot].deadline_ns < 0 ||
+				now_ns < dev->async[slot].deadline_ns))
+				break;
+			done[ndone].cb = dev->async[slot].cb;
+			done[ndone].arg = dev->async[slot].arg;
+			done[ndone].err = dev->async[slot].done ? 0 : ETIMEDOUT;
+			done[ndone].len = dev->async[slot].len;
+			memcpy(done[ndone].resp, dev->async[slot].resp,
+				dev->async[slot].len);
+			if (!dev->async[slot].done)
+			{
+				CANCTL_STAT_ADD(dev, timeouts, 1);
+				CANCTL_STAT_ADD(dev, command_failures, 1);
+			}
+			dev->as_tail++;
+			ndone++;
+		}
+		if (ndone > 0 || dev->as_tail == dev->as_head || last)
+			break;
+
+		// Wait for the oldest command's reply or deadline, whichever of
+		// it and the caller's timeout comes first
+		slot = dev->as_tail % CANCTL_ASYNC_DEPTH;
+		wake_ns = dev->async[slot].deadline_ns;
+		if (limit_ns >= 0 && (wake_ns < 0 || limit_ns < wake_ns))
+		{
+			wake_ns = limit_ns;
+			last = now_ns >= limit_ns; // One more look, then give up
+		}
+		if (dev->reader_active || dev->sync_readers > 0)
+		{
+			// Someone else is reading; they fill the queue for us
+			if (last)
+				continue;
+			if (wake_ns < 0)
+				pthread_cond_wait(&dev->cond, &dev->lock);
+			else
+			{
+				wake.tv_sec = wake_ns / 1000000000LL;
+				wake.tv_nsec = wake_ns % 1000000000LL;
+				pthread_cond_timedwait(&dev->cond, &dev->lock, &wake);
+			}
+			continue;
+		}
+
+		// Nobody else is reading this fd, so read it ourselves
+		pthread_mutex_unlock(&dev->lock);
+		wait_ms = -1;
+		if (wake_ns >= 0)
+			wait_ms = wake_ns > now_ns ?
+				(int)((wake_ns - now_ns + 999999) / 1000000) : 0;
+		if (wait_ms == 0)
+			nbytes = canctl_recv(dev, buf, sizeof(buf)); // Just a look
+		else
+			nbytes = canctl_read_timeout(dev, buf, sizeof(buf), wait_ms);
+		if (nbytes > 0 &&
+			canctl_dispatch(dev, buf, nbytes) == CANCTL_ROUTE_DATA)
+		{
+			pthread_mutex_lock(&dev->lock);
+			canctl_backlog_push(dev, buf, nbytes);
+			continue;
+		}
+		pthread_mutex_lock(&dev->lock);
+		if (nbytes < 0 && errno != EAGAIN && errno != EINTR)
+		{
+			rc = -1; // Read error
+			break;
+		}
+	}
+	pthread_mutex_unlock(&dev->lock);
+
+	for (size_t i = 0; i < ndone; i++)
+		if (done[i].cb != NULL)
+			done[i].cb(dev, done[i].err, done[i].err ? NULL : done[i].resp,
+				done[i].len, done[i].arg);
+	return (rc < 0 && ndone == 0 ? -1 : (int)ndone);
+} // canctl_complete()
+
+/**
+ * Gives up on every command sent with canctl_submit() that has not finished
+ * yet and runs their callbacks with ECANCELED, e.g. before the callbacks'
+ * arguments go away after canctl_complete() failed. A reply that still
+ * arrives is treated as unsolicited.
+ * @param dev The module's handle
+ * @returns Returns the number of commands cancelled
+ */
+int canctl_cancel(canctl_dev_t *dev)
+{
+	canctl_async_done_t done[CANCTL_ASYNC_DEPTH];
+	size_t ndone = 0, slot;
+
+	pthread_mutex_lock(&dev->lock);
+	for (; dev->as_tail != dev->as_head; dev->as_tail++, ndone++)
+	{
+		slot = dev->as_tail % CANCTL_ASYNC_DEPTH;
+		done[ndone].cb = dev->async[slot].cb;
+		done[ndone].arg = dev->async[slot].arg;
+	}
+	pthread_mutex_unlock(&dev->lock);
+
+	for (size_t i = 0; i < ndone; i++)
+		if (done[i].cb != NULL)
+			done[i].cb(dev, ECANCELED, NULL, 0, done[i].arg);
+	return ((int)ndone);
+} // canctl_cancel()
+
+/**
+ * @param dev The module's handle
+ * @returns Returns the number of commands sent with canctl_submit() whose
+ * callbacks have not run yet
+ */
+int canctl_in_flight(canctl_dev_t *dev)
+{
+	int n;
+
+	pthread_mutex_lock(&dev->lock);
+	n = (int)(dev->as_head - dev->as_tail);
+	pthread_mutex_unlock(&dev->lock);
+	return (n);
+} // canctl_in_flight()
+
+/**
+ * Decodes a CANBUS_IN_RECV_DATA report into an array of frames. The report
+ * holds a frame count followed by that many fixed-size frame records, each
+ * laid out the same way mnu_can_loopback_test() builds them:
+ * [SOF/ID size][ID 31:24][ID 23:16][ID 15:8][ID 7:0][DLC][8 data bytes]
+ * @param buf Report as returned by canctl_read()
+ * @param len Number of valid bytes in @c buf
+ * @param frames Array to decode the frames into
+ * @param max Number of elements in @c frames
+ * @param ts Receive time stamped on every frame, normally from
+ * canctl_get_rx_time(), or NULL to use the current CLOCK_MONOTONIC time
+ * @returns Returns the number of frames decoded on success, -1 on error
+ */
+int canctl_decode_report(const unsigned char *buf, size_t len,
+	canbus_frame_t *frames, size_t max, const struct timespec *ts)
+{
+	struct timespec now;
+	size_t count;
+
+	if (buf == NULL || frames == NULL)
+		return (-1); // @todo Return a better error indicator
+	if (len < CANBUS_REPORT_HEADER_SIZE || buf[0] != CANBUS_IN_RECV_DATA)
+		return (-1); // @todo Return a better error indicator
+
+	count = buf[1];
+	if (count > CANBUS_FRAMES_PER_REPORT || count > max)
+		return (-1); // @todo Return a better error indicator
+	if (len < CANBUS_REPORT_HEADER_SIZE + count * CANBUS_FRAME_RECORD_SIZE)
+		return (-1); // @todo Return a better error indicator
+
+	if (ts == NULL)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		ts = &now;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const unsigned char *rec = &buf[CANBUS_REPORT_HEADER_SIZE +
+			i * CANBUS_FRAME_RECORD_SIZE];
+		canbus_frame_t *f = &frames[i];
+
+		switch (rec[0])
+		{
+			case CANBUS_FRAME_ID_STD:
+				f->ext = 0;
+				break;
+			case CANBUS_FRAME_ID_EXT:
+				f->ext = 1;
+				break;
+			default:
+				return (-1); // @todo Return a better error indicator
+		}
+		f->id = ((uint32_t)rec[1] << 24) | ((uint32_t)rec[2] << 16) |
+			((uint32_t)rec[3] << 8) | ((uint32_t)rec[4] << 0);
+		if (f->id > (f->ext ? CANBUS_EXT_ID_MASK : CANBUS_STD_ID_MASK))
+			return (-1); // @todo Return a better error indicator
+		f->dlc = rec[5];
+		if (f->dlc > CANBUS_FRAME_MAX_DLC)
+			return (-1); // @todo Return a better error indicator
+		memcpy(f->data, &rec[6], CANBUS_FRAME_MAX_DLC);
+		f->ts = *ts;
+	}
+
+	return ((int)count);
+} // canctl_decode_report()
+
+/**
+ * Encodes up to CANBUS_FRAMES_PER_REPORT frames into one CANBUS_OUT_SEND_DATA
+ * report, using the same record layout canctl_decode_report() reads.
+ * @param buf Buffer to encode the report into
+ * @param len Length of buffer @c buf, at least CANBUS_MSG_SIZE is enough
+ * @param frames Frames to encode
+ * @param n Number of frames in @c frames
+ * @returns Returns the number of report bytes to write on success, -1 on error
+ */
+int canctl_encode_frames(unsigned char *buf, size_t len,
+	const canbus_frame_t *frames, size_t n)
+{
+	size_t rptlen = CANBUS_REPORT_HEADER_SIZE + n * CANBUS_FRAME_RECORD_SIZE;
 
-	// Read
+	if (buf == NULL || frames == NULL)
+		return (-1); // @todo Return a better error indicator
+	if (n == 0 || n > CANBUS_FRAMES_PER_REPORT || len < rptlen)
+		return (-1); // @todo Return a better error indicator
+
+	buf[0] = CANBUS_OUT_SEND_DATA;
+	buf[1] = n;
+	for (size_t i = 0; i < n; i++)
+	{
+		unsigned char *rec = &buf[CANBUS_REPORT_HEADER_SIZE +
+			i * CANBUS_FRAME_RECORD_SIZE];
+		const canbus_frame_t *f = &frames[i];
+
+		if (f->dlc > CANBUS_FRAME_MAX_DLC)
+			return (-1); // @todo Return a better error indicator
+		if (f->id > (f->ext ? CANBUS_EXT_ID_MASK : CANBUS_STD_ID_MASK))
+			return (-1); // @todo Return a better error indicator
+
+		rec[0] = f->ext ? CANBUS_FRAME_ID_EXT : CANBUS_FRAME_ID_STD;
+		rec[1] = (f->id >> 24) & 0xff;
+		rec[2] = (f->id >> 16) & 0xff;
+		rec[3] = (f->id >> 8) & 0xff;
+		rec[4] = (f->id >> 0) & 0xff;
+		rec[5] = f->dlc;
+		memcpy(&rec[6], f->data, f->dlc);
+		memset(&rec[6 + f->dlc], 0, CANBUS_FRAME_MAX_DLC - f->dlc);
+	}
+
+	return ((int)rptlen);
+} // canctl_encode_frames()
+
+/**
+ * canctl_send_frames() for CANCTL_IO_URING: encodes up to URING_WRITE_BATCH
+ * reports at a time and hands each batch to the kernel in one system call.
+ * @param dev The CANbus module's handle
+ * @param frames Frames to send
+ * @param n Number of frames in @c frames
+ * @param sent Set to the number of frames sent
+ * @returns Returns 0 if the frames went through the transmit ring (@c sent
+ * is short on a write error), -1 if the ring could not be set up and
+ * nothing was sent
+ */
+static int canctl_send_uring(canctl_dev_t *dev, const canbus_frame_t *frames,
+	size_t n, size_t *sent)
+{
+	unsigned char bufs[URING_WRITE_BATCH][CANBUS_MSG_SIZE];
+	struct iovec iov[URING_WRITE_BATCH];
+	size_t nframes[URING_WRITE_BATCH]; // Frames in each report
+	uring_stats_t before, after;
+	size_t nrpt, start, done = 0;
+	int len, written, err = 0;
+
+	pthread_mutex_lock(&dev->tx_lock);
+	if (dev->tx_ring == NULL &&
+		(dev->tx_ring = uring_create(dev->fd, 0)) == NULL)
+	{
+		pthread_mutex_unlock(&dev->tx_lock);
+		return (-1);
+	}
+	uring_get_stats(dev->tx_ring, &before);
+	while (done < n && err == 0)
+	{
+		start = done;
+		for (nrpt = 0; nrpt < URING_WRITE_BATCH && done < n; nrpt++)
+		{
+			nframes[nrpt] = n - done;
+			if (nframes[nrpt] > CANBUS_FRAMES_PER_REPORT)
+				nframes[nrpt] = CANBUS_FRAMES_PER_REPORT;
+			if ((len = canctl_encode_frames(bufs[nrpt], sizeof(bufs[nrpt]),
+				&frames[done], nframes[nrpt])) < 0)
+			{
+				err = errno;
+				break;
+			}
+			iov[nrpt].iov_base = bufs[nrpt];
+			iov[nrpt].iov_len = len;
+			done += nframes[nrpt];
+		}
+		if (nrpt == 0)
+			break;
+		if ((written = uring_write(dev->tx_ring, iov, nrpt,
+			dev->timeout_ms)) < 0)
+			written = 0;
+		CANCTL_STAT_ADD(dev, reports_written, written);
+		if (written != (int)nrpt)
+		{
+			// Only the reports that went out in full count
+			err = errno;
+			done = start;
+			for (int i = 0; i < written; i++)
+				done += nframes[i];
+			CANCTL_STAT_ADD(dev, write_errors, 1);
+			if (err == ETIMEDOUT)
+				CANCTL_STAT_ADD(dev, timeouts, 1);
+		}
+	}
+	uring_get_stats(dev->tx_ring, &after);
+	pthread_mutex_unlock(&dev->tx_lock);
+	CANCTL_STAT_ADD(dev, io_syscalls, after.enters - before.enters);
+	*sent = done;
+	if (err != 0)
+		errno = err;
+	return (0);
+} // canctl_send_uring()
+
+/**
+ * Sends @c n frames to the CANbus module, packing CANBUS_FRAMES_PER_REPORT
+ * frames into every report so a batch costs the fewest USB interrupt
+ * transfers. Frames are sent in order. With CANCTL_IO_URING the reports go
+ * to the kernel in batches rather than one write() each.
+ * @param dev The CANbus module's handle
+ * @param frames Frames to send
+ * @param n Number of frames in @c frames
+ * @returns Returns the number of frames sent on success, -1 on error. A short
+ * count means a report could not be written after that many frames were sent.
+ */
+int canctl_send_frames(canctl_dev_t *dev, const canbus_frame_t *frames,
+	size_t n)
+{
+	unsigned char buf[CANBUS_MSG_SIZE];
+	size_t sent = 0;
+	int len;
+
+	if (dev == NULL || frames == NULL)
+		return (-1); // @todo Return a better error indicator
+
+	// A single report gains nothing from batching
+	if (dev->io == CANCTL_IO_URING && n > CANBUS_FRAMES_PER_REPORT &&
+		canctl_send_uring(dev, frames, n, &sent) == 0)
+		return (sent > 0 ? (int)sent : -1);
+
+	while (sent < n)
+	{
+		size_t batch = n - sent;
+		if (batch > CANBUS_FRAMES_PER_REPORT)
+			batch = CANBUS_FRAMES_PER_REPORT;
+
+		if ((len = canctl_encode_frames(buf, sizeof(buf), &frames[sent],
+			batch)) < 0)
+			return (-1); // @todo Return a better error indicator
+		if (canctl_write(dev, buf, len) != len)
+			return (sent > 0 ? (int)sent : -1);
+		sent += batch;
+	}
+
+	return ((int)sent);
+} // canctl_send_frames()
+
+/**
+ * Gets the firmware version from the CANbus or GPIO module.
+ * @param dev The module's handle
+ * @param fw Buffer of CANBUS_FIRMWARE_SIZE bytes to receive the version
+ * @returns Returns 0 on success, -1 on error.
+ */
+int canctl_get_firmware_version(canctl_dev_t *dev, unsigned char *fw)
+{
+	unsigned char buf[CANBUS_MSG_SIZE];
+
+	// Clear memory to be safe
+	memset(fw, 0, CANBUS_FIRMWARE_SIZE);
 	memset(buf, 0, sizeof(buf));
-	if (canctl_read(fd, buf, sizeof(buf)) < 0)
-		return (NULL);
 
-	// Make sure the first byte is the correct report ID
-	if (buf[0] != CANBUS_IN_FW_VERSION)
-		return (NULL);
+	// Write the command and wait for its reply
+	buf[0] = CANBUS_OUT_FW_VERSION;
+	buf[1] = 0; // Data payload is empty
+	if (canctl_command(dev, buf, 2, CANBUS_IN_FW_VERSION, buf,
+		sizeof(buf)) < 0)
+		return (-1);
 
 	memcpy(fw, &buf[1], CANBUS_FIRMWARE_SIZE);
-	return (fw);
+	return (0);
 } // canctl_get_firmware_version()
 
 /**
  * Get the CANbus module's current configuration
- * @param fd The CANbus module's already open file descriptor
+ * @param dev The CANbus module's handle
  * @returns Returns the CANbus configuration, -1 on error.
  */
-canbus_cfg_t canctl_get_config(int fd)
+canbus_cfg_t canctl_get_config(canctl_dev_t *dev)
 {
 	unsigned char buf[CANBUS_MSG_SIZE];
 	canbus_cfg_t cfg;
 
-	// Write
+	// Write the command and wait for its reply
 	buf[0] = CANBUS_OUT_GET_CONFIG;
 	buf[1] = 0; // Data payload is empty
-	if (canctl_write(fd, buf, 2) != 2)
-		return (-1); // @todo Return a better error indicator
-
-	// Read
-	memset(buf, 0, sizeof(buf));
-	if (canctl_read(fd, buf, sizeof(buf)) < 0)
-		return (-1); // @todo Return a better error indicator
-
-	// Make sure the first byte is the correct report ID
-	if (buf[0] != CANBUS_IN_GET_CONFIG)
+	if (canctl_command(dev, buf, 2, CANBUS_IN_GET_CONFIG, buf,
+		sizeof(buf)) < 0)
 		return (-1); // @todo Return a better error indicator
 
 	cfg = buf[1];
@@ -134,17 +1528,17 @@ canbus_cfg_t canctl_get_config(int fd)
 /**
  * Sets the gateway's CANbus configuration and bus speed. Note that the speed
  * parameter is only used when the mode is CANBUS_CFG_CONFIGURATION.
- * @param fd The already opened CANbus module's file descriptor
+ * @param dev The CANbus module's handle
  * @param cfg The new CANbus configuration
  * @param speed The CANbus speed from 136kbps to 1Mbps (136000 to 1000000)
  * @returns Returns 0 on success, -1 on error.
  */
-int canctl_set_config(int fd, canbus_cfg_t cfg, unsigned int speed)
+int canctl_set_config(canctl_dev_t *dev, canbus_cfg_t cfg, unsigned int speed)
 {
 	unsigned char buf[CANBUS_MSG_SIZE];
 	int len;
 
-	// Write
+	// Write the command and wait for its reply
 	buf[0] = CANBUS_OUT_SET_CONFIG;
 	buf[1] = cfg;
 	len = 2;
@@ -156,28 +1550,43 @@ int canctl_set_config(int fd, canbus_cfg_t cfg, unsigned int speed)
 		buf[5] = (speed >> 0) & 0xff;
 		len = 6;
 	}
-	if (canctl_write(fd, buf, len) != len)
-		return (-1); // @todo Return a better error indicator
-
-	// Read
-	memset(buf, 0, sizeof(buf));
-	if (canctl_read(fd, buf, sizeof(buf)) < 0)
-		return (-1); // @todo Return a better error indicator
-
-	// Make sure the first byte is the correct report ID
-	if (buf[0] != CANBUS_IN_SET_CONFIG)
+	if (canctl_command(dev, buf, len, CANBUS_IN_SET_CONFIG, buf,
+		sizeof(buf)) < 0)
 		return (-1); // @todo Return a better error indicator
 
+	// Remember what the module was told so a reconnect can restore it
+	dev->cfg_known = 1;
+	dev->last_cfg = cfg;
+	if (cfg == CANBUS_CFG_CONFIGURATION)
+		dev->last_speed = speed;
 	return (0);
 } // canctl_set_config()
 
+/**
+ * Gets the configuration last set through canctl_set_config() on this
+ * handle, which is what the module runs with unless it was reset since.
+ * @param dev The CANbus module's handle
+ * @param cfg Where to store the last configuration mode
+ * @param speed Where to store the last bus speed, 0 if none was ever set
+ * @returns Returns 0 on success, -1 if no configuration was set yet
+ */
+int canctl_get_last_config(const canctl_dev_t *dev, canbus_cfg_t *cfg,
+	unsigned int *speed)
+{
+	if (dev == NULL || !dev->cfg_known)
+		return (-1);
+	*cfg = dev->last_cfg;
+	*speed = dev->last_speed;
+	return (0);
+} // canctl_get_last_config()
+
 /**
  * Sets the gateway's LED to on, off, or normal operation.
- * @param fd The already opened CANbus module's file descriptor
+ * @param dev The CANbus module's handle
  * @param mode The new LED mode
  * @returns Returns 0 on success, -1 on error.
  */
-int canctl_set_led(int fd, canbus_led_t mode)
+int canctl_set_led(canctl_dev_t *dev, canbus_led_t mode)
 {
 	unsigned char buf[CANBUS_MSG_SIZE];
 	int rpt;
@@ -197,19 +1606,11 @@ int canctl_set_led(int fd, canbus_led_t mode)
 			return (-1); // @todo Return a better error indicator
 	}
 
-	// Write
+	// Write the command and wait for its reply
 	buf[0] = rpt;
 	buf[1] = 0; // Data payload is empty
-	if (canctl_write(fd, buf, 2) != 2)
-		return (-1); // @todo Return a better error indicator
-
-	// Read
-	memset(buf, 0, sizeof(buf));
-	if (canctl_read(fd, buf, sizeof(buf)) < 0)
-		return (-1); // @todo Return a better error indicator
-
-	// Make sure the first byte is the correct report ID
-	if (buf[0] != rpt)
+	if (canctl_command(dev, buf, 2, rpt, buf,
+		sizeof(buf)) < 0)
 		return (-1); // @todo Return a better error indicator
 
 	return (0);
@@ -238,38 +1639,57 @@ const char *canctl_config_to_string(canbus_cfg_t cfg)
 } // canctl_config_to_string()
 
 /**
- * @todo Document
+ * Gets the CANbus module's error state: the Tx error count, the Rx error
+ * count and the canbus_estate_flags_t bits, one byte each.
+ * @param dev The CANbus module's handle
+ * @param estate Buffer of CANBUS_ERROR_STATE_SIZE bytes to receive the state
+ * @returns Returns 0 on success, -1 on error.
  */
-const unsigned char *canctl_get_error_state(int fd)
+int canctl_get_error_state(canctl_dev_t *dev, unsigned char *estate)
 {
-	static unsigned char estate[CANBUS_FIRMWARE_SIZE];
 	unsigned char buf[CANBUS_MSG_SIZE];
 
-	// Write
+	// Write the command and wait for its reply
 	buf[0] = CANBUS_OUT_ERROR_STATUS;
 	buf[1] = 0; // Data payload is empty
-	if (canctl_write(fd, buf, 2) != 2)
-		return (NULL); // @todo Return a better error indicator
-
-	// Read
-	memset(buf, 0, sizeof(buf));
-	if (canctl_read(fd, buf, sizeof(buf)) < 0)
-		return (NULL); // @todo Return a better error indicator
-
-	// Make sure the first byte is the correct report ID
-	if (buf[0] != CANBUS_IN_ERROR_STATUS)
-		return (NULL); // @todo Return a better error indicator
+	if (canctl_command(dev, buf, 2, CANBUS_IN_ERROR_STATUS, buf,
+		sizeof(buf)) < 0)
+		return (-1); // @todo Return a better error indicator
 
 	memcpy(estate, &buf[1], CANBUS_ERROR_STATE_SIZE);
-	return (estate);
+	CANCTL_STAT_SET(dev, tx_errors, estate[0]);
+	CANCTL_STAT_SET(dev, rx_errors, estate[1]);
+	CANCTL_STAT_SET(dev, error_flags, estate[2]);
+	return (0);
 } // canctl_get_error_status()
 
+/**
+ * Packs one byte per pin into a mask, pin 1 in bit 0.
+ */
+static uint8_t gpio_pack_pins(const unsigned char *pins)
+{
+	uint8_t mask = 0;
+
+	for (int i = 0; i < GPIO_PIN_COUNT; i++)
+		mask |= (pins[i] != 0) << i;
+	return (mask);
+} // gpio_pack_pins()
+
+/**
+ * Unpacks a mask into one byte per pin, the inverse of gpio_pack_pins().
+ */
+static void gpio_unpack_pins(uint8_t mask, unsigned char *pins)
+{
+	for (int i = 0; i < GPIO_PIN_COUNT; i++)
+		pins[i] = (mask >> i) & 1;
+} // gpio_unpack_pins()
+
 /**
  * Writes the Pin Type/Direction Settings OR pin data for each GPIO PIN
- * @param fd The already opened GPIO module's file descriptor
+ * @param dev The GPIO module's handle
  * @returns Returns 0 on success, -1 on error.
  */
-int gpio_set_pin(int fd, int op_type, unsigned char *pin_types)
+int gpio_set_pin(canctl_dev_t *dev, int op_type, unsigned char *pin_types)
 {
 	unsigned char buf[GPIO_PIN_COUNT+2];
 
@@ -284,23 +1704,10 @@ int gpio_set_pin(int fd, int op_type, unsigned char *pin_types)
 	buf[7] = pin_types[5];
 	buf[8] = pin_types[6];
 	buf[9] = pin_types[7];
-	if (canctl_write(fd, buf, 10) != 10)
+	// The reply echoes the command that was issued
+	if (canctl_command(dev, buf, 10, buf[0], buf, sizeof(buf)) < 0)
 		return (-1); // @todo Return a better error indicator
 
-	// Read
-	memset(buf, 0, sizeof(buf));
-	if (canctl_read(fd, buf, sizeof(buf)) < 0)
-		return (-1); // @todo Return a better error indicator
-
-	// Make sure the first byte is the command that was issued
-	if (op_type == PIN_TYPE) {
-		if (buf[0] != GPIO_IN_SET_PIN_TYPE)
-		return (-1); // @todo Return a better error indicator
-	} else {
-		if (buf[0] != GPIO_IN_SET_PIN_DATA)
-		return (-1); // @todo Return a better error indicator
-	}
-	
 	// Make sure the second byte is the correct subcommand response
 	if (op_type == PIN_TYPE) {
 		if (buf[1] != GPIO_SET_PIN_TYPE_RESPONSE)
@@ -311,35 +1718,52 @@ int gpio_set_pin(int fd, int op_type, unsigned char *pin_types)
 		return (-1); // @todo Return a better error indicator
 	}
 
-
+	if (op_type == PIN_DATA)
+	{
+		pthread_mutex_lock(&dev->lock);
+		dev->gpio_out = gpio_pack_pins(pin_types);
+		dev->gpio_out_known = 1;
+		pthread_mutex_unlock(&dev->lock);
+	}
 	return (0);
 } // gpio_set_pin_type()
 
 
 /**
- * Reads the Pin Type/Direction Settings or PIN DATA for each GPIO PIN
- * @param fd The already opened GPIO module's file descriptor
+ * Sends the request half of gpio_read_pin() without waiting for the reply,
+ * so an event loop can pick the reply up when the GPIO module's fd becomes
+ * readable and hand it to gpio_parse_pin().
+ * @param dev The GPIO module's handle
+ * @param op_type PIN_TYPE or PIN_DATA
  * @returns Returns 0 on success, -1 on error.
  */
-int gpio_read_pin(int fd, int op_type, unsigned char *pin_types)
+int gpio_request_pin(canctl_dev_t *dev, int op_type)
 {
-	unsigned char buf[GPIO_PIN_COUNT+2];
+	unsigned char buf[2];
 
 	// Write command and subcommand
 	buf[0] = (op_type == PIN_TYPE) ? GPIO_OUT_READ_PIN_TYPE : GPIO_OUT_READ_PIN_DATA;
 	buf[1] = (op_type == PIN_TYPE) ? GPIO_READ_PIN_TYPE_CMD : GPIO_READ_PIN_DATA_CMD;
-	
-	if (canctl_write(fd, buf, 2) != 2) {
+
+	if (canctl_write(dev, buf, 2) != 2)
 		return (-1); // @todo Return a better error indicator
-                
-	}
+	return (0);
+} // gpio_request_pin()
 
-	// Read
-	memset(buf, 0, sizeof(buf));
-	if (canctl_read(fd, buf, sizeof(buf)) < 0) {
+/**
+ * Parses the GPIO module's reply to gpio_request_pin().
+ * @param buf Report read from the GPIO module
+ * @param len Number of valid bytes in @c buf
+ * @param op_type PIN_TYPE or PIN_DATA, as requested
+ * @param pin_types Filled with GPIO_PIN_COUNT values, one per pin
+ * @returns Returns 0 on success, -1 if @c buf is not the expected reply.
+ */
+int gpio_parse_pin(const unsigned char *buf, size_t len, int op_type,
+	unsigned char *pin_types)
+{
+	if (len < GPIO_PIN_COUNT+2)
 		return (-1); // @todo Return a better error indicator
-                
-	}
+
 	// Make sure the first byte is the command that was issued
 	if (op_type == PIN_TYPE) {
 		if (buf[0] != GPIO_IN_READ_PIN_TYPE)
@@ -357,51 +1781,641 @@ int gpio_read_pin(int fd, int op_type, unsigned char *pin_types)
 		if (buf[1] != GPIO_READ_PIN_DATA_CMD)
 		return (-1); // @todo Return a better error indicator
 	}
-		
 
 	//Responses were correct, so fill pin type array with values
-	pin_types[0] = buf[2];
-	pin_types[1] = buf[3];
-	pin_types[2] = buf[4];
-	pin_types[3] = buf[5];
-	pin_types[4] = buf[6];
-	pin_types[5] = buf[7];
-	pin_types[6] = buf[8];
-	pin_types[7] = buf[9];
-	
+	memcpy(pin_types, &buf[2], GPIO_PIN_COUNT);
 	return (0);
+} // gpio_parse_pin()
+
+/**
+ * Reads the Pin Type/Direction Settings or PIN DATA for each GPIO PIN
+ * @param dev The GPIO module's handle
+ * @returns Returns 0 on success, -1 on error.
+ */
+int gpio_read_pin(canctl_dev_t *dev, int op_type, unsigned char *pin_types)
+{
+	unsigned char buf[GPIO_PIN_COUNT+2];
+	int nbytes;
+
+	// Write command and subcommand, the reply echoes the command
+	buf[0] = (op_type == PIN_TYPE) ? GPIO_OUT_READ_PIN_TYPE : GPIO_OUT_READ_PIN_DATA;
+	buf[1] = (op_type == PIN_TYPE) ? GPIO_READ_PIN_TYPE_CMD : GPIO_READ_PIN_DATA_CMD;
+	if ((nbytes = canctl_command(dev, buf, 2, buf[0], buf, sizeof(buf))) < 0)
+		return (-1); // @todo Return a better error indicator
+
+	return (gpio_parse_pin(buf, nbytes, op_type, pin_types));
 } // gpio_read_pin_type()
 
+/**
+ * Reads the pin types or pin data as a mask, pin 1 in bit 0. A set bit is
+ * an input pin (PIN_TYPE) or a high pin (PIN_DATA).
+ * @param dev The GPIO module's handle
+ * @param op_type PIN_TYPE or PIN_DATA
+ * @param mask Set to the pins' types or levels
+ * @returns Returns 0 on success, -1 on error.
+ */
+int gpio_read_pins(canctl_dev_t *dev, int op_type, uint8_t *mask)
+{
+	unsigned char pins[GPIO_PIN_COUNT];
+
+	if (gpio_read_pin(dev, op_type, pins) < 0)
+		return (-1); // @todo Return a better error indicator
+	*mask = gpio_pack_pins(pins);
+	return (0);
+} // gpio_read_pins()
+
+/**
+ * Sets every pin's type or data from a mask, pin 1 in bit 0.
+ * @param dev The GPIO module's handle
+ * @param op_type PIN_TYPE or PIN_DATA
+ * @param mask Set bits make input pins (PIN_TYPE) or high pins (PIN_DATA)
+ * @returns Returns 0 on success, -1 on error.
+ */
+int gpio_set_pins(canctl_dev_t *dev, int op_type, uint8_t mask)
+{
+	unsigned char pins[GPIO_PIN_COUNT];
+
+	gpio_unpack_pins(mask, pins);
+	return (gpio_set_pin(dev, op_type, pins));
+} // gpio_set_pins()
+
+/**
+ * Changes the GPIO module's pin data to ((old & ~clear) ^ flip) in one
+ * transaction, where old is the handle's copy of what was last written.
+ * Only the first call on a handle (or after a reconnect) reads the pin data
+ * to seed that copy.
+ * @returns Returns 0 on success, -1 on error.
+ */
+static int gpio_modify_pins(canctl_dev_t *dev, uint8_t clear, uint8_t flip)
+{
+	uint8_t out;
+	int known, rc;
+
+	if (dev == NULL)
+		return (-1); // @todo Return a better error indicator
+	pthread_mutex_lock(&dev->gpio_lock);
+	pthread_mutex_lock(&dev->lock);
+	known = dev->gpio_out_known;
+	out = dev->gpio_out;
+	pthread_mutex_unlock(&dev->lock);
+	if (!known && gpio_read_pins(dev, PIN_DATA, &out) < 0)
+	{
+		pthread_mutex_unlock(&dev->gpio_lock);
+		return (-1); // @todo Return a better error indicator
+	}
+	rc = gpio_set_pins(dev, PIN_DATA, (out & ~clear) ^ flip);
+	pthread_mutex_unlock(&dev->gpio_lock);
+	return (rc);
+} // gpio_modify_pins()
+
+/**
+ * Drives some output pins and leaves the others as they were, usually in a
+ * single transaction (see gpio_modify_pins()).
+ * @param dev The GPIO module's handle
+ * @param mask Pins to change, pin 1 in bit 0
+ * @param value New levels for the pins in @c mask, other bits are ignored
+ * @returns Returns 0 on success, -1 on error.
+ */
+int gpio_write_pins(canctl_dev_t *dev, uint8_t mask, uint8_t value)
+{
+	return (gpio_modify_pins(dev, mask, value & mask));
+} // gpio_write_pins()
+
+/**
+ * Flips some output pins, usually in a single transaction (see
+ * gpio_modify_pins()).
+ * @param dev The GPIO module's handle
+ * @param mask Pins to flip, pin 1 in bit 0
+ * @returns Returns 0 on success, -1 on error.
+ */
+int gpio_toggle_pins(canctl_dev_t *dev, uint8_t mask)
+{
+	return (gpio_modify_pins(dev, 0, mask));
+} // gpio_toggle_pins()
+
 /**
  * Get the IO Module SKU or GPIO PIC Board ID
- * @param fd The GPIO module's already open file descriptor
+ * @param dev The GPIO module's handle
  * @returns Returns , -1 on error.
  */
-int gpio_get_iom_or_sku(int fd, int op_select, unsigned char *outbuf)
+int gpio_get_iom_or_sku(canctl_dev_t *dev, int op_select, unsigned char *outbuf)
 {
 	unsigned char buf[CANBUS_MSG_SIZE];
 
-	// Write
+	// Write the command and wait for its reply
 	buf[0] = (op_select == GET_IOM) ? GPIO_OUT_GET_IOM_SKU : GPIO_IN_GET_BOARD_ID;
 	buf[1] = 0; // Data payload is empty
-	if (canctl_write(fd, buf, 2) != 2)
-		return (-1); // @todo Return a better error indicator
-
-	// Read
-	memset(buf, 0, sizeof(buf));
-	if (canctl_read(fd, buf, sizeof(buf)) < 0)
+	if (canctl_command(dev, buf, 2, (op_select == GET_IOM) ?
+		GPIO_IN_GET_IOM_SKU : GPIO_IN_GET_BOARD_ID, buf, sizeof(buf)) < 0)
 		return (-1); // @todo Return a better error indicator
 
-	// Make sure the first byte is the correct report ID
- 	if (op_select == GET_IOM) { 	
-		if (buf[0] != GPIO_IN_GET_IOM_SKU)
-			return (-1); // @todo Return a better error indicator
-	} else {
-		if (buf[0] != GPIO_IN_GET_BOARD_ID)
-			return (-1); // @todo Return a better error indicator
-	}
-
 	outbuf[0] = buf[1];
 
 	return (0);
 } // gpio_get_iom_or_sku()
+
+/**
+ * canctl_submit() callback for canctl_query_info(): stores one reply in the
+ * module's canctl_info_t, or the first error.
+ */
+static void canctl_info_reply(canctl_dev_t *dev, int err,
+	const unsigned char *reply, size_t len, void *arg)
+{
+	canctl_info_t *info = arg;
+	unsigned char data[CANBUS_FIRMWARE_SIZE + CANBUS_ERROR_STATE_SIZE] = { 0 };
+
+	if (err != 0)
+	{
+		if (info->err == 0)
+			info->err = err;
+		return;
+	}
+	// Short replies read as zeros, like the blocking getters' cleared buffer
+	if (len > 1)
+		memcpy(data, &reply[1], len - 1 < sizeof(data) ? len - 1 : sizeof(data));
+	switch (reply[0])
+	{
+		case CANBUS_IN_FW_VERSION: // Same ID on the GPIO module
+			memcpy(info->fw, data, CANBUS_FIRMWARE_SIZE);
+			break;
+		case CANBUS_IN_GET_CONFIG:
+			info->cfg = data[0];
+			break;
+		case CANBUS_IN_ERROR_STATUS:
+			memcpy(info->estate, data, CANBUS_ERROR_STATE_SIZE);
+			CANCTL_STAT_SET(dev, tx_errors, data[0]);
+			CANCTL_STAT_SET(dev, rx_errors, data[1]);
+			CANCTL_STAT_SET(dev, error_flags, data[2]);
+			break;
+		case GPIO_IN_GET_BOARD_ID:
+			info->board_id = data[0];
+			break;
+		case GPIO_IN_GET_IOM_SKU:
+			info->sku = data[0];
+			break;
+	}
+} // canctl_info_reply()
+
+/**
+ * Asks every module for its identity and state at once: the firmware
+ * version, plus the configuration and error state of a CANbus module or the
+ * board ID and SKU of a GPIO module. All the commands go out before any
+ * reply is awaited, so bringing up a rack of modules takes about one round
+ * trip instead of a handful per module.
+ * @param devs The modules' handles
+ * @param info One entry per module. The caller sets @c gpio; the rest is
+ * filled in.
+ * @param n Number of modules
+ * @returns Returns 0 if every module answered every query, -1 otherwise
+ * (the entries' @c err say which failed)
+ */
+int canctl_query_info(canctl_dev_t **devs, canctl_info_t *info, size_t n)
+{
+	static const unsigned char can_queries[][2] = {
+		{ CANBUS_OUT_FW_VERSION, CANBUS_IN_FW_VERSION },
+		{ CANBUS_OUT_GET_CONFIG, CANBUS_IN_GET_CONFIG },
+		{ CANBUS_OUT_ERROR_STATUS, CANBUS_IN_ERROR_STATUS },
+	};
+	static const unsigned char gpio_queries[][2] = {
+		{ CANBUS_OUT_FW_VERSION, CANBUS_IN_FW_VERSION },
+		{ GPIO_OUT_GET_BOARD_ID, GPIO_IN_GET_BOARD_ID },
+		{ GPIO_OUT_GET_IOM_SKU, GPIO_IN_GET_IOM_SKU },
+	};
+	unsigned char buf[2];
+	int rc = 0;
+
+	// Send everything first...
+	for (size_t i = 0; i < n; i++)
+	{
+		const unsigned char (*q)[2] = info[i].gpio ? gpio_queries : can_queries;
+
+		info[i].err = 0;
+		memset(info[i].fw, 0, sizeof(info[i].fw));
+		info[i].cfg = CANBUS_CFG_UNKNOWN;
+		memset(info[i].estate, 0, sizeof(info[i].estate));
+		info[i].board_id = 0;
+		info[i].sku = 0;
+		for (size_t k = 0; k < 3; k++)
+		{
+			buf[0] = q[k][0];
+			buf[1] = 0; // Data payload is empty
+			// Not every failure sets errno, so none must be left over
+			errno = 0;
+			if (canctl_submit(devs[i], buf, sizeof(buf), q[k][1],
+				canctl_info_reply, &info[i]) < 0 && info[i].err == 0)
+				info[i].err = errno ? errno : EIO;
+		}
+	}
+
+	// ...then collect the replies, which are all on their way by now
+	for (size_t i = 0; i < n; i++)
+	{
+		while (canctl_in_flight(devs[i]) > 0)
+		{
+			errno = 0;
+			if (canctl_complete(devs[i], -1) < 0)
+			{
+				if (info[i].err == 0)
+					info[i].err = errno ? errno : EIO;
+				canctl_cancel(devs[i]); // Nothing may point at info[i] after
+				break;
+			}
+		}
+		if (info[i].err != 0)
+			rc = -1;
+	}
+	return (rc);
+} // canctl_query_info()
+
+
+/**
+ * State of one background reader thread, see canctl_reader_start().
+ */
+struct canctl_reader
+{
+	pthread_t thread;
+	canctl_dev_t *dev; // CANbus module being drained
+	int efd; // eventfd bumped whenever frames are pushed or the thread exits
+	int stop; // Set by canctl_reader_stop(), read by the thread
+	int error; // errno that made the thread exit early, 0 otherwise
+	canctl_ring_t *ring;
+};
+
+/**
+ * Empties a ring and clears its counters. Must not be called while a reader
+ * thread is pushing into it.
+ * @param ring The ring to initialize
+ */
+void canctl_ring_init(canctl_ring_t *ring)
+{
+	ring->head = 0;
+	ring->tail = 0;
+	ring->overflows = 0;
+	ring->bad_reports = 0;
+} // canctl_ring_init()
+
+/**
+ * Producer side: appends frames to the ring. Frames that do not fit are
+ * dropped and counted in the ring's overflow counter.
+ * @param ring The ring to push into
+ * @param frames Frames to append
+ * @param n Number of frames in @c frames
+ * @returns Returns the number of frames actually stored
+ */
+size_t canctl_ring_push(canctl_ring_t *ring, const canbus_frame_t *frames,
+	size_t n)
+{
+	size_t head = ring->head; // Only this thread writes head
+	size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	size_t space = CANCTL_RING_SIZE - (head - tail);
+	size_t i;
+
+	if (n > space)
+	{
+		__atomic_fetch_add(&ring->overflows, n - space, __ATOMIC_RELAXED);
+		n = space;
+	}
+	for (i = 0; i < n; i++)
+		ring->slots[(head + i) & (CANCTL_RING_SIZE - 1)] = frames[i];
+
+	// Publish the new frames only after they are fully written
+	__atomic_store_n(&ring->head, head + n, __ATOMIC_RELEASE);
+	return (n);
+} // canctl_ring_push()
+
+/**
+ * Consumer side: removes up to @c max frames from the ring, oldest first.
+ * @param ring The ring to pop from
+ * @param frames Buffer to copy the frames into
+ * @param max Number of elements in @c frames
+ * @returns Returns the number of frames copied, 0 if the ring is empty
+ */
+size_t canctl_ring_pop(canctl_ring_t *ring, canbus_frame_t *frames,
+	size_t max)
+{
+	size_t tail = ring->tail; // Only this thread writes tail
+	size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	size_t n = head - tail;
+	size_t i;
+
+	if (n > max)
+		n = max;
+	for (i = 0; i < n; i++)
+		frames[i] = ring->slots[(tail + i) & (CANCTL_RING_SIZE - 1)];
+
+	// Hand the slots back to the producer only after they are copied out
+	__atomic_store_n(&ring->tail, tail + n, __ATOMIC_RELEASE);
+	return (n);
+} // canctl_ring_pop()
+
+/**
+ * Consumer side: lends out the oldest frames in place instead of copying
+ * them. Only the frames up to the end of the slot array are returned, so a
+ * span that wraps takes two calls. The frames stay valid and unchanged
+ * until they are handed back with canctl_ring_release().
+ * @param ring The ring to peek into
+ * @param frames Set to the oldest frame waiting in the ring
+ * @returns Returns the number of consecutive frames at @c *frames, 0 if the
+ * ring is empty
+ */
+size_t canctl_ring_peek(canctl_ring_t *ring, const canbus_frame_t **frames)
+{
+	size_t tail = ring->tail; // Only this thread writes tail
+	size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	size_t idx = tail & (CANCTL_RING_SIZE - 1);
+	size_t n = head - tail;
+
+	if (n > CANCTL_RING_SIZE - idx)
+		n = CANCTL_RING_SIZE - idx;
+	*frames = &ring->slots[idx];
+	return (n);
+} // canctl_ring_peek()
+
+/**
+ * Consumer side: hands the oldest @c n frames back to the producer after
+ * canctl_ring_peek(). Their slots may be overwritten as soon as this returns.
+ * @param ring The ring to release frames in
+ * @param n Number of frames to release, at most what canctl_ring_peek()
+ * returned
+ */
+void canctl_ring_release(canctl_ring_t *ring, size_t n)
+{
+	__atomic_store_n(&ring->tail, ring->tail + n, __ATOMIC_RELEASE);
+} // canctl_ring_release()
+
+/**
+ * Consumer side: passes up to @c max queued frames to @c cb in place, in at
+ * most two spans when the queued frames wrap around the slot array, and
+ * releases the frames it used.
+ * @param ring The ring to drain
+ * @param cb Called with each span of frames
+ * @param arg Passed to @c cb
+ * @param max Most frames to pass, 0 for all that are queued on entry. Frames
+ * pushed meanwhile wait for the next call, so a fast producer can not keep
+ * the consumer here forever.
+ * @returns Returns the number of frames @c cb used
+ */
+size_t canctl_ring_consume(canctl_ring_t *ring, canctl_ring_cb cb, void *arg,
+	size_t max)
+{
+	const canbus_frame_t *frames;
+	size_t total = 0, n, used;
+
+	if (max == 0)
+		max = canctl_ring_count(ring);
+	while (total < max && (n = canctl_ring_peek(ring, &frames)) > 0)
+	{
+		if (n > max - total)
+			n = max - total;
+		used = cb(frames, n, arg);
+		if (used > n)
+			used = n;
+		canctl_ring_release(ring, used);
+		total += used;
+		if (used < n)
+			break;
+	}
+	return (total);
+} // canctl_ring_consume()
+
+/**
+ * @param ring The ring to inspect
+ * @returns Returns the number of frames waiting in the ring
+ */
+size_t canctl_ring_count(const canctl_ring_t *ring)
+{
+	return (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) -
+		__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+} // canctl_ring_count()
+
+/**
+ * @param ring The ring to inspect
+ * @returns Returns the number of frames dropped because the ring was full
+ */
+unsigned long canctl_ring_overflows(const canctl_ring_t *ring)
+{
+	return (__atomic_load_n(&ring->overflows, __ATOMIC_RELAXED));
+} // canctl_ring_overflows()
+
+/**
+ * Bumps the reader's eventfd to wake the consumer. A failed write only means
+ * the counter is saturated, in which case the consumer is awake anyway.
+ * @param r The reader whose consumer to wake
+ */
+static void canctl_reader_notify(canctl_reader_t *r)
+{
+	uint64_t one = 1;
+	ssize_t rc = write(r->efd, &one, sizeof(one));
+	(void)rc;
+} // canctl_reader_notify()
+
+/**
+ * canctl_read_timeout() through a receive ring, for reader threads on a
+ * CANCTL_IO_URING handle. Keeps the same statistics.
+ * @param dev The module's handle
+ * @param ring The reader thread's receive ring
+ * @param buf Buffer to read data into
+ * @param len Length of buffer @c buf
+ * @param timeout_ms Milliseconds to wait, or negative to wait forever
+ * @returns Returns the number of bytes read on success, 0 on timeout,
+ * -1 on error
+ */
+static int canctl_read_uring(canctl_dev_t *dev, uring_t *ring,
+	unsigned char *buf, size_t len, int timeout_ms)
+{
+	uring_stats_t before, after;
+	int nbytes;
+
+	uring_get_stats(ring, &before);
+	nbytes = uring_read(ring, buf, len, timeout_ms);
+	uring_get_stats(ring, &after);
+	if (after.enters != before.enters)
+		CANCTL_STAT_ADD(dev, io_syscalls, after.enters - before.enters);
+	if (after.retries != before.retries)
+		CANCTL_STAT_ADD(dev, io_retries, after.retries - before.retries);
+	if (nbytes > 0)
+	{
+		CANCTL_STAT_ADD(dev, reports_read, 1);
+		canctl_stamp(dev);
+	}
+	else if (nbytes < 0 && errno != EINTR)
+		CANCTL_STAT_ADD(dev, read_errors, 1);
+	return (nbytes);
+} // canctl_read_uring()
+
+/**
+ * Routes one report the reader thread read: command replies go to the
+ * waiting command, data frames through the filter into the ring.
+ * @param r The reader
+ * @param buf The report
+ * @param nbytes Length of the report
+ */
+static void canctl_reader_deliver(canctl_reader_t *r, unsigned char *buf,
+	int nbytes)
+{
+	canbus_frame_t frames[CANBUS_FRAMES_PER_REPORT];
+	int nframes;
+
+	if (canctl_dispatch(r->dev, buf, nbytes) != CANCTL_ROUTE_DATA)
+		return;
+	if ((nframes = canctl_decode_report(buf, nbytes, frames,
+		CANBUS_FRAMES_PER_REPORT, &r->dev->rx_ts)) < 0)
+	{
+		__atomic_fetch_add(&r->ring->bad_reports, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	nframes = canctl_filter_frames(r->dev, frames, nframes);
+	if (nframes > 0)
+	{
+		canctl_ring_push(r->ring, frames, nframes);
+		canctl_reader_notify(r);
+	}
+} // canctl_reader_deliver()
+
+/**
+ * Reader thread body. Reads reports as fast as the module delivers them,
+ * decodes them and pushes the frames into the ring. Every report goes through
+ * canctl_dispatch() first, so replies to commands issued from other threads
+ * reach the command instead of the ring.
+ * @param arg The canctl_reader_t that owns this thread
+ * @returns Always NULL
+ */
+static void *canctl_reader_main(void *arg)
+{
+	canctl_reader_t *r = arg;
+	unsigned char buf[CANBUS_MSG_SIZE];
+	uring_t *rx_ring = NULL;
+	uring_stats_t before, after;
+	int nbytes;
+
+	// Without a ring (e.g. too many open files), fall back to select()
+	if (r->dev->io == CANCTL_IO_URING)
+		rx_ring = uring_create(r->dev->fd, URING_READ_DEPTH);
+
+	while (!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE))
+	{
+		if (rx_ring != NULL)
+			nbytes = canctl_read_uring(r->dev, rx_ring, buf, sizeof(buf),
+				CANCTL_READER_POLL_MS);
+		else
+			nbytes = canctl_read_timeout(r->dev, buf, sizeof(buf),
+				CANCTL_READER_POLL_MS);
+		if (nbytes < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			__atomic_store_n(&r->error, errno, __ATOMIC_RELEASE);
+			break;
+		}
+		else if (nbytes == 0)
+			continue; // Timeout, just go check the stop flag
+		canctl_reader_deliver(r, buf, nbytes);
+	}
+
+	if (rx_ring != NULL)
+	{
+		// Reports the ring already read in would be lost with it, where
+		// select() and read() would have left them queued in the driver
+		uring_get_stats(rx_ring, &before);
+		while ((nbytes = uring_drain(rx_ring, buf, sizeof(buf))) > 0)
+		{
+			CANCTL_STAT_ADD(r->dev, reports_read, 1);
+			canctl_stamp(r->dev);
+			canctl_reader_deliver(r, buf, nbytes);
+		}
+		uring_get_stats(rx_ring, &after);
+		CANCTL_STAT_ADD(r->dev, io_syscalls, after.enters - before.enters);
+		uring_destroy(rx_ring);
+	}
+	// Wake the consumer so it notices the thread is gone
+	canctl_reader_notify(r);
+	return (NULL);
+} // canctl_reader_main()
+
+/**
+ * Starts a background thread that drains the module into @c ring. While
+ * the reader runs, nothing else may read from the module and only one
+ * consumer may pop from @c ring. The consumer can wait on
+ * canctl_reader_event_fd() instead of polling the ring.
+ * @param dev The CANbus module's handle
+ * @param ring Ring to push decoded frames into; it is initialized here
+ * @returns Returns the new reader on success, NULL on error
+ */
+canctl_reader_t *canctl_reader_start(canctl_dev_t *dev, canctl_ring_t *ring)
+{
+	canctl_reader_t *r;
+	sigset_t all, old;
+
+	if (dev == NULL || ring == NULL)
+		return (NULL); // @todo Return a better error indicator
+	if ((r = calloc(1, sizeof(*r))) == NULL)
+		return (NULL);
+	r->dev = dev;
+	r->ring = ring;
+	canctl_ring_init(ring);
+	if ((r->efd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK)) < 0)
+	{
+		free(r);
+		return (NULL);
+	}
+
+	// From now on commands wait for the reader to route their replies
+	pthread_mutex_lock(&dev->lock);
+	dev->reader_active = 1;
+	pthread_mutex_unlock(&dev->lock);
+
+	// The reader must never take signals meant for the UI thread (Ctrl+c),
+	// so create it with everything blocked.
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	if (pthread_create(&r->thread, NULL, canctl_reader_main, r) != 0)
+	{
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		pthread_mutex_lock(&dev->lock);
+		dev->reader_active = 0;
+		pthread_mutex_unlock(&dev->lock);
+		close(r->efd);
+		free(r);
+		return (NULL);
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return (r);
+} // canctl_reader_start()
+
+/**
+ * @param reader A running reader
+ * @returns Returns an eventfd that becomes readable whenever frames were
+ * pushed into the ring or the reader thread exited
+ */
+int canctl_reader_event_fd(const canctl_reader_t *reader)
+{
+	return (reader->efd);
+} // canctl_reader_event_fd()
+
+/**
+ * @param reader A running reader
+ * @returns Returns the errno that made the reader thread exit on its own,
+ * or 0 if it is still running
+ */
+int canctl_reader_error(const canctl_reader_t *reader)
+{
+	return (__atomic_load_n(&reader->error, __ATOMIC_ACQUIRE));
+} // canctl_reader_error()
+
+/**
+ * Stops the reader thread, waits for it to exit and frees it. Frames still
+ * in the ring stay there for the consumer.
+ * @param reader The reader to stop, may be NULL
+ */
+void canctl_reader_stop(canctl_reader_t *reader)
+{
+	if (reader == NULL)
+		return;
+	__atomic_store_n(&reader->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(reader->thread, NULL);
+	pthread_mutex_lock(&reader->dev->lock);
+	reader->dev->reader_active = 0;
+	pthread_mutex_unlock(&reader->dev->lock);
+	close(reader->efd);
+	free(reader);
+} // canctl_reader_stop()
@@ -0,0 +1,306 @@
+/**
+ * @file canfilter.c
+ * @date 2026-10-16
+ */
+
+#include "canfilter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/**
+ * Extended ID rule: accepts IDs where lo <= (ID & mask) <= hi
+ */
+typedef struct canfilter_rule
+{
+	uint32_t mask;
+	uint32_t lo;
+	uint32_t hi;
+} canfilter_rule_t;
+
+struct canfilter
+{
+	uint32_t std[(CANBUS_STD_ID_MASK + 1) / 32]; // One bit per standard ID
+	size_t nrules;
+	canfilter_rule_t ext[CANFILTER_MAX_EXT_RULES];
+
+	// Set by canfilter_compile(): rules sharing a mask are contiguous,
+	// sorted by lo and do not overlap, so each group is binary searched
+	size_t ngroups;
+	struct
+	{
+		uint32_t mask;
+		size_t first;
+		size_t count;
+	} groups[CANFILTER_MAX_EXT_RULES];
+};
+
+/**
+ * Creates an empty filter, which drops every frame until rules are added.
+ * @returns Returns the new filter on success, NULL on error
+ */
+canfilter_t *canfilter_create(void)
+{
+	return (calloc(1, sizeof(canfilter_t)));
+} // canfilter_create()
+
+/**
+ * @param f The filter to free, may be NULL
+ */
+void canfilter_destroy(canfilter_t *f)
+{
+	free(f);
+} // canfilter_destroy()
+
+/**
+ * Accepts standard IDs @c lo to @c hi inclusive.
+ * @param f The filter
+ * @param lo First ID to accept
+ * @param hi Last ID to accept
+ * @returns Returns 0 on success, -1 on error (errno is EINVAL)
+ */
+int canfilter_add_std(canfilter_t *f, uint32_t lo, uint32_t hi)
+{
+	if (lo > hi || hi > CANBUS_STD_ID_MASK)
+	{
+		errno = EINVAL;
+		return (-1);
+	}
+	for (uint32_t id = lo; id <= hi; id++)
+		f->std[id / 32] |= 1u << (id % 32);
+	return (0);
+} // canfilter_add_std()
+
+/**
+ * Accepts extended IDs where @c lo <= (ID & @c mask) <= @c hi. Use a mask of
+ * CANBUS_EXT_ID_MASK for a plain range, or @c lo == @c hi for a value/mask
+ * match. canfilter_compile() must be called before the filter is used.
+ * @param f The filter
+ * @param lo Lowest accepted masked ID
+ * @param hi Highest accepted masked ID
+ * @param mask ID bits that take part in the comparison
+ * @returns Returns 0 on success, -1 on error (errno is EINVAL or ENOSPC)
+ */
+int canfilter_add_ext(canfilter_t *f, uint32_t lo, uint32_t hi,
+	uint32_t mask)
+{
+	if (lo > hi || hi > CANBUS_EXT_ID_MASK || mask > CANBUS_EXT_ID_MASK ||
+		(lo & ~mask) != 0 || (hi & ~mask) != 0)
+	{
+		errno = EINVAL;
+		return (-1);
+	}
+	if (f->nrules >= CANFILTER_MAX_EXT_RULES)
+	{
+		errno = ENOSPC;
+		return (-1);
+	}
+	f->ext[f->nrules].mask = mask;
+	f->ext[f->nrules].lo = lo;
+	f->ext[f->nrules].hi = hi;
+	f->nrules++;
+	return (0);
+} // canfilter_add_ext()
+
+/**
+ * qsort() comparator ordering rules by mask, then by lo
+ */
+static int canfilter_rule_cmp(const void *a, const void *b)
+{
+	const canfilter_rule_t *ra = a, *rb = b;
+
+	if (ra->mask != rb->mask)
+		return (ra->mask < rb->mask ? -1 : 1);
+	if (ra->lo != rb->lo)
+		return (ra->lo < rb->lo ? -1 : 1);
+	return (0);
+} // canfilter_rule_cmp()
+
+/**
+ * Sorts the extended ID rules, merges overlapping and adjacent ranges that
+ * share a mask and builds the per-mask groups canfilter_match() searches.
+ * @param f The filter
+ */
+void canfilter_compile(canfilter_t *f)
+{
+	size_t out = 0;
+
+	qsort(f->ext, f->nrules, sizeof(f->ext[0]), canfilter_rule_cmp);
+	f->ngroups = 0;
+	for (size_t i = 0; i < f->nrules; i++)
+	{
+		canfilter_rule_t *prev = out > 0 ? &f->ext[out - 1] : NULL;
+
+		if (prev != NULL && prev->mask == f->ext[i].mask &&
+			(uint64_t)f->ext[i].lo <= (uint64_t)prev->hi + 1)
+		{
+			if (f->ext[i].hi > prev->hi)
+				prev->hi = f->ext[i].hi;
+			continue;
+		}
+		f->ext[out] = f->ext[i];
+		if (prev == NULL || prev->mask != f->ext[out].mask)
+		{
+			f->groups[f->ngroups].mask = f->ext[out].mask;
+			f->groups[f->ngroups].first = out;
+			f->groups[f->ngroups].count = 0;
+			f->ngroups++;
+		}
+		f->groups[f->ngroups - 1].count++;
+		out++;
+	}
+	f->nrules = out;
+} // canfilter_compile()
+
+/**
+ * Parses "LO", "LO-HI" or, if @c mask is not NULL, "VALUE/MASK" in hex.
+ * @returns Returns 0 on success, -1 on a syntax error
+ */
+static int canfilter_parse_spec(const char *spec, uint32_t *lo, uint32_t *hi,
+	uint32_t *mask)
+{
+	char *end;
+	unsigned long num;
+
+	num = strtoul(spec, &end, 16);
+	if (end == spec || num > CANBUS_EXT_ID_MASK)
+		return (-1);
+	*lo = *hi = num;
+	if (*end == '\0')
+		return (0);
+	if (*end != '-' && (*end != '/' || mask == NULL))
+		return (-1);
+
+	spec = end + 1;
+	num = strtoul(spec, &end, 16);
+	if (end == spec || *end != '\0' || num > CANBUS_EXT_ID_MASK)
+		return (-1);
+	if (*(spec - 1) == '-')
+		*hi = num;
+	else
+	{
+		*mask = num;
+		*lo = *hi = *lo & num;
+	}
+	return (0);
+} // canfilter_parse_spec()
+
+/**
+ * Builds a filter from a rule file, see canfilter.h for the format.
+ * @param path The file to load
+ * @param errline Set to the line number of the first bad rule, or 0 if the
+ * file could not be read at all. May be NULL.
+ * @returns Returns the compiled filter on success, NULL on error
+ */
+canfilter_t *canfilter_load(const char *path, int *errline)
+{
+	FILE *fp;
+	canfilter_t *f;
+	char line[256], kind[8], spec[64], extra;
+	uint32_t lo, hi, mask;
+	int lineno = 0, n, rc = 0;
+
+	if (errline != NULL)
+		*errline = 0;
+	if ((f = canfilter_create()) == NULL)
+		return (NULL);
+	if ((fp = fopen(path, "r")) == NULL)
+	{
+		canfilter_destroy(f);
+		return (NULL);
+	}
+
+	while (rc == 0 && fgets(line, sizeof(line), fp) != NULL)
+	{
+		lineno++;
+		line[strcspn(line, "#\r\n")] = '\0'; // Drop comments and EOL
+
+		if ((n = sscanf(line, "%7s %63s %c", kind, spec, &extra)) <= 0)
+			continue; // Blank line
+		if (n != 2)
+			rc = -1;
+		else if (strcmp(kind, "std") == 0)
+			rc = canfilter_parse_spec(spec, &lo, &hi, NULL) < 0 ? -1 :
+				canfilter_add_std(f, lo, hi);
+		else if (strcmp(kind, "ext") == 0)
+		{
+			mask = CANBUS_EXT_ID_MASK;
+			rc = canfilter_parse_spec(spec, &lo, &hi, &mask) < 0 ? -1 :
+				canfilter_add_ext(f, lo, hi, mask);
+		}
+		else
+			rc = -1;
+	}
+	fclose(fp);
+
+	if (rc < 0)
+	{
+		if (errline != NULL)
+			*errline = lineno;
+		canfilter_destroy(f);
+		errno = EINVAL;
+		return (NULL);
+	}
+	canfilter_compile(f);
+	return (f);
+} // canfilter_load()
+
+/**
+ * @param f The compiled filter
+ * @param frame The frame to check
+ * @returns Returns nonzero if @c frame is accepted
+ */
+int canfilter_match(const canfilter_t *f, const canbus_frame_t *frame)
+{
+	uint32_t id = frame->id;
+
+	if (!frame->ext)
+		return (id <= CANBUS_STD_ID_MASK &&
+			(f->std[id / 32] & (1u << (id % 32))) != 0);
+
+	for (size_t g = 0; g < f->ngroups; g++)
+	{
+		const canfilter_rule_t *rules = &f->ext[f->groups[g].first];
+		uint32_t v = id & f->groups[g].mask;
+		size_t lo = 0, hi = f->groups[g].count;
+
+		// Find the last rule whose range starts at or below v
+		while (lo < hi)
+		{
+			size_t mid = lo + (hi - lo) / 2;
+			if (rules[mid].lo <= v)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo > 0 && v <= rules[lo - 1].hi)
+			return (1);
+	}
+	return (0);
+} // canfilter_match()
+
+/**
+ * Drops the frames @c f does not accept, keeping the rest in order.
+ * @param f The compiled filter, or NULL to accept every frame
+ * @param frames The frames to filter in place
+ * @param n Number of frames in @c frames
+ * @returns Returns the number of frames kept at the start of @c frames
+ */
+size_t canfilter_apply(const canfilter_t *f, canbus_frame_t *frames,
+	size_t n)
+{
+	size_t kept = 0;
+
+	if (f == NULL)
+		return (n);
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!canfilter_match(f, &frames[i]))
+			continue;
+		if (kept != i)
+			frames[kept] = frames[i];
+		kept++;
+	}
+	return (kept);
+} // canfilter_apply()
@@ -0,0 +1,385 @@
+/**
+ * @file canmgr.c
+ * @date 2026-10-16
+ */
+
+#include "canmgr.h"
+#include "discover.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+struct canmgr
+{
+	int count;
+	int next; // Module canmgr_read() drains first, rotates for fairness
+	canmgr_device_t devices[CANMGR_MAX_DEVICES];
+};
+
+/**
+ * Creates an empty manager.
+ * @returns Returns the new manager on success, NULL on error
+ */
+canmgr_t *canmgr_create(void)
+{
+	return (calloc(1, sizeof(canmgr_t)));
+} // canmgr_create()
+
+/**
+ * Stops every reader thread, closes every module and frees the manager.
+ * @param mgr The manager to destroy, may be NULL
+ */
+void canmgr_destroy(canmgr_t *mgr)
+{
+	if (mgr == NULL)
+		return;
+	canmgr_stop(mgr);
+	for (int i = 0; i < mgr->count; i++)
+	{
+		canctl_close(mgr->devices[i].dev);
+		free(mgr->devices[i].ring);
+	}
+	free(mgr);
+} // canmgr_destroy()
+
+/**
+ * Opens the module at @c path and adds it to the manager, in the first slot
+ * canmgr_remove() freed if any. A CANbus module's reader thread starts on
+ * the next call to canmgr_start().
+ * @param mgr The manager to add to
+ * @param path The module's device file path, e.g. /dev/hidraw3
+ * @param kind Whether the module is a CANbus or GPIO module
+ * @returns Returns the module's index on success, -1 on error
+ */
+int canmgr_add(canmgr_t *mgr, const char *path, canmgr_kind_t kind)
+{
+	canmgr_device_t *d;
+	int idx;
+
+	for (idx = 0; idx < mgr->count && mgr->devices[idx].dev != NULL; idx++)
+		;
+	if (idx >= CANMGR_MAX_DEVICES)
+	{
+		errno = ENOSPC;
+		return (-1);
+	}
+	d = &mgr->devices[idx];
+	memset(d, 0, sizeof(*d));
+	d->kind = kind;
+	snprintf(d->path, sizeof(d->path), "%s", path);
+	if ((d->dev = canctl_open(path)) == NULL)
+		return (-1);
+	if (kind == CANMGR_KIND_CAN &&
+		(d->ring = malloc(sizeof(canctl_ring_t))) == NULL)
+	{
+		canctl_close(d->dev);
+		d->dev = NULL;
+		return (-1);
+	}
+	if (idx == mgr->count)
+		mgr->count++;
+	return (idx);
+} // canmgr_add()
+
+/**
+ * Stops the module's reader thread, closes the module and frees its slot,
+ * e.g. after it was unplugged. Frames still queued from it are dropped.
+ * The other modules keep their indexes.
+ * @param mgr The manager to remove from
+ * @param idx Index of the module
+ * @returns Returns 0 on success, -1 on error (errno is ENOENT if there is
+ * no such module)
+ */
+int canmgr_remove(canmgr_t *mgr, int idx)
+{
+	canmgr_device_t *d;
+
+	if (idx < 0 || idx >= mgr->count || mgr->devices[idx].dev == NULL)
+	{
+		errno = ENOENT;
+		return (-1);
+	}
+	d = &mgr->devices[idx];
+	canctl_reader_stop(d->reader);
+	canctl_close(d->dev);
+	free(d->ring);
+	memset(d, 0, sizeof(*d));
+	while (mgr->count > 0 && mgr->devices[mgr->count - 1].dev == NULL)
+		mgr->count--;
+	return (0);
+} // canmgr_remove()
+
+/**
+ * @param mgr The manager to search
+ * @param path A module's device file path
+ * @returns Returns the index of the module opened from @c path, or -1 if
+ * there is none
+ */
+int canmgr_find(const canmgr_t *mgr, const char *path)
+{
+	for (int i = 0; i < mgr->count; i++)
+		if (mgr->devices[i].dev != NULL &&
+			strcmp(mgr->devices[i].path, path) == 0)
+			return (i);
+	return (-1);
+} // canmgr_find()
+
+/**
+ * Asks udev for every CANbus and GPIO module on the system and adds them
+ * all. Modules that can not be opened are skipped.
+ * @param mgr The manager to add to
+ * @returns Returns the number of modules added, -1 on error
+ */
+int canmgr_open_all(canmgr_t *mgr)
+{
+	discover_device_t found[DISCOVER_MAX_DEVICES];
+	int nfound, added = 0;
+
+	if ((nfound = discover_find(found, DISCOVER_MAX_DEVICES, 1)) < 0)
+		return (-1);
+	for (int i = 0; i < nfound; i++)
+		added += canmgr_add(mgr, found[i].devnode,
+			found[i].kind == DISCOVER_KIND_CAN ?
+			CANMGR_KIND_CAN : CANMGR_KIND_GPIO) >= 0;
+	return (added);
+} // canmgr_open_all()
+
+/**
+ * @param mgr The manager to inspect
+ * @returns Returns one more than the highest index in use; slots below it
+ * that canmgr_remove() freed are empty
+ */
+int canmgr_count(const canmgr_t *mgr)
+{
+	return (mgr->count);
+} // canmgr_count()
+
+/**
+ * @param mgr The manager to inspect
+ * @param idx Index of the module, 0 to canmgr_count()-1
+ * @returns Returns the module, or NULL if @c idx is out of range or its
+ * module was removed
+ */
+const canmgr_device_t *canmgr_get(const canmgr_t *mgr, int idx)
+{
+	if (idx < 0 || idx >= mgr->count || mgr->devices[idx].dev == NULL)
+		return (NULL);
+	return (&mgr->devices[idx]);
+} // canmgr_get()
+
+/**
+ * Starts a reader thread for every CANbus module that does not have one, so
+ * each module is drained in parallel and aggregate throughput scales with
+ * the number of modules.
+ * @param mgr The manager to start
+ * @returns Returns 0 on success, -1 if any reader could not be started
+ */
+int canmgr_start(canmgr_t *mgr)
+{
+	int rc = 0;
+
+	for (int i = 0; i < mgr->count; i++)
+	{
+		canmgr_device_t *d = &mgr->devices[i];
+
+		if (d->dev == NULL || d->kind != CANMGR_KIND_CAN || d->reader != NULL)
+			continue;
+		if ((d->reader = canctl_reader_start(d->dev, d->ring)) == NULL)
+			rc = -1;
+	}
+	return (rc);
+} // canmgr_start()
+
+/**
+ * Stops every reader thread. Frames already queued can still be read.
+ * @param mgr The manager to stop
+ */
+void canmgr_stop(canmgr_t *mgr)
+{
+	for (int i = 0; i < mgr->count; i++)
+	{
+		canctl_reader_stop(mgr->devices[i].reader);
+		mgr->devices[i].reader = NULL;
+	}
+} // canmgr_stop()
+
+/**
+ * Moves up to @c want frames out of one module's ring, tagged with its
+ * index.
+ * @param mgr The manager
+ * @param idx Index of the module
+ * @param frames Where to put the frames
+ * @param want Most frames to take
+ * @returns Returns the number of frames taken
+ */
+static size_t canmgr_drain(canmgr_t *mgr, int idx, canmgr_frame_t *frames,
+	size_t want)
+{
+	const canbus_frame_t *span;
+	size_t n = 0, got;
+
+	// Tag the frames straight out of the ring, in up to two spans
+	while (n < want &&
+		(got = canctl_ring_peek(mgr->devices[idx].ring, &span)) > 0)
+	{
+		if (got > want - n)
+			got = want - n;
+		for (size_t j = 0; j < got; j++, n++)
+		{
+			frames[n].src = idx;
+			frames[n].frame = span[j];
+		}
+		canctl_ring_release(mgr->devices[idx].ring, got);
+	}
+	return (n);
+} // canmgr_drain()
+
+/**
+ * Reads from the merged frame stream of every started CANbus module. Waits
+ * up to @c timeout_ms for any module to deliver frames, then drains the
+ * modules round-robin so a busy module can not starve a quiet one: each
+ * module with frames gets an even share of @c frames, and what quiet
+ * modules leave unused goes to the busy ones. Frames from one module stay
+ * in order; frames from different modules are only ordered by their
+ * timestamps. Wakeups for frames an earlier call already took do not end
+ * the wait early. A module whose reader stopped (see canmgr_error()) ends
+ * one wait, then is left out until it is removed.
+ * @param mgr The manager to read from
+ * @param frames Buffer for the tagged frames
+ * @param max Number of elements in @c frames
+ * @param timeout_ms Milliseconds to wait, or negative to wait forever
+ * @returns Returns the number of frames read, 0 on timeout, -1 on error
+ * (errno is ENODEV if no reader was started)
+ */
+int canmgr_read(canmgr_t *mgr, canmgr_frame_t *frames, size_t max,
+	int timeout_ms)
+{
+	struct pollfd pfds[CANMGR_MAX_DEVICES];
+	int polled[CANMGR_MAX_DEVICES]; // Module behind each pfds entry
+	struct timespec now, deadline;
+	uint64_t events;
+	size_t n = 0, share, left;
+	int nfds = 0, nreaders = 0, queued = 0, rc;
+
+	for (int i = 0; i < mgr->count; i++)
+	{
+		if (mgr->devices[i].reader == NULL)
+			continue;
+		nreaders++;
+		if (canctl_ring_count(mgr->devices[i].ring) > 0)
+			queued = 1;
+		// A stopped reader never signals again
+		if (canctl_reader_error(mgr->devices[i].reader) != 0)
+			continue;
+		pfds[nfds].fd = canctl_reader_event_fd(mgr->devices[i].reader);
+		pfds[nfds].events = POLLIN;
+		pfds[nfds].revents = 0;
+		polled[nfds] = i;
+		nfds++;
+	}
+	if (nreaders == 0)
+	{
+		errno = ENODEV;
+		return (-1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	for (;;)
+	{
+		// Frames queued from a previous, partial drain need no sleep, but
+		// still poll so their wakeups are cleared along with them. With
+		// every reader stopped this just sleeps out the timeout.
+		if ((rc = poll(pfds, nfds, queued ? 0 : timeout_ms)) < 0)
+			return (-1);
+		if (rc == 0 && !queued)
+			return (0);
+		for (int i = 0; i < nfds; i++)
+		{
+			// Clear the wakeup. Failure means it was already cleared.
+			if (pfds[i].revents & POLLIN)
+			{
+				ssize_t nbytes = read(pfds[i].fd, &events, sizeof(events));
+				(void)nbytes;
+			}
+		}
+		queued = 0;
+		for (int i = 0; i < mgr->count && !queued; i++)
+		{
+			if (mgr->devices[i].reader != NULL &&
+				canctl_ring_count(mgr->devices[i].ring) > 0)
+				queued = 1; // Frames to drain
+		}
+		for (int i = 0; i < nfds && !queued; i++)
+		{
+			if (canctl_reader_error(mgr->devices[polled[i]].reader) != 0)
+				queued = 1; // A reader stopped during this wait
+		}
+		if (queued)
+			break;
+
+		// A stale wakeup: sleep again for what is left of the timeout
+		if (timeout_ms < 0)
+			continue;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timeout_ms = (deadline.tv_sec - now.tv_sec) * 1000 +
+			(deadline.tv_nsec - now.tv_nsec) / 1000000;
+		if (timeout_ms <= 0)
+			return (0);
+	}
+
+	// First an even share for each module with frames, in turn...
+	left = 0;
+	for (int i = 0; i < mgr->count; i++)
+	{
+		if (mgr->devices[i].reader != NULL &&
+			canctl_ring_count(mgr->devices[i].ring) > 0)
+			left++;
+	}
+	for (int k = 0; k < mgr->count && n < max && left > 0; k++)
+	{
+		int idx = (mgr->next + k) % mgr->count;
+
+		if (mgr->devices[idx].reader == NULL ||
+			canctl_ring_count(mgr->devices[idx].ring) == 0)
+			continue;
+		share = (max - n) / left--;
+		if (share == 0)
+			share = 1;
+		n += canmgr_drain(mgr, idx, &frames[n], share);
+	}
+	// ...then the room quiet modules left goes to the busy ones
+	for (int k = 0; k < mgr->count && n < max; k++)
+	{
+		int idx = (mgr->next + k) % mgr->count;
+
+		if (mgr->devices[idx].reader != NULL)
+			n += canmgr_drain(mgr, idx, &frames[n], max - n);
+	}
+	mgr->next = (mgr->next + 1) % mgr->count;
+	return ((int)n);
+} // canmgr_read()
+
+/**
+ * @param mgr The manager to inspect
+ * @param idx Index of the module
+ * @returns Returns the errno that stopped the module's reader thread, or 0
+ * if it is running (or is not a CANbus module)
+ */
+int canmgr_error(const canmgr_t *mgr, int idx)
+{
+	if (idx < 0 || idx >= mgr->count || mgr->devices[idx].reader == NULL)
+		return (0);
+	return (canctl_reader_error(mgr->devices[idx].reader));
+} // canmgr_error()
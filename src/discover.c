@@ -0,0 +1,249 @@
+/**
+ * @file discover.c
+ * @date 2026-10-16
+ */
+
+#include "discover.h"
+#include "canctl.h" // CANBUS_VID, CANBUS_PID, GPIO_VID, GPIO_PID
+#include <libudev.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+struct discover_monitor
+{
+	struct udev *udev;
+	struct udev_monitor *mon;
+	// Modules seen so far. Remove events carry no parent attributes, so
+	// this is the only way to tell whether a removed node was a module.
+	discover_device_t known[DISCOVER_MAX_DEVICES];
+	int nknown;
+};
+
+/**
+ * Fills in @c out from a hidraw udev device and its hid and usb_device
+ * parents. Only devices whose USB parent carries our vendor and product IDs
+ * are classified as modules.
+ * @param hidraw The hidraw udev device
+ * @param out Where to store the description
+ * @returns Returns 0 on success, -1 if the device has no device node
+ */
+static int discover_describe(struct udev_device *hidraw,
+	discover_device_t *out)
+{
+	struct udev_device *hid, *usb;
+	const char *str;
+	unsigned int bus, vid, pid;
+
+	memset(out, 0, sizeof(*out));
+	if ((str = udev_device_get_devnode(hidraw)) == NULL)
+		return (-1);
+	snprintf(out->devnode, sizeof(out->devnode), "%s", str);
+
+	// Parents belong to the child, so they must not be unref'd
+	hid = udev_device_get_parent_with_subsystem_devtype(hidraw, "hid", NULL);
+	if (hid != NULL)
+	{
+		// HID_ID is "bus:vendor:product" in hex, e.g. 0003:000004D8:0000003F
+		str = udev_device_get_property_value(hid, "HID_ID");
+		if (str != NULL && sscanf(str, "%x:%x:%x", &bus, &vid, &pid) == 3)
+		{
+			out->bustype = bus;
+			out->vendor = vid;
+			out->product = pid;
+		}
+		if ((str = udev_device_get_property_value(hid, "HID_NAME")) != NULL)
+			snprintf(out->name, sizeof(out->name), "%s", str);
+		if ((str = udev_device_get_property_value(hid, "HID_PHYS")) != NULL)
+			snprintf(out->phys, sizeof(out->phys), "%s", str);
+	}
+
+	usb = udev_device_get_parent_with_subsystem_devtype(hidraw, "usb",
+		"usb_device");
+	if (usb == NULL)
+		return (0); // Not a USB HID, so not one of our modules
+	if ((str = udev_device_get_sysattr_value(usb, "idVendor")) != NULL)
+		out->vendor = (uint16_t)strtoul(str, NULL, 16);
+	if ((str = udev_device_get_sysattr_value(usb, "idProduct")) != NULL)
+		out->product = (uint16_t)strtoul(str, NULL, 16);
+
+	if (out->vendor == CANBUS_VID && out->product == CANBUS_PID)
+		out->kind = DISCOVER_KIND_CAN;
+	else if (out->vendor == GPIO_VID && out->product == GPIO_PID)
+		out->kind = DISCOVER_KIND_GPIO;
+	return (0);
+} // discover_describe()
+
+/**
+ * Enumerates the hidraw subsystem through udev. Nothing is opened, so this
+ * never prompts and needs no access to the device nodes themselves.
+ * @param devs Buffer for the devices found
+ * @param max Number of elements in @c devs
+ * @param modules_only If nonzero, only CANbus and GPIO modules are returned
+ * @returns Returns the number of devices found, -1 on error
+ */
+int discover_find(discover_device_t *devs, size_t max, int modules_only)
+{
+	struct udev *udev;
+	struct udev_enumerate *en;
+	struct udev_list_entry *entry;
+	size_t n = 0;
+
+	if ((udev = udev_new()) == NULL)
+		return (-1);
+	if ((en = udev_enumerate_new(udev)) == NULL ||
+		udev_enumerate_add_match_subsystem(en, "hidraw") < 0 ||
+		udev_enumerate_scan_devices(en) < 0)
+	{
+		udev_enumerate_unref(en);
+		udev_unref(udev);
+		errno = EIO;
+		return (-1);
+	}
+
+	udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(en))
+	{
+		struct udev_device *dev;
+
+		if (n >= max)
+			break;
+		dev = udev_device_new_from_syspath(udev,
+			udev_list_entry_get_name(entry));
+		if (dev == NULL)
+			continue;
+		if (discover_describe(dev, &devs[n]) == 0 &&
+			(!modules_only || devs[n].kind != DISCOVER_KIND_OTHER))
+			n++;
+		udev_device_unref(dev);
+	}
+
+	udev_enumerate_unref(en);
+	udev_unref(udev);
+	return ((int)n);
+} // discover_find()
+
+/**
+ * @param kind The kind to convert
+ * @returns Returns a short, human readable name for @c kind
+ */
+const char *discover_kind_to_string(discover_kind_t kind)
+{
+	switch (kind)
+	{
+		case DISCOVER_KIND_CAN:
+			return ("CANBus");
+		case DISCOVER_KIND_GPIO:
+			return ("GPIO");
+		default:
+			return ("Other");
+	}
+} // discover_kind_to_string()
+
+/**
+ * Starts listening for hidraw add and remove events. Modules present right
+ * now are remembered so their removal can be reported later.
+ * @returns Returns the new monitor on success, NULL on error
+ */
+discover_monitor_t *discover_monitor_create(void)
+{
+	discover_monitor_t *mon;
+	int n;
+
+	if ((mon = calloc(1, sizeof(*mon))) == NULL)
+		return (NULL);
+	if ((mon->udev = udev_new()) == NULL ||
+		(mon->mon = udev_monitor_new_from_netlink(mon->udev, "udev")) == NULL ||
+		udev_monitor_filter_add_match_subsystem_devtype(mon->mon, "hidraw",
+			NULL) < 0 ||
+		udev_monitor_enable_receiving(mon->mon) < 0)
+	{
+		discover_monitor_destroy(mon);
+		errno = EIO;
+		return (NULL);
+	}
+	if ((n = discover_find(mon->known, DISCOVER_MAX_DEVICES, 1)) > 0)
+		mon->nknown = n;
+	return (mon);
+} // discover_monitor_create()
+
+/**
+ * @param mon The monitor to inspect
+ * @returns Returns a non-blocking file descriptor that becomes readable when
+ * an event is pending. Watch it with select(), poll() or an evloop_t.
+ */
+int discover_monitor_fd(const discover_monitor_t *mon)
+{
+	return (udev_monitor_get_fd(mon->mon));
+} // discover_monitor_fd()
+
+/**
+ * Receives the next pending module event without blocking. Events for HIDs
+ * that are not CANbus or GPIO modules are consumed and skipped.
+ * @param mon The monitor to read from
+ * @param action Where to store whether the module arrived or left
+ * @param dev Where to store the module's description
+ * @returns Returns 1 if a module event was stored, 0 if no module event was
+ * pending
+ */
+int discover_monitor_read(discover_monitor_t *mon, discover_action_t *action,
+	discover_device_t *dev)
+{
+	struct udev_device *udev_dev;
+	const char *act;
+	int rc = 0;
+
+	// Skip other HIDs' events, so a keyboard plugged in just before a
+	// module does not hold the module's event back until the next wakeup
+	while (rc == 0 &&
+		(udev_dev = udev_monitor_receive_device(mon->mon)) != NULL)
+	{
+		if ((act = udev_device_get_action(udev_dev)) == NULL)
+			act = "";
+
+		if (strcmp(act, "add") == 0)
+		{
+			if (discover_describe(udev_dev, dev) == 0 &&
+				dev->kind != DISCOVER_KIND_OTHER)
+			{
+				if (mon->nknown < DISCOVER_MAX_DEVICES)
+					mon->known[mon->nknown++] = *dev;
+				*action = DISCOVER_ACTION_ADD;
+				rc = 1;
+			}
+		}
+		else if (strcmp(act, "remove") == 0 &&
+			udev_device_get_devnode(udev_dev) != NULL)
+		{
+			for (int i = 0; i < mon->nknown; i++)
+			{
+				if (strcmp(mon->known[i].devnode,
+					udev_device_get_devnode(udev_dev)) != 0)
+					continue;
+				*dev = mon->known[i];
+				mon->known[i] = mon->known[--mon->nknown];
+				*action = DISCOVER_ACTION_REMOVE;
+				rc = 1;
+				break;
+			}
+		}
+
+		udev_device_unref(udev_dev);
+	}
+	return (rc);
+} // discover_monitor_read()
+
+/**
+ * Stops listening and frees the monitor.
+ * @param mon The monitor to destroy, may be NULL
+ */
+void discover_monitor_destroy(discover_monitor_t *mon)
+{
+	if (mon == NULL)
+		return;
+	if (mon->mon != NULL)
+		udev_monitor_unref(mon->mon);
+	if (mon->udev != NULL)
+		udev_unref(mon->udev);
+	free(mon);
+} // discover_monitor_destroy()
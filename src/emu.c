@@ -0,0 +1,546 @@
+/**
+ * @file emu.c
+ * @date 2026-10-16
+ */
+
+#define _GNU_SOURCE // ppoll()
+#include "emu.h"
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+struct emu
+{
+	emu_opts_t opts;
+	pthread_t thread;
+	int fd; // The module's end of the socketpair
+	int efd; // eventfd that wakes the thread for injected frames and stop
+	int stop;
+	pthread_mutex_t lock; // Guards everything below
+
+	// Module state
+	canbus_cfg_t cfg;
+	unsigned int speed;
+	canbus_led_t led;
+	unsigned char estate[CANBUS_ERROR_STATE_SIZE];
+	unsigned char pin_types[GPIO_PIN_COUNT]; // 0 = output, 1 = input
+	unsigned char pin_latch[GPIO_PIN_COUNT]; // Last data written
+	uint8_t inputs; // Levels on the input pins, bit 0 is pin 1
+	emu_stats_t stats;
+
+	// Reports waiting to be sent, oldest at q_tail. Due times never
+	// decrease, so the queue is sent strictly in order.
+	struct
+	{
+		uint64_t due_ns;
+		unsigned char buf[CANBUS_MSG_SIZE];
+	} q[EMU_QUEUE_SIZE];
+	size_t q_head, q_tail;
+	uint64_t tx_free_ns; // When the link to the host is next idle
+	uint64_t rx_free_ns; // When the link from the host is next idle
+};
+
+/**
+ * @returns Returns the CLOCK_MONOTONIC time in nanoseconds
+ */
+static uint64_t emu_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+} // emu_now_ns()
+
+/**
+ * @param emu The emulator
+ * @returns Returns how long one report occupies the link, 0 if unlimited
+ */
+static uint64_t emu_report_ns(const emu_t *emu)
+{
+	if (emu->opts.bandwidth == 0)
+		return (0);
+	// Interrupt transfers always move the whole report
+	return (CANBUS_MSG_SIZE * 1000000000ULL / emu->opts.bandwidth);
+} // emu_report_ns()
+
+/**
+ * Queues a report for the host. It goes out @c opts.latency_us from now,
+ * or later if the link is still busy with earlier reports. Must be called
+ * with @c emu->lock held.
+ * @param emu The emulator
+ * @param buf The report, padded to CANBUS_MSG_SIZE bytes
+ * @param len Number of valid bytes in @c buf
+ * @returns Returns 0 on success, -1 if the queue is full
+ */
+static int emu_queue(emu_t *emu, const unsigned char *buf, size_t len)
+{
+	size_t idx;
+	uint64_t ready;
+
+	if (emu->q_head - emu->q_tail >= EMU_QUEUE_SIZE)
+	{
+		emu->stats.overruns++;
+		return (-1);
+	}
+	ready = emu_now_ns() + emu->opts.latency_us * 1000ULL;
+	if (emu->tx_free_ns < ready)
+		emu->tx_free_ns = ready;
+	emu->tx_free_ns += emu_report_ns(emu);
+
+	idx = emu->q_head % EMU_QUEUE_SIZE;
+	memset(emu->q[idx].buf, 0, CANBUS_MSG_SIZE);
+	memcpy(emu->q[idx].buf, buf, len);
+	emu->q[idx].due_ns = emu->tx_free_ns;
+	emu->q_head++;
+	return (0);
+} // emu_queue()
+
+/**
+ * Queues a reply made of a report ID and up to CANBUS_MSG_SIZE - 1 bytes.
+ * Must be called with @c emu->lock held.
+ */
+static void emu_reply(emu_t *emu, unsigned char id, const unsigned char *data,
+	size_t len)
+{
+	unsigned char buf[CANBUS_MSG_SIZE];
+
+	buf[0] = id;
+	memcpy(&buf[1], data, len);
+	emu_queue(emu, buf, len + 1);
+} // emu_reply()
+
+/**
+ * Puts frames on the emulated bus, or back to the host in loopback mode.
+ * Must be called with @c emu->lock held.
+ */
+static void emu_can_send(emu_t *emu, const unsigned char *buf, size_t len)
+{
+	canbus_frame_t frames[CANBUS_FRAMES_PER_REPORT];
+	unsigned char out[CANBUS_MSG_SIZE];
+	int n, outlen;
+
+	if ((n = canctl_decode_report(buf, len, frames,
+		CANBUS_FRAMES_PER_REPORT, NULL)) <= 0)
+		return; // The firmware ignores bad reports too
+
+	switch (emu->cfg)
+	{
+		case CANBUS_CFG_NORMAL:
+			emu->stats.frames_sent += n;
+			break;
+		case CANBUS_CFG_LOOPBACK:
+			if ((outlen = canctl_encode_frames(out, sizeof(out), frames,
+				n)) > 0 && emu_queue(emu, out, outlen) == 0)
+				emu->stats.frames_looped += n;
+			break;
+		default:
+			break; // Not allowed to transmit in this mode
+	}
+} // emu_can_send()
+
+/**
+ * Handles one report from the host as the CANbus module's firmware would.
+ * Must be called with @c emu->lock held.
+ */
+static void emu_can_command(emu_t *emu, unsigned char *buf, size_t len)
+{
+	unsigned char data[CANBUS_MSG_SIZE];
+
+	switch (buf[0])
+	{
+		case CANBUS_OUT_SEND_DATA:
+			emu_can_send(emu, buf, len);
+			break;
+		case CANBUS_OUT_FW_VERSION:
+			emu_reply(emu, CANBUS_IN_FW_VERSION, emu->opts.fw,
+				CANBUS_FIRMWARE_SIZE);
+			break;
+		case CANBUS_OUT_GET_CONFIG:
+			data[0] = emu->cfg;
+			emu_reply(emu, CANBUS_IN_GET_CONFIG, data, 1);
+			break;
+		case CANBUS_OUT_SET_CONFIG:
+			if (len >= 2 && buf[1] < CANBUS_CFG_UNKNOWN &&
+				buf[1] != CANBUS_CFG_RESERVED_1 &&
+				buf[1] != CANBUS_CFG_RESERVED_2)
+			{
+				emu->cfg = buf[1];
+				if (emu->cfg == CANBUS_CFG_CONFIGURATION && len >= 6)
+					emu->speed = (unsigned int)buf[2] << 24 |
+						buf[3] << 16 | buf[4] << 8 | buf[5];
+				// Configuration mode resets the controller, bus-off and
+				// error counters included
+				if (emu->cfg == CANBUS_CFG_CONFIGURATION)
+					memset(emu->estate, 0, sizeof(emu->estate));
+			}
+			data[0] = emu->cfg;
+			emu_reply(emu, CANBUS_IN_SET_CONFIG, data, 1);
+			break;
+		case CANBUS_OUT_ERROR_STATUS:
+			emu_reply(emu, CANBUS_IN_ERROR_STATUS, emu->estate,
+				CANBUS_ERROR_STATE_SIZE);
+			break;
+		case CANBUS_OUT_USB_TEST:
+			emu_queue(emu, buf, len);
+			break;
+		case CANBUS_OUT_LED_OFF:
+		case CANBUS_OUT_LED_ON:
+		case CANBUS_OUT_LED_NORMAL:
+			emu->led = buf[0] == CANBUS_OUT_LED_OFF ? CANBUS_LED_OFF :
+				buf[0] == CANBUS_OUT_LED_ON ? CANBUS_LED_ON :
+				CANBUS_LED_NORMAL;
+			emu_reply(emu, buf[0], data, 0);
+			break;
+		default:
+			break; // Unknown commands get no reply
+	}
+} // emu_can_command()
+
+/**
+ * Handles one report from the host as the GPIO module's firmware would.
+ * Must be called with @c emu->lock held.
+ */
+static void emu_gpio_command(emu_t *emu, unsigned char *buf, size_t len)
+{
+	unsigned char data[GPIO_PIN_COUNT + 1];
+
+	switch (buf[0])
+	{
+		case CANBUS_OUT_FW_VERSION:
+			emu_reply(emu, CANBUS_IN_FW_VERSION, emu->opts.fw,
+				CANBUS_FIRMWARE_SIZE);
+			break;
+		case GPIO_OUT_READ_PIN_TYPE: // Also GPIO_OUT_SET_PIN_TYPE
+			if (len >= 2 + GPIO_PIN_COUNT && buf[1] == GPIO_SET_PIN_TYPE_CMD)
+			{
+				memcpy(emu->pin_types, &buf[2], GPIO_PIN_COUNT);
+				data[0] = GPIO_SET_PIN_TYPE_RESPONSE;
+				emu_reply(emu, GPIO_IN_SET_PIN_TYPE, data, 1);
+			}
+			else if (len >= 2 && buf[1] == GPIO_READ_PIN_TYPE_CMD)
+			{
+				data[0] = GPIO_READ_PIN_TYPE_RESPONSE;
+				memcpy(&data[1], emu->pin_types, GPIO_PIN_COUNT);
+				emu_reply(emu, GPIO_IN_READ_PIN_TYPE, data,
+					GPIO_PIN_COUNT + 1);
+			}
+			break;
+		case GPIO_OUT_READ_PIN_DATA: // Also GPIO_OUT_SET_PIN_DATA
+			if (len >= 2 + GPIO_PIN_COUNT && buf[1] == GPIO_SET_PIN_DATA_CMD)
+			{
+				memcpy(emu->pin_latch, &buf[2], GPIO_PIN_COUNT);
+				data[0] = GPIO_SET_PIN_DATA_RESPONSE;
+				emu_reply(emu, GPIO_IN_SET_PIN_DATA, data, 1);
+			}
+			else if (len >= 2 && buf[1] == GPIO_READ_PIN_DATA_CMD)
+			{
+				// Outputs read back their latch, inputs the pin level
+				data[0] = GPIO_READ_PIN_DATA_CMD;
+				for (int i = 0; i < GPIO_PIN_COUNT; i++)
+					data[i + 1] = emu->pin_types[i] ?
+						(emu->inputs >> i) & 1 : emu->pin_latch[i] != 0;
+				emu_reply(emu, GPIO_IN_READ_PIN_DATA, data,
+					GPIO_PIN_COUNT + 1);
+			}
+			break;
+		case GPIO_OUT_GET_BOARD_ID:
+			emu_reply(emu, GPIO_IN_GET_BOARD_ID, &emu->opts.board_id, 1);
+			break;
+		case GPIO_OUT_GET_IOM_SKU:
+			emu_reply(emu, GPIO_IN_GET_IOM_SKU, &emu->opts.sku, 1);
+			break;
+		default:
+			break; // Unknown commands get no reply
+	}
+} // emu_gpio_command()
+
+/**
+ * Sends the queued reports that are due. Like hidraw, reports the host has
+ * no room for are dropped rather than held back. Must be called with
+ * @c emu->lock held.
+ * @param emu The emulator
+ * @param now Current time from emu_now_ns()
+ * @returns Returns 0 on success, -1 if the host end was closed
+ */
+static int emu_flush(emu_t *emu, uint64_t now)
+{
+	while (emu->q_tail != emu->q_head)
+	{
+		size_t idx = emu->q_tail % EMU_QUEUE_SIZE;
+
+		if (emu->q[idx].due_ns > now)
+			break;
+		if (send(emu->fd, emu->q[idx].buf, CANBUS_MSG_SIZE,
+			MSG_DONTWAIT|MSG_NOSIGNAL) >= 0)
+			emu->stats.reports_out++;
+		else if (errno == EAGAIN)
+			emu->stats.overruns++; // The host is not reading
+		else
+			return (-1);
+		emu->q_tail++;
+	}
+	return (0);
+} // emu_flush()
+
+/**
+ * Emulator thread: reads commands when the link from the host is free and
+ * the reply queue has room, and sends replies as they fall due.
+ */
+static void *emu_thread(void *arg)
+{
+	emu_t *emu = arg;
+	unsigned char buf[CANBUS_MSG_SIZE];
+	struct pollfd pfd[2];
+	struct timespec ts, *tsp;
+	uint64_t now, wake, events;
+	ssize_t nbytes;
+
+	pfd[1].fd = emu->efd;
+	pfd[1].events = POLLIN;
+	pthread_mutex_lock(&emu->lock);
+	while (!emu->stop)
+	{
+		now = emu_now_ns();
+		if (emu_flush(emu, now) < 0)
+			break; // The host went away
+
+		// Sleep until the next report is due or the next command may be
+		// read, whichever comes first
+		wake = UINT64_MAX;
+		pfd[0].fd = emu->fd;
+		pfd[0].events = 0;
+		if (emu->q_tail != emu->q_head)
+			wake = emu->q[emu->q_tail % EMU_QUEUE_SIZE].due_ns;
+		if (emu->q_head - emu->q_tail < EMU_QUEUE_SIZE)
+		{
+			if (emu->rx_free_ns <= now)
+				pfd[0].events |= POLLIN;
+			else if (emu->rx_free_ns < wake)
+				wake = emu->rx_free_ns;
+		}
+		tsp = NULL;
+		if (wake != UINT64_MAX)
+		{
+			wake = wake > now ? wake - now : 0;
+			ts.tv_sec = wake / 1000000000ULL;
+			ts.tv_nsec = wake % 1000000000ULL;
+			tsp = &ts;
+		}
+		pthread_mutex_unlock(&emu->lock);
+
+		if (ppoll(pfd, 2, tsp, NULL) < 0 && errno != EINTR)
+		{
+			pthread_mutex_lock(&emu->lock);
+			break;
+		}
+		if (pfd[1].revents & POLLIN)
+			if (read(emu->efd, &events, sizeof(events)) < 0)
+				events = 0; // Already cleared
+		nbytes = 0;
+		if (pfd[0].revents & POLLIN)
+			nbytes = recv(emu->fd, buf, sizeof(buf), MSG_DONTWAIT);
+
+		pthread_mutex_lock(&emu->lock);
+		if (pfd[0].revents & POLLIN)
+		{
+			if (nbytes == 0 || (nbytes < 0 && errno != EAGAIN))
+				break; // The host end was closed
+			if (nbytes > 0)
+			{
+				now = emu_now_ns();
+				if (emu->rx_free_ns < now)
+					emu->rx_free_ns = now;
+				emu->rx_free_ns += emu_report_ns(emu);
+				emu->stats.reports_in++;
+				if (emu->opts.kind == EMU_KIND_GPIO)
+					emu_gpio_command(emu, buf, nbytes);
+				else
+					emu_can_command(emu, buf, nbytes);
+			}
+		}
+		else if (pfd[0].revents & (POLLHUP|POLLERR))
+			break;
+	}
+	pthread_mutex_unlock(&emu->lock);
+	return (NULL);
+} // emu_thread()
+
+/**
+ * Starts an emulated module.
+ * @param opts The module's settings
+ * @param fd Set to the host's end of the link, to be given to
+ * canctl_attach(). Closing it makes the module go away like an unplug.
+ * @returns Returns the emulator on success, NULL on error
+ */
+emu_t *emu_start(const emu_opts_t *opts, int *fd)
+{
+	emu_t *emu;
+	int sv[2];
+
+	if (opts == NULL || fd == NULL)
+		return (NULL); // @todo Return a better error indicator
+	if ((emu = calloc(1, sizeof(*emu))) == NULL)
+		return (NULL);
+	emu->opts = *opts;
+	emu->cfg = CANBUS_CFG_NORMAL;
+	emu->led = CANBUS_LED_NORMAL;
+	memset(emu->pin_types, 1, sizeof(emu->pin_types)); // Inputs at reset
+	pthread_mutex_init(&emu->lock, NULL);
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, sv) < 0)
+		goto err;
+	emu->fd = sv[1];
+	if ((emu->efd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK)) < 0)
+		goto err_socket;
+	if (pthread_create(&emu->thread, NULL, emu_thread, emu) != 0)
+		goto err_eventfd;
+
+	// Like hidraw, the host side does not block
+	fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+	*fd = sv[0];
+	return (emu);
+
+err_eventfd:
+	close(emu->efd);
+err_socket:
+	close(sv[0]);
+	close(sv[1]);
+err:
+	pthread_mutex_destroy(&emu->lock);
+	free(emu);
+	return (NULL);
+} // emu_start()
+
+/**
+ * Wakes the emulator thread.
+ * @param emu The emulator
+ */
+static void emu_wake(emu_t *emu)
+{
+	uint64_t one = 1;
+
+	if (write(emu->efd, &one, sizeof(one)) < 0)
+		return; // The counter is already nonzero
+} // emu_wake()
+
+/**
+ * Stops the emulator thread and frees the emulator. The host's end of the
+ * link is not closed.
+ * @param emu The emulator to stop, may be NULL
+ */
+void emu_stop(emu_t *emu)
+{
+	if (emu == NULL)
+		return;
+	pthread_mutex_lock(&emu->lock);
+	emu->stop = 1;
+	pthread_mutex_unlock(&emu->lock);
+	emu_wake(emu);
+	pthread_join(emu->thread, NULL);
+
+	close(emu->efd);
+	close(emu->fd);
+	pthread_mutex_destroy(&emu->lock);
+	free(emu);
+} // emu_stop()
+
+/**
+ * Puts frames on the emulated bus. The CANbus module passes them to the
+ * host in CANBUS_IN_RECV_DATA reports if it is in normal or a listen mode.
+ * @param emu The CANbus emulator
+ * @param frames The frames
+ * @param n Number of frames in @c frames
+ * @returns Returns the number of frames the module accepted, -1 on error
+ */
+int emu_inject(emu_t *emu, const canbus_frame_t *frames, size_t n)
+{
+	unsigned char buf[CANBUS_MSG_SIZE];
+	size_t done = 0;
+	int len;
+
+	if (emu == NULL || frames == NULL || emu->opts.kind != EMU_KIND_CAN)
+		return (-1); // @todo Return a better error indicator
+
+	pthread_mutex_lock(&emu->lock);
+	if (emu->cfg == CANBUS_CFG_NORMAL || emu->cfg == CANBUS_CFG_LISTEN_ONLY ||
+		emu->cfg == CANBUS_CFG_LISTEN_ALL_MESSAGE)
+	{
+		while (done < n)
+		{
+			size_t batch = n - done;
+
+			if (batch > CANBUS_FRAMES_PER_REPORT)
+				batch = CANBUS_FRAMES_PER_REPORT;
+			if ((len = canctl_encode_frames(buf, sizeof(buf), &frames[done],
+				batch)) < 0 || emu_queue(emu, buf, len) < 0)
+				break;
+			done += batch;
+		}
+	}
+	pthread_mutex_unlock(&emu->lock);
+	emu_wake(emu);
+	return ((int)done);
+} // emu_inject()
+
+/**
+ * Sets what the CANbus module reports to CANBUS_OUT_ERROR_STATUS.
+ * @param emu The CANbus emulator
+ * @param tx_errors Tx error count
+ * @param rx_errors Rx error count
+ * @param flags canbus_estate_flags_t bits
+ */
+void emu_set_error_state(emu_t *emu, unsigned char tx_errors,
+	unsigned char rx_errors, unsigned char flags)
+{
+	pthread_mutex_lock(&emu->lock);
+	emu->estate[0] = tx_errors;
+	emu->estate[1] = rx_errors;
+	emu->estate[2] = flags;
+	pthread_mutex_unlock(&emu->lock);
+} // emu_set_error_state()
+
+/**
+ * Sets the levels on the GPIO module's pins. Only pins configured as inputs
+ * read back these levels.
+ * @param emu The GPIO emulator
+ * @param levels One bit per pin, bit 0 is pin 1
+ */
+void emu_set_inputs(emu_t *emu, uint8_t levels)
+{
+	pthread_mutex_lock(&emu->lock);
+	emu->inputs = levels;
+	pthread_mutex_unlock(&emu->lock);
+} // emu_set_inputs()
+
+/**
+ * @param emu The GPIO emulator
+ * @returns Returns the levels driven on the output pins, one bit per pin
+ * with bit 0 for pin 1. Input pins read as 0.
+ */
+uint8_t emu_get_outputs(emu_t *emu)
+{
+	uint8_t levels = 0;
+
+	pthread_mutex_lock(&emu->lock);
+	for (int i = 0; i < GPIO_PIN_COUNT; i++)
+		if (emu->pin_types[i] == 0 && emu->pin_latch[i] != 0)
+			levels |= 1u << i;
+	pthread_mutex_unlock(&emu->lock);
+	return (levels);
+} // emu_get_outputs()
+
+/**
+ * @param emu The emulator
+ * @param stats Filled with a snapshot of the emulator's counters
+ */
+void emu_get_stats(emu_t *emu, emu_stats_t *stats)
+{
+	pthread_mutex_lock(&emu->lock);
+	*stats = emu->stats;
+	pthread_mutex_unlock(&emu->lock);
+} // emu_get_stats()
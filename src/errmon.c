@@ -0,0 +1,341 @@
+/**
+ * @file errmon.c
+ * @date 2026-10-16
+ */
+
+#include "errmon.h"
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+struct errmon
+{
+	canctl_dev_t *dev;
+	errmon_opts_t opts;
+	errmon_event_cb cb;
+	void *cb_arg;
+	pthread_t thread;
+	int efd; // eventfd that stops the thread
+	pthread_mutex_t recover_lock; // One configuration mode cycle at a time
+
+	pthread_mutex_t lock; // Guards everything below
+	int have_sample;
+	errmon_sample_t sample; // Latest good sample
+	int counters_reset; // Recovered since, so no rates from the last sample
+	struct timespec last_recover; // CLOCK_MONOTONIC, zero if never
+	errmon_stats_t stats;
+};
+
+/**
+ * @param flags canbus_estate_flags_t bits from canctl_get_error_state()
+ * @returns Returns the worst level the flags show
+ */
+errmon_level_t errmon_level_from_flags(unsigned char flags)
+{
+	if (flags & CANBUS_ESTATE_TX_OFF)
+		return (ERRMON_LEVEL_BUS_OFF);
+	if (flags & (CANBUS_ESTATE_RX_PASSIVE|CANBUS_ESTATE_TX_PASSIVE))
+		return (ERRMON_LEVEL_PASSIVE);
+	if (flags & (CANBUS_ESTATE_TXRX_WARN|CANBUS_ESTATE_RX_WARN|
+		CANBUS_ESTATE_TX_WARN))
+		return (ERRMON_LEVEL_WARNING);
+	return (ERRMON_LEVEL_ACTIVE);
+} // errmon_level_from_flags()
+
+/**
+ * @param level An error level
+ * @returns Returns the level in words
+ */
+const char *errmon_level_to_string(errmon_level_t level)
+{
+	switch (level)
+	{
+		case ERRMON_LEVEL_ACTIVE: return ("error active");
+		case ERRMON_LEVEL_WARNING: return ("warning");
+		case ERRMON_LEVEL_PASSIVE: return ("error passive");
+		case ERRMON_LEVEL_BUS_OFF: return ("bus-off");
+		default: return ("unknown");
+	}
+} // errmon_level_to_string()
+
+/**
+ * @returns Returns @c a - @c b in milliseconds
+ */
+static long long errmon_diff_ms(const struct timespec *a,
+	const struct timespec *b)
+{
+	return ((long long)(a->tv_sec - b->tv_sec) * 1000 +
+		(a->tv_nsec - b->tv_nsec) / 1000000);
+} // errmon_diff_ms()
+
+/**
+ * Passes an event to the callback, if there is one.
+ */
+static void errmon_notify(errmon_t *mon, errmon_event_type_t type,
+	errmon_level_t old_level, const errmon_sample_t *sample, int err)
+{
+	errmon_event_t event;
+
+	if (mon->cb == NULL)
+		return;
+	memset(&event, 0, sizeof(event));
+	event.type = type;
+	event.old_level = old_level;
+	if (sample != NULL)
+		event.sample = *sample;
+	else
+		event.sample.level = ERRMON_LEVEL_UNKNOWN;
+	event.err = err;
+	mon->cb(mon, &event, mon->cb_arg);
+} // errmon_notify()
+
+/**
+ * Reads the module's error state and raises an event if its level changed.
+ * @param mon The monitor
+ * @param sample Set to the new sample
+ * @returns Returns 0 on success, -1 on error
+ */
+static int errmon_sample(errmon_t *mon, errmon_sample_t *sample)
+{
+	unsigned char estate[CANBUS_ERROR_STATE_SIZE];
+	errmon_sample_t prev;
+	int have_prev, err;
+	double dt;
+
+	if (canctl_get_error_state(mon->dev, estate) < 0)
+	{
+		err = errno;
+		pthread_mutex_lock(&mon->lock);
+		mon->stats.sample_failures++;
+		have_prev = mon->have_sample;
+		prev = mon->sample;
+		pthread_mutex_unlock(&mon->lock);
+		errmon_notify(mon, ERRMON_EVENT_SAMPLE_FAILED, ERRMON_LEVEL_UNKNOWN,
+			have_prev ? &prev : NULL, err);
+		errno = err;
+		return (-1);
+	}
+
+	memset(sample, 0, sizeof(*sample));
+	clock_gettime(CLOCK_MONOTONIC, &sample->ts);
+	sample->tx_errors = estate[0];
+	sample->rx_errors = estate[1];
+	sample->flags = estate[2];
+	sample->level = errmon_level_from_flags(estate[2]);
+
+	pthread_mutex_lock(&mon->lock);
+	have_prev = mon->have_sample;
+	prev = mon->sample;
+	dt = (sample->ts.tv_sec - prev.ts.tv_sec) +
+		(sample->ts.tv_nsec - prev.ts.tv_nsec) / 1e9;
+	if (have_prev && !mon->counters_reset && dt > 0)
+	{
+		// The counters also go down as frames get through, so a rate can
+		// be negative
+		sample->tx_rate = (sample->tx_errors - prev.tx_errors) / dt;
+		sample->rx_rate = (sample->rx_errors - prev.rx_errors) / dt;
+	}
+	mon->sample = *sample;
+	mon->have_sample = 1;
+	mon->counters_reset = 0;
+	mon->stats.samples++;
+	if (have_prev && prev.level != sample->level)
+		mon->stats.transitions++;
+	if (sample->level == ERRMON_LEVEL_BUS_OFF &&
+		(!have_prev || prev.level != ERRMON_LEVEL_BUS_OFF))
+		mon->stats.bus_offs++;
+	pthread_mutex_unlock(&mon->lock);
+
+	// The first sample counts as a change only if it is bad news
+	if (have_prev ? prev.level != sample->level :
+		sample->level != ERRMON_LEVEL_ACTIVE)
+		errmon_notify(mon, ERRMON_EVENT_LEVEL, have_prev ? prev.level :
+			ERRMON_LEVEL_UNKNOWN, sample, 0);
+	return (0);
+} // errmon_sample()
+
+/**
+ * Recovers the module from bus-off by putting it in configuration mode,
+ * which resets its controller, and then back in the mode it was last set
+ * to. Needs the module to have been configured through this handle, since
+ * configuration mode takes the bus speed. Safe to call while the monitor
+ * runs.
+ * @param mon The monitor
+ * @returns Returns 0 on success, -1 on error (errno is ENODATA if the
+ * module's configuration is not known)
+ */
+int errmon_recover(errmon_t *mon)
+{
+	canbus_cfg_t cfg;
+	unsigned int speed;
+	int rc = -1;
+
+	if (mon == NULL)
+		return (-1); // @todo Return a better error indicator
+	pthread_mutex_lock(&mon->recover_lock);
+	if (canctl_get_last_config(mon->dev, &cfg, &speed) < 0)
+		errno = ENODATA;
+	else if (canctl_set_config(mon->dev, CANBUS_CFG_CONFIGURATION,
+		speed) == 0 && (cfg == CANBUS_CFG_CONFIGURATION ||
+		canctl_set_config(mon->dev, cfg, speed) == 0))
+		rc = 0;
+	pthread_mutex_unlock(&mon->recover_lock);
+
+	pthread_mutex_lock(&mon->lock);
+	clock_gettime(CLOCK_MONOTONIC, &mon->last_recover);
+	if (rc == 0)
+	{
+		mon->stats.recoveries++;
+		mon->counters_reset = 1;
+	}
+	else
+		mon->stats.recover_failures++;
+	pthread_mutex_unlock(&mon->lock);
+	return (rc);
+} // errmon_recover()
+
+/**
+ * Monitor thread: samples every interval, recovering from bus-off if asked.
+ * @param arg The monitor
+ * @returns Returns NULL
+ */
+static void *errmon_thread(void *arg)
+{
+	errmon_t *mon = arg;
+	struct pollfd pfd = { .fd = mon->efd, .events = POLLIN };
+	struct timespec now, last_recover;
+	errmon_sample_t sample;
+	int rc;
+
+	for (;;)
+	{
+		if (errmon_sample(mon, &sample) == 0 && mon->opts.auto_recover &&
+			sample.level == ERRMON_LEVEL_BUS_OFF)
+		{
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			pthread_mutex_lock(&mon->lock);
+			last_recover = mon->last_recover;
+			pthread_mutex_unlock(&mon->lock);
+
+			// Don't keep knocking a module off a bus that is still broken
+			if ((last_recover.tv_sec == 0 && last_recover.tv_nsec == 0) ||
+				errmon_diff_ms(&now, &last_recover) >=
+				mon->opts.recover_holdoff_ms)
+			{
+				errmon_notify(mon, ERRMON_EVENT_RECOVERING,
+					ERRMON_LEVEL_UNKNOWN, &sample, 0);
+				if (errmon_recover(mon) < 0)
+					errmon_notify(mon, ERRMON_EVENT_RECOVER_FAILED,
+						ERRMON_LEVEL_UNKNOWN, &sample, errno);
+				else
+					continue; // See how it went right away
+			}
+		}
+		if ((rc = poll(&pfd, 1, mon->opts.interval_ms)) < 0 && errno != EINTR)
+			break;
+		if (rc > 0)
+			break; // Stopped
+	}
+	return (NULL);
+} // errmon_thread()
+
+/**
+ * Starts monitoring a CANbus module's error state.
+ * @param dev The CANbus module's handle. The monitor does not own it.
+ * @param opts The monitor's settings, NULL for the defaults
+ * @param cb Called from the monitor's thread for each event, may be NULL
+ * @param arg Passed to @c cb
+ * @returns Returns the new monitor on success, NULL on error
+ */
+errmon_t *errmon_start(canctl_dev_t *dev, const errmon_opts_t *opts,
+	errmon_event_cb cb, void *arg)
+{
+	errmon_t *mon;
+
+	if (dev == NULL)
+		return (NULL); // @todo Return a better error indicator
+	if ((mon = calloc(1, sizeof(*mon))) == NULL)
+		return (NULL);
+	mon->dev = dev;
+	if (opts != NULL)
+		mon->opts = *opts;
+	if (mon->opts.interval_ms <= 0)
+		mon->opts.interval_ms = ERRMON_INTERVAL_MS;
+	if (mon->opts.recover_holdoff_ms <= 0)
+		mon->opts.recover_holdoff_ms = ERRMON_RECOVER_HOLDOFF_MS;
+	mon->cb = cb;
+	mon->cb_arg = arg;
+	mon->sample.level = ERRMON_LEVEL_UNKNOWN;
+	pthread_mutex_init(&mon->lock, NULL);
+	pthread_mutex_init(&mon->recover_lock, NULL);
+
+	if ((mon->efd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK)) < 0)
+		goto err;
+	if (pthread_create(&mon->thread, NULL, errmon_thread, mon) != 0)
+	{
+		close(mon->efd);
+		goto err;
+	}
+	return (mon);
+
+err:
+	pthread_mutex_destroy(&mon->recover_lock);
+	pthread_mutex_destroy(&mon->lock);
+	free(mon);
+	return (NULL);
+} // errmon_start()
+
+/**
+ * Stops the monitor and frees it. Waits for a sample or recovery in
+ * progress to finish.
+ * @param mon The monitor to stop, may be NULL
+ */
+void errmon_stop(errmon_t *mon)
+{
+	uint64_t one = 1;
+
+	if (mon == NULL)
+		return;
+	if (write(mon->efd, &one, sizeof(one)) < 0)
+		perror("errmon: eventfd");
+	pthread_join(mon->thread, NULL);
+	close(mon->efd);
+	pthread_mutex_destroy(&mon->recover_lock);
+	pthread_mutex_destroy(&mon->lock);
+	free(mon);
+} // errmon_stop()
+
+/**
+ * Gets the latest good sample.
+ * @param mon The monitor
+ * @param sample Set to the sample
+ * @returns Returns 0 on success, -1 if nothing was sampled yet
+ */
+int errmon_get_sample(errmon_t *mon, errmon_sample_t *sample)
+{
+	int rc;
+
+	pthread_mutex_lock(&mon->lock);
+	*sample = mon->sample;
+	rc = mon->have_sample ? 0 : -1;
+	pthread_mutex_unlock(&mon->lock);
+	return (rc);
+} // errmon_get_sample()
+
+/**
+ * Gets the monitor's counters.
+ * @param mon The monitor
+ * @param stats Set to the counters
+ */
+void errmon_get_stats(errmon_t *mon, errmon_stats_t *stats)
+{
+	pthread_mutex_lock(&mon->lock);
+	*stats = mon->stats;
+	pthread_mutex_unlock(&mon->lock);
+} // errmon_get_stats()
@@ -0,0 +1,270 @@
+/**
+ * @file evloop.c
+ * @date 2026-10-16
+ */
+
+#include "evloop.h"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+/**
+ * One registered file descriptor or timer. The epoll_event registered for
+ * it carries a pointer to this slot, so dispatch needs no lookup.
+ */
+typedef struct evloop_handler
+{
+	int fd; // Watched fd, or the timerfd for timers
+	int used;
+	int is_timer;
+	evloop_fd_cb fd_cb;
+	evloop_timer_cb timer_cb;
+	void *arg;
+} evloop_handler_t;
+
+struct evloop
+{
+	int epfd;
+	int stop;
+	evloop_handler_t handlers[EVLOOP_MAX_HANDLERS];
+};
+
+/**
+ * Creates an empty event loop.
+ * @returns Returns the new loop on success, NULL on error
+ */
+evloop_t *evloop_create(void)
+{
+	evloop_t *loop;
+
+	if ((loop = calloc(1, sizeof(*loop))) == NULL)
+		return (NULL);
+	if ((loop->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	{
+		free(loop);
+		return (NULL);
+	}
+	return (loop);
+} // evloop_create()
+
+/**
+ * Destroys a loop. Timers are closed; watched fds are left open since they
+ * belong to the caller.
+ * @param loop The loop to destroy, may be NULL
+ */
+void evloop_destroy(evloop_t *loop)
+{
+	if (loop == NULL)
+		return;
+	for (int i = 0; i < EVLOOP_MAX_HANDLERS; i++)
+		if (loop->handlers[i].used && loop->handlers[i].is_timer)
+			close(loop->handlers[i].fd);
+	close(loop->epfd);
+	free(loop);
+} // evloop_destroy()
+
+/**
+ * Registers a handler slot with epoll.
+ * @returns Returns the slot on success, NULL on error
+ */
+static evloop_handler_t *evloop_add(evloop_t *loop, int fd, uint32_t events)
+{
+	struct epoll_event ev;
+	evloop_handler_t *h = NULL;
+
+	for (int i = 0; i < EVLOOP_MAX_HANDLERS && h == NULL; i++)
+		if (!loop->handlers[i].used)
+			h = &loop->handlers[i];
+	if (h == NULL)
+	{
+		errno = ENOSPC;
+		return (NULL);
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = h;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		return (NULL);
+
+	memset(h, 0, sizeof(*h));
+	h->fd = fd;
+	h->used = 1;
+	return (h);
+} // evloop_add()
+
+/**
+ * Finds the slot watching @c fd.
+ * @returns Returns the slot, or NULL if @c fd is not watched
+ */
+static evloop_handler_t *evloop_find(evloop_t *loop, int fd, int is_timer)
+{
+	for (int i = 0; i < EVLOOP_MAX_HANDLERS; i++)
+		if (loop->handlers[i].used && loop->handlers[i].fd == fd &&
+			loop->handlers[i].is_timer == is_timer)
+			return (&loop->handlers[i]);
+	errno = ENOENT;
+	return (NULL);
+} // evloop_find()
+
+/**
+ * Watches a file descriptor.
+ * @param loop The loop to add to
+ * @param fd File descriptor to watch, e.g. a CANbus or GPIO module
+ * @param events Epoll events to wait for, usually EPOLLIN
+ * @param cb Called each time @c fd is ready
+ * @param arg Passed through to @c cb
+ * @returns Returns 0 on success, -1 on error
+ */
+int evloop_add_fd(evloop_t *loop, int fd, uint32_t events, evloop_fd_cb cb,
+	void *arg)
+{
+	evloop_handler_t *h;
+
+	if (cb == NULL)
+		return (-1); // @todo Return a better error indicator
+	if ((h = evloop_add(loop, fd, events)) == NULL)
+		return (-1);
+	h->fd_cb = cb;
+	h->arg = arg;
+	return (0);
+} // evloop_add_fd()
+
+/**
+ * Stops watching a file descriptor. Safe to call from inside a handler.
+ * @param loop The loop to remove from
+ * @param fd File descriptor previously passed to evloop_add_fd()
+ * @returns Returns 0 on success, -1 on error
+ */
+int evloop_del_fd(evloop_t *loop, int fd)
+{
+	evloop_handler_t *h;
+
+	if ((h = evloop_find(loop, fd, 0)) == NULL)
+		return (-1);
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+	h->used = 0;
+	return (0);
+} // evloop_del_fd()
+
+/**
+ * Adds a timer backed by a CLOCK_MONOTONIC timerfd.
+ * @param loop The loop to add to
+ * @param interval_ms Milliseconds until the timer first fires, and between
+ * firings if @c repeat is set
+ * @param repeat Non-zero for a periodic timer, zero for a one-shot
+ * @param cb Called each time the timer fires. Missed expirations are
+ * coalesced into one call.
+ * @param arg Passed through to @c cb
+ * @returns Returns the timer's ID (>= 0) on success, -1 on error
+ */
+int evloop_add_timer(evloop_t *loop, int interval_ms, int repeat,
+	evloop_timer_cb cb, void *arg)
+{
+	struct itimerspec its;
+	evloop_handler_t *h;
+	int tfd;
+
+	if (cb == NULL || interval_ms <= 0)
+		return (-1); // @todo Return a better error indicator
+	if ((tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK)) < 0)
+		return (-1);
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = interval_ms / 1000;
+	its.it_value.tv_nsec = (interval_ms % 1000) * 1000000L;
+	if (repeat)
+		its.it_interval = its.it_value;
+	if (timerfd_settime(tfd, 0, &its, NULL) < 0 ||
+		(h = evloop_add(loop, tfd, EPOLLIN)) == NULL)
+	{
+		close(tfd);
+		return (-1);
+	}
+	h->is_timer = 1;
+	h->timer_cb = cb;
+	h->arg = arg;
+	return (tfd);
+} // evloop_add_timer()
+
+/**
+ * Cancels and removes a timer. Safe to call from inside a handler.
+ * @param loop The loop to remove from
+ * @param id Timer ID returned by evloop_add_timer()
+ * @returns Returns 0 on success, -1 on error
+ */
+int evloop_del_timer(evloop_t *loop, int id)
+{
+	evloop_handler_t *h;
+
+	if ((h = evloop_find(loop, id, 1)) == NULL)
+		return (-1);
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, id, NULL);
+	close(id);
+	h->used = 0;
+	return (0);
+} // evloop_del_timer()
+
+/**
+ * Waits once for events and dispatches every ready one to its handler.
+ * @param loop The loop to run
+ * @param timeout_ms Milliseconds to wait, or negative to wait forever
+ * @returns Returns the number of events dispatched (0 on timeout), -1 on
+ * error. errno is EINTR when a signal interrupted the wait.
+ */
+int evloop_run_once(evloop_t *loop, int timeout_ms)
+{
+	struct epoll_event events[EVLOOP_MAX_EVENTS];
+	uint64_t expirations;
+	int n;
+
+	if ((n = epoll_wait(loop->epfd, events, EVLOOP_MAX_EVENTS,
+		timeout_ms)) < 0)
+		return (-1);
+
+	for (int i = 0; i < n; i++)
+	{
+		evloop_handler_t *h = events[i].data.ptr;
+
+		// An earlier handler in this batch may have removed this one
+		if (!h->used)
+			continue;
+		if (h->is_timer)
+		{
+			if (read(h->fd, &expirations, sizeof(expirations)) < 0)
+				continue; // Spurious wakeup, nothing expired
+			h->timer_cb(loop, h->fd, h->arg);
+		}
+		else
+			h->fd_cb(loop, h->fd, events[i].events, h->arg);
+	}
+	return (n);
+} // evloop_run_once()
+
+/**
+ * Dispatches events until evloop_stop() is called or an error occurs.
+ * @param loop The loop to run
+ * @returns Returns 0 once stopped, -1 on error. errno is EINTR when a signal
+ * interrupted the wait, so the caller can check its own flags and re-enter.
+ */
+int evloop_run(evloop_t *loop)
+{
+	loop->stop = 0;
+	while (!loop->stop)
+		if (evloop_run_once(loop, -1) < 0)
+			return (-1);
+	return (0);
+} // evloop_run()
+
+/**
+ * Makes evloop_run() return after the current batch of events. Meant to be
+ * called from inside a handler.
+ * @param loop The loop to stop
+ */
+void evloop_stop(evloop_t *loop)
+{
+	loop->stop = 1;
+} // evloop_stop()
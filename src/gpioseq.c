@@ -0,0 +1,299 @@
+/**
+ * @file gpioseq.c
+ * @date 2026-10-16
+ */
+
+#include "gpioseq.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+struct gpioseq
+{
+	gpioseq_step_t *steps; // Sorted by offset, ties in the order added
+	size_t count, size;
+	unsigned long period_us; // 0 if the sequence does not repeat
+};
+
+/**
+ * Steps that share one transaction
+ */
+typedef struct gpioseq_batch
+{
+	unsigned long offset_us; // Of the first step
+	uint8_t mask;
+	uint8_t value;
+	unsigned long nsteps;
+} gpioseq_batch_t;
+
+/**
+ * Creates an empty sequence.
+ * @returns Returns the new sequence on success, NULL on error
+ */
+gpioseq_t *gpioseq_create(void)
+{
+	return (calloc(1, sizeof(gpioseq_t)));
+} // gpioseq_create()
+
+/**
+ * Frees a sequence.
+ * @param seq The sequence to destroy, may be NULL
+ */
+void gpioseq_destroy(gpioseq_t *seq)
+{
+	if (seq == NULL)
+		return;
+	free(seq->steps);
+	free(seq);
+} // gpioseq_destroy()
+
+/**
+ * Adds a step. Steps may be added in any order.
+ * @param seq The sequence
+ * @param offset_us When the step is due, from the start of each period
+ * @param mask Pins the step sets, bit 0 is pin 1
+ * @param value New levels for the pins in @c mask
+ * @returns Returns 0 on success, -1 on error
+ */
+int gpioseq_add(gpioseq_t *seq, unsigned long offset_us, uint8_t mask,
+	uint8_t value)
+{
+	gpioseq_step_t *p;
+	size_t i;
+
+	if (seq == NULL)
+		return (-1); // @todo Return a better error indicator
+	if (seq->count == seq->size)
+	{
+		if ((p = realloc(seq->steps, (seq->size ? seq->size * 2 : 16) *
+			sizeof(*p))) == NULL)
+			return (-1);
+		seq->steps = p;
+		seq->size = seq->size ? seq->size * 2 : 16;
+	}
+
+	// Steps usually arrive in order, so this rarely moves anything
+	for (i = seq->count; i > 0 && seq->steps[i - 1].offset_us > offset_us;
+		i--)
+		seq->steps[i] = seq->steps[i - 1];
+	seq->steps[i].offset_us = offset_us;
+	seq->steps[i].mask = mask;
+	seq->steps[i].value = value & mask;
+	seq->count++;
+	return (0);
+} // gpioseq_add()
+
+/**
+ * Adds a software PWM: the pins go high at the start of each period and
+ * low after @c duty_pct percent of it. Sets the sequence's period.
+ * @param seq The sequence
+ * @param mask Pins to drive, bit 0 is pin 1
+ * @param period_us PWM period
+ * @param duty_pct Percent of each period the pins are high, 0 to 100
+ * @returns Returns 0 on success, -1 on error
+ */
+int gpioseq_add_pwm(gpioseq_t *seq, uint8_t mask, unsigned long period_us,
+	unsigned int duty_pct)
+{
+	unsigned long high_us;
+
+	if (seq == NULL || period_us == 0 || duty_pct > 100)
+	{
+		errno = EINVAL;
+		return (-1);
+	}
+	high_us = (unsigned long)((unsigned long long)period_us * duty_pct / 100);
+	seq->period_us = period_us;
+	if (gpioseq_add(seq, 0, mask, high_us > 0 ? mask : 0) < 0)
+		return (-1);
+	if (high_us > 0 && high_us < period_us)
+		return (gpioseq_add(seq, high_us, mask, 0));
+	return (0);
+} // gpioseq_add_pwm()
+
+/**
+ * Makes the sequence repeat every @c period_us. Every step's offset must
+ * be less than the period.
+ * @param seq The sequence
+ * @param period_us The period, or 0 for a sequence that does not repeat
+ */
+void gpioseq_set_period(gpioseq_t *seq, unsigned long period_us)
+{
+	seq->period_us = period_us;
+} // gpioseq_set_period()
+
+/**
+ * @param seq The sequence
+ * @returns Returns the sequence's period, 0 if it does not repeat
+ */
+unsigned long gpioseq_get_period(const gpioseq_t *seq)
+{
+	return (seq->period_us);
+} // gpioseq_get_period()
+
+/**
+ * @param seq The sequence
+ * @returns Returns every pin the sequence drives, bit 0 is pin 1
+ */
+uint8_t gpioseq_get_mask(const gpioseq_t *seq)
+{
+	uint8_t mask = 0;
+
+	for (size_t i = 0; i < seq->count; i++)
+		mask |= seq->steps[i].mask;
+	return (mask);
+} // gpioseq_get_mask()
+
+/**
+ * Folds the steps into batches, each one transaction.
+ * @param seq The sequence
+ * @param merge_us Steps due this soon after a batch's first step join it
+ * @param nbatches Set to the number of batches
+ * @returns Returns the batches, to be freed by the caller, or NULL on error
+ */
+static gpioseq_batch_t *gpioseq_batch(const gpioseq_t *seq,
+	unsigned long merge_us, size_t *nbatches)
+{
+	gpioseq_batch_t *batches, *b = NULL;
+	const gpioseq_step_t *s;
+
+	if ((batches = malloc(seq->count * sizeof(*batches))) == NULL)
+		return (NULL);
+	*nbatches = 0;
+	for (size_t i = 0; i < seq->count; i++)
+	{
+		s = &seq->steps[i];
+		if (b == NULL || s->offset_us - b->offset_us > merge_us)
+		{
+			b = &batches[(*nbatches)++];
+			b->offset_us = s->offset_us;
+			b->mask = 0;
+			b->value = 0;
+			b->nsteps = 0;
+		}
+		// Later steps win where they overlap
+		b->value = (b->value & ~s->mask) | s->value;
+		b->mask |= s->mask;
+		b->nsteps++;
+	}
+	return (batches);
+} // gpioseq_batch()
+
+/**
+ * @returns Returns @c base plus @c ns nanoseconds
+ */
+static struct timespec gpioseq_at(const struct timespec *base,
+	unsigned long long ns)
+{
+	struct timespec ts;
+
+	ns += base->tv_nsec;
+	ts.tv_sec = base->tv_sec + ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	return (ts);
+} // gpioseq_at()
+
+/**
+ * @returns Returns nonzero if @c a is later than @c b
+ */
+static int gpioseq_after(const struct timespec *a, const struct timespec *b)
+{
+	return (a->tv_sec != b->tv_sec ? a->tv_sec > b->tv_sec :
+		a->tv_nsec > b->tv_nsec);
+} // gpioseq_after()
+
+/**
+ * Plays a sequence on a GPIO module, returning when it is done. The pins
+ * it drives should be outputs. Pins it does not drive keep their data.
+ * @param dev The GPIO module's handle
+ * @param seq The sequence
+ * @param opts Playback settings
+ * @param res Filled with what playback achieved, also on error
+ * @returns Returns 0 on success or when stopped, -1 on error (errno is
+ * EINVAL if a step is not inside the period, or a repeating sequence has
+ * no period)
+ */
+int gpioseq_play(canctl_dev_t *dev, gpioseq_t *seq, const gpioseq_opts_t *opts,
+	gpioseq_result_t *res)
+{
+	gpioseq_batch_t *batches, *b;
+	struct timespec start, deadline, done, end;
+	size_t nbatches;
+	uint8_t shadow = 0, known = 0; // What this playback last wrote
+	int rc = 0;
+
+	memset(res, 0, sizeof(*res));
+	if (dev == NULL || seq == NULL || opts == NULL)
+		return (-1); // @todo Return a better error indicator
+	if ((opts->cycles != 1 && seq->period_us == 0) || (seq->period_us > 0 &&
+		seq->count > 0 && seq->steps[seq->count - 1].offset_us >=
+		seq->period_us))
+	{
+		errno = EINVAL;
+		return (-1);
+	}
+	if (seq->count == 0)
+		return (0);
+	if ((batches = gpioseq_batch(seq, opts->merge_us, &nbatches)) == NULL)
+		return (-1);
+
+	// Seed gpio_write_pins()'s copy of the outputs now, so the first step
+	// costs one transaction like the rest
+	if (gpio_write_pins(dev, 0, 0) < 0)
+	{
+		free(batches);
+		return (-1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	done = start;
+	for (unsigned long cycle = 0; opts->cycles == 0 || cycle < opts->cycles;
+		cycle++)
+	{
+		for (size_t i = 0; i < nbatches; i++)
+		{
+			b = &batches[i];
+			if (opts->stop != NULL && *opts->stop)
+				goto out;
+			deadline = gpioseq_at(&start, ((unsigned long long)cycle *
+				seq->period_us + b->offset_us) * 1000);
+
+			if (gpioseq_after(&done, &deadline))
+				res->late++; // The previous transaction ran over
+			else
+			{
+				while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&deadline, NULL) == EINTR)
+					if (opts->stop != NULL && *opts->stop)
+						goto out;
+			}
+
+			res->steps += b->nsteps;
+			if ((known & b->mask) == b->mask &&
+				((shadow ^ b->value) & b->mask) == 0)
+			{
+				res->skipped++;
+				continue;
+			}
+			if (gpio_write_pins(dev, b->mask, b->value) < 0)
+			{
+				rc = -1;
+				goto out;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &done);
+			canctl_hist_add(&res->error, &deadline, &done);
+			shadow = (shadow & ~b->mask) | b->value;
+			known |= b->mask;
+			res->transactions++;
+		}
+		res->cycles++;
+	}
+
+out:
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	res->elapsed_s = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1e9;
+	free(batches);
+	return (rc);
+} // gpioseq_play()
@@ -0,0 +1,310 @@
+/**
+ * @file gpiowatch.c
+ * @date 2026-10-16
+ */
+
+#define _GNU_SOURCE // ppoll()
+#include "gpiowatch.h"
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+struct gpiowatch
+{
+	canctl_dev_t *dev;
+	gpiowatch_opts_t opts;
+	gpiowatch_cb cb;
+	void *cb_arg;
+	pthread_t thread;
+	int stop_fd; // eventfd that stops the thread
+	int efd; // eventfd bumped when events are queued or the thread fails
+
+	pthread_mutex_t lock; // Guards everything below
+	gpiowatch_event_t queue[GPIOWATCH_QUEUE_SIZE]; // Oldest at q_tail
+	size_t q_head, q_tail;
+	int error; // errno that stopped the thread, 0 while it runs
+	gpiowatch_stats_t stats;
+};
+
+/**
+ * @returns Returns @c a - @c b in nanoseconds
+ */
+static int64_t gpiowatch_diff_ns(const struct timespec *a,
+	const struct timespec *b)
+{
+	return ((int64_t)(a->tv_sec - b->tv_sec) * 1000000000 +
+		(a->tv_nsec - b->tv_nsec));
+} // gpiowatch_diff_ns()
+
+/**
+ * Adds @c ns nanoseconds to @c ts.
+ */
+static void gpiowatch_add_ns(struct timespec *ts, int64_t ns)
+{
+	ns += ts->tv_nsec;
+	ts->tv_sec += ns / 1000000000;
+	ts->tv_nsec = ns % 1000000000;
+} // gpiowatch_add_ns()
+
+/**
+ * Bumps the event fd to wake the consumer. A failed write only means the
+ * counter is already nonzero.
+ */
+static void gpiowatch_wake(int fd)
+{
+	uint64_t one = 1;
+
+	if (write(fd, &one, sizeof(one)) < 0)
+		return;
+} // gpiowatch_wake()
+
+/**
+ * Delivers the edges between two snapshots.
+ * @param w The watcher
+ * @param changed Pins that changed, already masked
+ * @param levels The new snapshot
+ * @param ts When the new snapshot was taken
+ * @param window_us Time since the previous snapshot
+ */
+static void gpiowatch_deliver(gpiowatch_t *w, uint8_t changed, uint8_t levels,
+	const struct timespec *ts, unsigned long window_us)
+{
+	gpiowatch_event_t event;
+	unsigned int bit;
+	int queued = 0;
+
+	event.ts = *ts;
+	event.window_us = window_us;
+	event.levels = levels;
+	pthread_mutex_lock(&w->lock);
+	for (; changed != 0; changed &= changed - 1)
+	{
+		bit = __builtin_ctz(changed);
+		event.pin = bit + 1;
+		event.level = (levels >> bit) & 1;
+		w->stats.events++;
+		if (w->cb != NULL)
+		{
+			pthread_mutex_unlock(&w->lock);
+			w->cb(w, &event, w->cb_arg);
+			pthread_mutex_lock(&w->lock);
+		}
+		else if (w->q_head - w->q_tail == GPIOWATCH_QUEUE_SIZE)
+			w->stats.overflows++;
+		else
+		{
+			w->queue[w->q_head++ % GPIOWATCH_QUEUE_SIZE] = event;
+			queued = 1;
+		}
+	}
+	pthread_mutex_unlock(&w->lock);
+	if (queued)
+		gpiowatch_wake(w->efd);
+} // gpiowatch_deliver()
+
+/**
+ * Watcher thread: polls the pin data, diffs it and adapts the interval.
+ * @param arg The watcher
+ * @returns Returns NULL
+ */
+static void *gpiowatch_thread(void *arg)
+{
+	gpiowatch_t *w = arg;
+	struct pollfd pfd = { .fd = w->stop_fd, .events = POLLIN };
+	struct timespec due, now, last = { 0, 0 }, timeout;
+	unsigned long interval_us = w->opts.min_interval_us;
+	unsigned int idle = 0;
+	uint8_t levels, prev = 0, changed;
+	int have_prev = 0;
+	int64_t wait_ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &due);
+	for (;;)
+	{
+		if (gpio_read_pins(w->dev, PIN_DATA, &levels) < 0)
+		{
+			pthread_mutex_lock(&w->lock);
+			w->stats.poll_failures++;
+			if (errno == ENODEV || errno == EIO || errno == ENXIO)
+			{
+				w->error = errno; // The module went away
+				pthread_mutex_unlock(&w->lock);
+				gpiowatch_wake(w->efd);
+				break;
+			}
+			pthread_mutex_unlock(&w->lock);
+		}
+		else
+		{
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			changed = have_prev ? (levels ^ prev) & w->opts.mask : 0;
+			if (changed != 0)
+			{
+				gpiowatch_deliver(w, changed, levels, &now,
+					gpiowatch_diff_ns(&now, &last) / 1000);
+				interval_us = w->opts.min_interval_us;
+				idle = 0;
+			}
+			else if (++idle >= w->opts.idle_polls)
+			{
+				interval_us *= 2;
+				if (interval_us > w->opts.max_interval_us)
+					interval_us = w->opts.max_interval_us;
+				idle = 0;
+			}
+			prev = levels;
+			have_prev = 1;
+			last = now;
+
+			pthread_mutex_lock(&w->lock);
+			w->stats.polls++;
+			w->stats.interval_us = interval_us;
+			pthread_mutex_unlock(&w->lock);
+		}
+
+		// Keep to a fixed schedule, but don't burst to catch up after a
+		// slow round trip
+		gpiowatch_add_ns(&due, (int64_t)interval_us * 1000);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if ((wait_ns = gpiowatch_diff_ns(&due, &now)) < 0)
+		{
+			due = now;
+			wait_ns = 0;
+		}
+		timeout.tv_sec = wait_ns / 1000000000;
+		timeout.tv_nsec = wait_ns % 1000000000;
+		if (ppoll(&pfd, 1, &timeout, NULL) > 0)
+			break; // Stopped
+	}
+	return (NULL);
+} // gpiowatch_thread()
+
+/**
+ * Starts watching a GPIO module's input pins.
+ * @param dev The GPIO module's handle. The watcher does not own it.
+ * @param opts The watcher's settings, NULL for the defaults
+ * @param cb Called from the watcher's thread for each edge, or NULL to
+ * queue the edges for gpiowatch_read()
+ * @param arg Passed to @c cb
+ * @returns Returns the new watcher on success, NULL on error
+ */
+gpiowatch_t *gpiowatch_start(canctl_dev_t *dev, const gpiowatch_opts_t *opts,
+	gpiowatch_cb cb, void *arg)
+{
+	gpiowatch_t *w;
+
+	if (dev == NULL)
+		return (NULL); // @todo Return a better error indicator
+	if ((w = calloc(1, sizeof(*w))) == NULL)
+		return (NULL);
+	w->dev = dev;
+	if (opts != NULL)
+		w->opts = *opts;
+	if (w->opts.min_interval_us == 0)
+		w->opts.min_interval_us = GPIOWATCH_MIN_INTERVAL_US;
+	if (w->opts.max_interval_us < w->opts.min_interval_us)
+		w->opts.max_interval_us = w->opts.min_interval_us >
+			GPIOWATCH_MAX_INTERVAL_US ? w->opts.min_interval_us :
+			GPIOWATCH_MAX_INTERVAL_US;
+	if (w->opts.idle_polls == 0)
+		w->opts.idle_polls = GPIOWATCH_IDLE_POLLS;
+	if (w->opts.mask == 0)
+		w->opts.mask = 0xff;
+	w->cb = cb;
+	w->cb_arg = arg;
+	pthread_mutex_init(&w->lock, NULL);
+
+	if ((w->stop_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK)) < 0)
+		goto err;
+	if ((w->efd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK)) < 0)
+		goto err_stop_fd;
+	if (pthread_create(&w->thread, NULL, gpiowatch_thread, w) != 0)
+		goto err_efd;
+	return (w);
+
+err_efd:
+	close(w->efd);
+err_stop_fd:
+	close(w->stop_fd);
+err:
+	pthread_mutex_destroy(&w->lock);
+	free(w);
+	return (NULL);
+} // gpiowatch_start()
+
+/**
+ * Stops the watcher and frees it. Queued events are discarded.
+ * @param w The watcher to stop, may be NULL
+ */
+void gpiowatch_stop(gpiowatch_t *w)
+{
+	if (w == NULL)
+		return;
+	gpiowatch_wake(w->stop_fd);
+	pthread_join(w->thread, NULL);
+	close(w->efd);
+	close(w->stop_fd);
+	pthread_mutex_destroy(&w->lock);
+	free(w);
+} // gpiowatch_stop()
+
+/**
+ * @param w The watcher
+ * @returns Returns an eventfd that becomes readable whenever events were
+ * queued or the watcher failed. Read it to clear it before draining the
+ * queue with gpiowatch_read().
+ */
+int gpiowatch_event_fd(gpiowatch_t *w)
+{
+	return (w->efd);
+} // gpiowatch_event_fd()
+
+/**
+ * Takes queued events, oldest first.
+ * @param w The watcher
+ * @param events Buffer for the events
+ * @param max Number of events @c events can hold
+ * @returns Returns the number of events taken
+ */
+size_t gpiowatch_read(gpiowatch_t *w, gpiowatch_event_t *events, size_t max)
+{
+	size_t n = 0;
+
+	pthread_mutex_lock(&w->lock);
+	while (n < max && w->q_tail != w->q_head)
+		events[n++] = w->queue[w->q_tail++ % GPIOWATCH_QUEUE_SIZE];
+	pthread_mutex_unlock(&w->lock);
+	return (n);
+} // gpiowatch_read()
+
+/**
+ * @param w The watcher
+ * @returns Returns the errno that stopped the watcher, or 0 while it runs
+ */
+int gpiowatch_error(gpiowatch_t *w)
+{
+	int err;
+
+	pthread_mutex_lock(&w->lock);
+	err = w->error;
+	pthread_mutex_unlock(&w->lock);
+	return (err);
+} // gpiowatch_error()
+
+/**
+ * Gets the watcher's counters.
+ * @param w The watcher
+ * @param stats Set to the counters
+ */
+void gpiowatch_get_stats(gpiowatch_t *w, gpiowatch_stats_t *stats)
+{
+	pthread_mutex_lock(&w->lock);
+	*stats = w->stats;
+	pthread_mutex_unlock(&w->lock);
+} // gpiowatch_get_stats()
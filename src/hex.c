@@ -0,0 +1,360 @@
+/**
+ * @file hex.c
+ * @date 2026-10-16
+ */
+
+#include "hex.h"
+#include <string.h>
+#include <errno.h>
+
+// Two lowercase hex digits for every byte value
+static const char hex_table[512] =
+	"000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+	"202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+	"404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+	"606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+	"808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+	"a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+	"c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+	"e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+/**
+ * Writes @c v in decimal, zero-padded to at least @c width digits.
+ * @returns Returns the number of characters written, at most 20
+ */
+static size_t hex_put_dec(char *out, unsigned long v, size_t width)
+{
+	char tmp[20];
+	size_t n = 0;
+
+	do
+	{
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v != 0);
+	while (n < width && n < sizeof(tmp))
+		tmp[n++] = '0';
+	for (size_t i = 0; i < n; i++)
+		out[i] = tmp[n - 1 - i];
+	return (n);
+} // hex_put_dec()
+
+/**
+ * Writes @c v in hex, zero-padded to at least @c width digits.
+ * @returns Returns the number of characters written, at most 8
+ */
+static size_t hex_put_u32(char *out, uint32_t v, size_t width)
+{
+	size_t n = 8;
+
+	while (n > width && n > 1 && (v >> ((n - 1) * 4)) == 0)
+		n--;
+	for (size_t i = 0; i < n; i++)
+		out[i] = hex_table[((v >> ((n - 1 - i) * 4)) & 0xf) * 2 + 1];
+	return (n);
+} // hex_put_u32()
+
+/**
+ * Renders bytes as "xx " each, the same as printf("%02x ") per byte.
+ * @param out Buffer to render into, not NUL terminated
+ * @param size Length of buffer @c out, at least 3 * @c len
+ * @param buf Bytes to render
+ * @param len Number of bytes in @c buf
+ * @returns Returns the number of characters rendered, 0 if @c out is too
+ * small
+ */
+size_t hex_format_bytes(char *out, size_t size, const unsigned char *buf,
+	size_t len)
+{
+	char *p = out;
+
+	if (size < len * 3)
+		return (0);
+	for (size_t i = 0; i < len; i++)
+	{
+		memcpy(p, &hex_table[buf[i] * 2], 2);
+		p[2] = ' ';
+		p += 3;
+	}
+	return (p - out);
+} // hex_format_bytes()
+
+/**
+ * Renders bytes as rows of HEX_ROW_BYTES, each labelled with the range of
+ * offsets it holds: "<pad spaces>[00-15] xx xx ... \n".
+ * @param out Buffer to render into, not NUL terminated
+ * @param size Length of buffer @c out, at least HEX_ROW_SIZE(@c pad) per row
+ * @param buf Bytes to render
+ * @param len Number of bytes in @c buf
+ * @param base Offset of @c buf[0], used for the row labels
+ * @param pad Number of spaces before each row
+ * @returns Returns the number of characters rendered, 0 if @c out is too
+ * small
+ */
+size_t hex_format_rows(char *out, size_t size, const unsigned char *buf,
+	size_t len, size_t base, unsigned int pad)
+{
+	size_t nrows = (len + HEX_ROW_BYTES - 1) / HEX_ROW_BYTES;
+	char *p = out;
+
+	if (size / HEX_ROW_SIZE(pad) < nrows)
+		return (0);
+	for (size_t r = 0; r < nrows; r++)
+	{
+		size_t first = r * HEX_ROW_BYTES;
+		size_t n = len - first < HEX_ROW_BYTES ? len - first : HEX_ROW_BYTES;
+
+		memset(p, ' ', pad);
+		p += pad;
+		*p++ = '[';
+		p += hex_put_dec(p, base + first, 2);
+		*p++ = '-';
+		p += hex_put_dec(p, base + first + HEX_ROW_BYTES - 1, 2);
+		*p++ = ']';
+		*p++ = ' ';
+		p += hex_format_bytes(p, n * 3, &buf[first], n);
+		*p++ = '\n';
+	}
+	return (p - out);
+} // hex_format_rows()
+
+/**
+ * Renders one decoded CAN frame on a single line: the receive time, the ID
+ * (3 hex digits for standard IDs, 8 for extended), the DLC and the data.
+ * @param out Buffer to render into, not NUL terminated
+ * @param size Length of buffer @c out, at least HEX_FRAME_SIZE
+ * @param frame Frame to render
+ * @returns Returns the number of characters rendered, 0 if @c out is too
+ * small
+ */
+size_t hex_format_frame(char *out, size_t size, const canbus_frame_t *frame)
+{
+	size_t dlc = frame->dlc;
+	char *p = out;
+
+	if (size < HEX_FRAME_SIZE)
+		return (0);
+	if (dlc > CANBUS_FRAME_MAX_DLC)
+		dlc = CANBUS_FRAME_MAX_DLC;
+
+	memcpy(p, "  (", 3);
+	p += 3;
+	p += hex_put_dec(p, frame->ts.tv_sec, 1);
+	*p++ = '.';
+	p += hex_put_dec(p, frame->ts.tv_nsec / 1000, 6);
+	*p++ = ')';
+	*p++ = ' ';
+	if (!frame->ext)
+	{
+		memset(p, ' ', 5); // Line standard IDs up with extended ones
+		p += 5;
+	}
+	p += hex_put_u32(p, frame->id, frame->ext ? 8 : 3);
+	*p++ = ' ';
+	*p++ = '[';
+	p += hex_put_dec(p, frame->dlc, 1);
+	*p++ = ']';
+	for (size_t i = 0; i < dlc; i++)
+	{
+		*p++ = ' ';
+		memcpy(p, &hex_table[frame->data[i] * 2], 2);
+		p += 2;
+	}
+	*p++ = '\n';
+	return (p - out);
+} // hex_format_frame()
+
+/**
+ * @returns Returns nonzero if @c c separates tokens
+ */
+static int hex_is_sep(char c)
+{
+	return (c == ' ' || c == '\t' || c == ',' || c == '\r' || c == '\n');
+} // hex_is_sep()
+
+/**
+ * @returns Returns the value of hex digit @c c, or -1 if it is not one
+ */
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return (c - '0');
+	if (c >= 'a' && c <= 'f')
+		return (c - 'a' + 10);
+	if (c >= 'A' && c <= 'F')
+		return (c - 'A' + 10);
+	return (-1);
+} // hex_digit()
+
+/**
+ * Parses one hex number starting at @c s[*pos] and moves @c *pos past it.
+ * @param s The text
+ * @param len Number of characters in @c s
+ * @param pos Where the number starts; on error, where the problem is
+ * @param max Largest value allowed
+ * @param value Set to the number
+ * @param ndigits Set to the number of digits, leading zeros included
+ * @returns Returns 0 on success, -1 on error (errno is EINVAL or ERANGE)
+ */
+static int hex_parse_number(const char *s, size_t len, size_t *pos,
+	uint32_t max, uint32_t *value, size_t *ndigits)
+{
+	size_t start = *pos, i = *pos;
+	uint32_t v = 0;
+	int d;
+
+	if (i + 1 < len && s[i] == '0' && (s[i + 1] == 'x' || s[i + 1] == 'X'))
+		i += 2;
+	*ndigits = 0;
+	while (i < len && (d = hex_digit(s[i])) >= 0)
+	{
+		if (v > (max - d) / 16)
+		{
+			*pos = start;
+			errno = ERANGE;
+			return (-1);
+		}
+		v = v * 16 + d;
+		(*ndigits)++;
+		i++;
+	}
+	if (*ndigits == 0 || (i < len && !hex_is_sep(s[i]) && s[i] != ':'))
+	{
+		*pos = i < len ? i : start; // A lone "0x" points at itself
+		errno = EINVAL;
+		return (-1);
+	}
+	*value = v;
+	*pos = i;
+	return (0);
+} // hex_parse_number()
+
+/**
+ * Skips separators.
+ * @returns Returns the position of the next token, or @c len if none
+ */
+static size_t hex_skip(const char *s, size_t len, size_t pos)
+{
+	while (pos < len && hex_is_sep(s[pos]))
+		pos++;
+	return (pos);
+} // hex_skip()
+
+/**
+ * Parses a line of hex bytes, see hex.h for the syntax.
+ * @param s The text, need not be NUL terminated
+ * @param len Number of characters in @c s
+ * @param out Buffer for the bytes
+ * @param max Length of buffer @c out
+ * @param errpos On error, set to the offset in @c s of the problem. May be
+ * NULL.
+ * @returns Returns the number of bytes parsed on success, -1 on error
+ * (errno is EINVAL for a bad character, ERANGE for a value over 0xff or
+ * E2BIG for more than @c max bytes)
+ */
+int hex_parse_bytes(const char *s, size_t len, unsigned char *out, size_t max,
+	size_t *errpos)
+{
+	size_t pos = hex_skip(s, len, 0), n = 0, ndigits;
+	uint32_t v;
+
+	while (pos < len)
+	{
+		if (n == max)
+		{
+			errno = E2BIG;
+			goto err;
+		}
+		if (hex_parse_number(s, len, &pos, 0xff, &v, &ndigits) < 0)
+			goto err;
+		if (pos < len && s[pos] == ':')
+		{
+			errno = EINVAL; // A frame ID where a byte was expected
+			goto err;
+		}
+		out[n++] = v;
+		pos = hex_skip(s, len, pos);
+	}
+	return ((int)n);
+
+err:
+	if (errpos != NULL)
+		*errpos = pos;
+	return (-1);
+} // hex_parse_bytes()
+
+/**
+ * Parses a CAN frame written as "ID: data bytes", see hex.h for the syntax.
+ * @param s The text, need not be NUL terminated
+ * @param len Number of characters in @c s
+ * @param frame Filled with the frame. The time stamp is zeroed.
+ * @param errpos On error, set to the offset in @c s of the problem. May be
+ * NULL.
+ * @returns Returns 0 on success, -1 on error (errno is EINVAL for a bad
+ * character or missing ':', ERANGE for an ID over 29 bits or a byte over
+ * 0xff, or E2BIG for more than 8 data bytes)
+ */
+int hex_parse_frame(const char *s, size_t len, canbus_frame_t *frame,
+	size_t *errpos)
+{
+	size_t pos = hex_skip(s, len, 0), ndigits, dpos;
+	uint32_t id;
+	int n;
+
+	memset(frame, 0, sizeof(*frame));
+	if (hex_parse_number(s, len, &pos, CANBUS_EXT_ID_MASK, &id,
+		&ndigits) < 0)
+		goto err;
+	if (pos >= len || s[pos] != ':')
+	{
+		errno = EINVAL;
+		goto err;
+	}
+	frame->id = id;
+	frame->ext = id > CANBUS_STD_ID_MASK || ndigits > 3;
+
+	dpos = pos + 1;
+	if ((n = hex_parse_bytes(&s[dpos], len - dpos, frame->data,
+		CANBUS_FRAME_MAX_DLC, &pos)) < 0)
+	{
+		pos += dpos;
+		goto err;
+	}
+	frame->dlc = n;
+	return (0);
+
+err:
+	if (errpos != NULL)
+		*errpos = pos;
+	return (-1);
+} // hex_parse_frame()
+
+/**
+ * @param s The text, need not be NUL terminated
+ * @param len Number of characters in @c s
+ * @returns Returns nonzero if @c s is written as a CAN frame, i.e. its
+ * first token ends with ':'
+ */
+int hex_is_frame(const char *s, size_t len)
+{
+	size_t pos = hex_skip(s, len, 0);
+
+	while (pos < len && !hex_is_sep(s[pos]) && s[pos] != ':')
+		pos++;
+	return (pos < len && s[pos] == ':');
+} // hex_is_frame()
+
+/**
+ * @param err errno from a failed hex_parse_bytes() or hex_parse_frame()
+ * @returns Returns what went wrong in words
+ */
+const char *hex_error_to_string(int err)
+{
+	switch (err)
+	{
+		case EINVAL: return ("Expected a hex number");
+		case ERANGE: return ("Value too large");
+		case E2BIG: return ("Too many bytes");
+		default: return ("Error");
+	}
+} // hex_error_to_string()
@@ -7,6 +7,18 @@
 #include "cfg.h"
 #include "args.h"
 #include "canctl.h"
+#include "evloop.h"
+#include "canmgr.h"
+#include "discover.h"
+#include "session.h"
+#include "canfilter.h"
+#include "bench.h"
+#include "emu.h"
+#include "hex.h"
+#include "metrics.h"
+#include "errmon.h"
+#include "gpiowatch.h"
+#include "gpioseq.h"
 
 // #include <linux/types.h>
 #include <linux/input.h> // BUS_* macros
@@ -20,10 +32,16 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
-#include <dirent.h> // for searching /dev directory
 #include <signal.h>
+#include <poll.h>
 #include <time.h>
 
+// How often monitor mode samples the GPIO module's pin data
+#define GPIO_MONITOR_INTERVAL_MS 100
+
+// Longest line write mode and --script accept
+#define WRITE_LINE_SIZE 1024
+
 // Used during printf() output in some cases for making text pretty. A
 // negative number means left-align the text and fill with spaces on the right.
 #define PAD -15
@@ -33,14 +51,25 @@ static cfg_t cfg = {
 	.path = { 0 },
 	.timeout_ms = CANBUS_DEFAULT_TIMEOUT_MS,
 	.list_hids = 0,
-	.verbose = 0
+	.verbose = 0,
+	.bench_count = BENCH_DEFAULT_COUNT,
+	.bench_depth = 1,
+	.gpio_cycles = ULONG_MAX // Unset, see run_gpioseq()
 };
 
-// This static ints is used as the file descriptors for the CANbus/GPIO module.
-// It is opened in the beginning part of main() using open().
-static int fd = -1;
-static int fd_can = -1;
-static int fd_gpio = -1;
+// Handles for the CANbus/GPIO modules. They are opened in the beginning part
+// of main() and are NULL when the module was not found or not selected.
+static canctl_dev_t *dev_can = NULL;
+static canctl_dev_t *dev_gpio = NULL;
+static session_t *session_can = NULL; // Only with --supervise
+static canfilter_t *filter = NULL; // Only with --filter
+static emu_t *emu_can = NULL; // Only with --emulate
+static emu_t *emu_gpio = NULL; // Only with --emulate
+static metrics_t *metrics = NULL; // Only with --metrics-file/-socket
+static errmon_t *errmon_can = NULL; // Only with --errmon
+static volatile sig_atomic_t filter_reload_requested = 0; // Set by SIGHUP
+static volatile sig_atomic_t hist_dump_requested = 0; // Set by SIGUSR1
+static volatile sig_atomic_t stop_requested = 0; // Set by SIGINT in --bench
 
 // This int serves as a global variable used during the read and write
 // operation modes. It is used in conjunction with the signal handling
@@ -58,12 +87,45 @@ static void mnu_can_loopback_test(void);
 static void mnu_set_timeout(void);
 static const char *bus_to_str(int bus);
 static void list_hids(void);
+static void print_device(const discover_device_t *dev);
+static canctl_dev_t *select_device(const discover_device_t *found, int nfound,
+	discover_kind_t kind);
 static void list_gpio_pin(int type_or_data);
 static void handle_signal_while_reading_or_writing(int signo);
 static void flush_stdin(void);
 static void print_bytes(FILE *fs, unsigned char *buf, size_t len, char pad);
+static void print_frame(FILE *fs, const canbus_frame_t *frame);
+static void read_with_reader_thread(void);
+static void mnu_monitor(void);
+static void apply_timeout(void);
+static void apply_io(canctl_dev_t *dev, const char *name);
+static void on_session_event(session_t *s, session_event_t event, void *arg);
+static int load_filter(void);
+static void reload_filter(canmgr_t *mgr);
+static void handle_sighup(int signo);
+static void handle_sigusr1(int signo);
+static void service_signal_requests(canmgr_t *mgr);
+static void print_hists(FILE *fs, canctl_dev_t *dev);
+static void print_hist(FILE *fs, const char *name, const canctl_hist_t *hist);
+static int run_bench(void);
+static void handle_signal_while_benchmarking(int signo);
+static int run_all_devices(void);
+static int start_emulators(void);
+static int write_frames(const canbus_frame_t *frames, size_t n);
+static void print_parse_error(const char *line, size_t len, size_t pos,
+	int err);
+static int run_script(void);
+static void stop_emulators(void);
+static void start_metrics(canmgr_t *mgr);
+static errmon_t *start_errmon(canctl_dev_t *dev, const char *name);
+static void on_errmon_event(errmon_t *mon, const errmon_event_t *event,
+	void *arg);
 static void mnu_gpio_set_pin(int type_or_data);
 static void mnu_gpio_get_iom_or_sku(int op_select);
+static void mnu_gpio_watch(void);
+static void mnu_gpio_set_one(void);
+static int run_gpioseq(void);
+static gpioseq_t *load_gpioseq(void);
 
 /**
  * Main program entry point
@@ -74,8 +136,8 @@ static void mnu_gpio_get_iom_or_sku(int op_select);
 int main(int argc, char **argv)
 {
 	int rc; // Used for the return code of almost all functions
+	int fd = -1; // Candidate module's file descriptor during the search
 	int keep_going; // Used to control while loops
-	unsigned char buf[256]; // Generic buffer
 
 	/* BEGIN ARGUMENT PARSING STUFF */
 	const char *env_extras = "ARGP_HELP_FMT=dup-args,no-dup-args-note";
@@ -89,146 +151,59 @@ int main(int argc, char **argv)
 		return (0);
 	}
 
-	canctl_set_timeout_ms(cfg.timeout_ms);
+	// Benchmarks that need no module run right away
+	if (strcmp(cfg.bench, "hexfmt") == 0)
+		return (run_bench());
+
+	if (cfg.filter_path[0] != '\0' && load_filter() < 0)
+		return (-1);
+
+	// SIGUSR1 dumps the receive latency histograms, even mid-read
+	struct sigaction usr1;
+	memset(&usr1, 0, sizeof(usr1));
+	usr1.sa_handler = handle_sigusr1;
+	usr1.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &usr1, NULL);
 
-	// If the user supplied a --path PATH argument, then skip
-	// this if-statement. Otherwise, search through the /dev
-	// directory for HID devices until finding the CANbus HID.
-	if (strlen(cfg.path) == 0)
+	if (cfg.all_devices && cfg.emulate)
 	{
-		printf("Searching for CANbus and GPIO modules\n");
+		printf("ERROR: --all can not be combined with --emulate\n");
+		return (-1);
+	}
+	if (cfg.all_devices)
+		return (run_all_devices());
 
-		DIR *dir;
-		struct dirent *ent;
-		char *devdir = "/dev/";
-                int is_gpio = 0;
+	// With --emulate, talk to emulated modules. If the user supplied a
+	// --path PATH argument, then skip the search. Otherwise, ask udev for
+	// the CANbus and GPIO modules attached to the system.
+	if (cfg.emulate)
+	{
+		if (start_emulators() < 0)
+			return (-1);
+	}
+	else if (strlen(cfg.path) == 0)
+	{
+		discover_device_t found[DISCOVER_MAX_DEVICES];
+		int nfound;
 
-		if ((dir = opendir(devdir)) == NULL)
+		printf("Searching for CANbus and GPIO modules\n");
+		if ((nfound = discover_find(found, DISCOVER_MAX_DEVICES, 1)) < 0)
 		{
-			printf("ERROR: Could not search /dev directory: %s",
+			printf("ERROR: Could not search for modules: %s\n",
 				strerror(errno));
 			return (-1);
 		}
-
-		// Loop through all the entries in this directory looking for hidraw
-		//keep_going = 1;
-		//while ((ent = readdir(dir)) != NULL && keep_going)
-		while ((ent = readdir(dir)) != NULL)
-		{
-			// Found a directory entry. Parse it to see if it's hidraw*
-			if (strstr(ent->d_name, "hidraw") != NULL)
-			{
-				// This directory is /dev/hidraw*, so check if it's CANbus.
-				// Make the absolute file path to pass to open()
-				char devpath[strlen(devdir) + strlen(ent->d_name) + 1];
-				memset(devpath, 0, sizeof(devpath));
-				strncpy(devpath, devdir, strlen(devdir));
-				strncat(devpath, ent->d_name, strlen(ent->d_name));
-
-				// Open the device in non-blocking mode
-				if ((fd = open(devpath, O_RDWR|O_NONBLOCK)) < 0)
-				{
-					printf("WARNING: Found potential module at %s, but a "
-						"problem occurred trying to open it: %s\n",
-						devpath, strerror(errno));
-					errno = 0; // Clear error just in case
-					continue;
-				}
-
-				// Device is now open. Get device's raw name
-				memset(buf, 0, sizeof(buf));
-				rc = ioctl(fd, HIDIOCGRAWNAME(sizeof(buf)), buf);
-				if (rc < 0)
-				{
-					close(fd);
-					fd = -1;
-					continue;
-				}
-
-				// Check if this /dev/hidraw* is a CANbus or GPIO device
-				if ((strstr((char *)buf, "CANBus") == NULL) && (strstr((char *)buf, "GPIO") == NULL))
-				{
-					close(fd);
-					fd = -1;
-					continue; // This HID device is NOT a CANbus nor a GPIO device
-				} else { //Drill down to whether it's a GPIO device
-                                     if (strstr((char *)buf, "GPIO") != NULL) {
-					is_gpio = 1;
-				     }
-				}
-
-
-
-				// To make it here, this is a potential CANbus module.
-				// Print information about it to the user.
-				printf("Found device:\n");
-				printf("  %*s: %s\n", PAD, "File path", devpath);
-				printf("  %*s: %s\n", PAD, "Description", buf);
-
-				// Get some other information about this device.
-				// First get the bus type, vendor and product ids
-				struct hidraw_devinfo info;
-				memset(&info, 0, sizeof(info));
-				if ((rc = ioctl(fd, HIDIOCGRAWINFO, &info)) < 0)
-				{
-					printf("  %*s: unknown\n", PAD, "Bus type");
-					printf("  %*s: unknown\n", PAD, "Vendor ID");
-					printf("  %*s: unknown\n", PAD, "Product ID");
-				}
-				else
-				{
-					printf("  %*s: %d (%s)\n", PAD, "Bus type",
-						info.bustype, bus_to_str(info.bustype));
-					printf("  %*s: 0x%04x\n", PAD, "Vendor ID", info.vendor);
-					printf("  %*s: 0x%04x\n", PAD, "Product ID", info.product);
-				}
-
-				// Now get the physical address
-				memset(buf, 0, sizeof(buf));
-				if ((rc = ioctl(fd, HIDIOCGRAWPHYS(256), buf)) < 0)
-					printf("  %*s: unknown\n", PAD, "Phys. Address");
-				else
-					printf("  %*s: %s\n", PAD, "Phys. Address", buf);
-
-				int ans;
-				printf("\nDo you want to use this device (y/n)? ");
-				ans = getchar();
-				flush_stdin();
-				switch (ans)
-				{
-					case 'Y':
-					case 'y':
-						if (is_gpio) {
-							//If we are setting up a GPIO device, copy the descriptor
-							fd_gpio = fd;
-							is_gpio = 0;
-						} else {
-							fd_can = fd;
-						}
-						//keep_going = 0;
-						//break;
-						continue;
-					default:
-						printf("ERROR: Invalid input. Skipping device.\n");
-					case 'N':
-					case 'n':
-						is_gpio = 0;
-						close(fd);
-						fd = -1;
-						continue;
-				}
-			} // if (strstr(ent->d_name, "hidraw") != NULL)
-		} // while ((ent = readdir(dir)) != NULL && keep_going)
-		closedir(dir);
+		dev_can = select_device(found, nfound, DISCOVER_KIND_CAN);
+		dev_gpio = select_device(found, nfound, DISCOVER_KIND_GPIO);
 
 		// Check to make sure a device was found
-		if ((fd_can < 0) && (fd_gpio < 0))
+		if ((dev_can == NULL) && (dev_gpio == NULL))
 		{
 			printf("ERROR: No CANbus or GPIO devices found or none selected\n");
 			return (-1);
 		} else {
-			printf("CANBus Device Status: %s\n", (fd_can < 0) ? "NOT FOUND/UNSELECTED" : "SELECTED");
-			printf("GPIO Device Status: %s\n", (fd_gpio < 0) ? "NOT FOUND/UNSELECTED" : "SELECTED");
+			printf("CANBus Device Status: %s\n", (dev_can == NULL) ? "NOT FOUND/UNSELECTED" : "SELECTED");
+			printf("GPIO Device Status: %s\n", (dev_gpio == NULL) ? "NOT FOUND/UNSELECTED" : "SELECTED");
 		}
 	}
 	else
@@ -248,17 +223,65 @@ int main(int argc, char **argv)
 		switch (ans)
 		{
 			case '1':
-				fd_can = fd;
+				dev_can = canctl_attach(fd);
 				printf("\nCAN Device Chosen.\n");
+				break;
 			case '2':
-				fd_gpio = fd;
+				dev_gpio = canctl_attach(fd);
 				printf("\nGPIO Device Chosen.\n");
+				break;
 			default:
 				printf("ERROR: Please Choose one of the above. Exiting...\n");
+				close(fd);
+				return (-1);
 		}
 	}
 
 	// To get to this point the device MUST be found and MUST be opened.
+	apply_timeout();
+	if (dev_can != NULL)
+	{
+		canctl_set_filter(dev_can, filter);
+		if (cfg.realtime)
+			canctl_set_clock(dev_can, CLOCK_REALTIME);
+		apply_io(dev_can, "the CANBus device");
+	}
+
+	// With --supervise, read and write mode survive the CANbus module
+	// resetting or re-enumerating
+	if (cfg.supervise && dev_can != NULL)
+	{
+		if ((session_can = session_create(dev_can, -1)) == NULL)
+			printf("WARNING: Could not supervise the CANBus device: %s\n",
+				strerror(errno));
+		else
+			session_set_notify(session_can, on_session_event, NULL);
+	}
+	start_metrics(NULL);
+	if (dev_can != NULL && cfg.bench[0] == '\0') // Benchmarks own the fd
+		errmon_can = start_errmon(dev_can, "CANBus device");
+
+	// --bench runs one benchmark, --script writes a file and --gpio-seq or
+	// --gpio-pwm plays GPIO outputs, instead of the menu
+	if (cfg.bench[0] != '\0' || cfg.script[0] != '\0' ||
+		cfg.gpio_seq[0] != '\0' || cfg.gpio_pwm[0] != '\0')
+	{
+		if (cfg.bench[0] != '\0')
+			rc = run_bench();
+		else if (cfg.script[0] != '\0')
+			rc = run_script();
+		else
+			rc = run_gpioseq();
+		errmon_stop(errmon_can);
+		metrics_destroy(metrics);
+		session_destroy(session_can);
+		canctl_close(dev_can);
+		canctl_close(dev_gpio);
+		stop_emulators();
+		canfilter_destroy(filter);
+		return (rc);
+	}
+
 	// Now ask the user what they want to do.
 
 	keep_going = 1;
@@ -285,6 +308,10 @@ int main(int argc, char **argv)
 			"17- Set GPIO pin Data (for OUTPUT pins only)\n"
 			"18- Get GPIO board ID\n"
 			"19- Get IO Module SKU ID (GPIO Device Path)\n"
+			"20- Monitor CANBus and GPIO...\n"
+			"21- Show CANBus receive latency histograms\n"
+			"22- Watch GPIO inputs...\n"
+			"23- Set or toggle one GPIO output pin...\n"
 			"0 - Quit\n"
 			"> ");
 
@@ -307,14 +334,14 @@ int main(int argc, char **argv)
 			case 3: // Get firmware version
 			{
 				printf("\n");
-				const unsigned char *can_fw;
-				const unsigned char *gpio_fw;
+				unsigned char can_fw[CANBUS_FIRMWARE_SIZE];
+				unsigned char gpio_fw[CANBUS_FIRMWARE_SIZE];
 				
-				if(fd_can < 0) { 
+				if(dev_can == NULL) { 
 					printf("CANBus Device Not Selected, skipping\n"); 
 				} 
 				else {
-					if ((can_fw = canctl_get_firmware_version(fd_can)) == NULL)
+					if (canctl_get_firmware_version(dev_can, can_fw) < 0)
 					printf("ERROR: A problem occurred retrieving CANBus firmware version\n");
 					else
 					{
@@ -325,11 +352,11 @@ int main(int argc, char **argv)
 					}
 				}
 
-				if(fd_gpio < 0) { 
+				if(dev_gpio == NULL) { 
 					printf("GPIO Device Not Selected, skipping\n"); 
 				} 
 				else {
-					if ((gpio_fw = canctl_get_firmware_version(fd_gpio)) == NULL)
+					if (canctl_get_firmware_version(dev_gpio, gpio_fw) < 0)
 					printf("ERROR: A problem occurred retrieving GPIO firmware version\n");
 					else
 					{
@@ -344,7 +371,7 @@ int main(int argc, char **argv)
 			}
 			case 4: // Get configuration mode
 				printf("\nCurrent configuration: %s\n",
-					canctl_config_to_string(canctl_get_config(fd_can)));
+					canctl_config_to_string(canctl_get_config(dev_can)));
 				break;
 			case 5: // Set configuration mode...
 				mnu_set_config();
@@ -360,8 +387,8 @@ int main(int argc, char **argv)
 				break;
 			case 9: // Get error status
 			{
-				const unsigned char *estate;
-				if ((estate = canctl_get_error_state(fd_can)) == NULL)
+				unsigned char estate[CANBUS_ERROR_STATE_SIZE];
+				if (canctl_get_error_state(dev_can, estate) < 0)
 					printf("ERROR: A problem occurred\n");
 				else
 				{
@@ -393,7 +420,7 @@ int main(int argc, char **argv)
 				mnu_set_timeout();
 				break;
 			case 13: // Get read timeout
-				printf("Timeout (ms): %d\n", canctl_get_timeout_ms());
+				printf("Timeout (ms): %ld\n", cfg.timeout_ms);
 				break;
 			case 14: // List GPIO pin type settings
                                 list_gpio_pin(PIN_TYPE); 
@@ -413,6 +440,18 @@ int main(int argc, char **argv)
 			case 19: // Get IO Module SKU ID (GPIO Device Path)
 				mnu_gpio_get_iom_or_sku(GET_IOM);
 				break;
+			case 20: // Monitor CANBus and GPIO...
+				mnu_monitor();
+				break;
+			case 21: // Show receive latency histograms
+				print_hists(stdout, dev_can);
+				break;
+			case 22: // Watch GPIO inputs...
+				mnu_gpio_watch();
+				break;
+			case 23: // Set or toggle one GPIO output pin...
+				mnu_gpio_set_one();
+				break;
 			case 0: // Quit
 				keep_going = 0;
 				break;
@@ -423,8 +462,13 @@ int main(int argc, char **argv)
 	} // end while(keep_going)
 
 	printf("Closing devices\n");
-	if(!(fd_can < 0)) close(fd_can);
-	if(!(fd_gpio < 0)) close(fd_gpio);
+	errmon_stop(errmon_can);
+	metrics_destroy(metrics);
+	session_destroy(session_can);
+	canctl_close(dev_can);
+	canctl_close(dev_gpio);
+	stop_emulators();
+	canfilter_destroy(filter);
 	printf("Bye\n");
 	return (0);
 } // main()
@@ -466,7 +510,7 @@ void mnu_set_config(void)
 	while (keep_going)
 	{
 		printf("\nCurrent configuration: %s\n",
-			canctl_config_to_string(canctl_get_config(fd_can)));
+			canctl_config_to_string(canctl_get_config(dev_can)));
 		printf(
 			"\nCONFIGURATION MODES:\n"
 			"1 - Normal\n"
@@ -527,11 +571,11 @@ void mnu_set_config(void)
 	 */
 
 	// Write a new configuration
-	if ((rc = canctl_set_config(fd_can, mode, CANBUS_MAX_BPS)) < 0)
+	if ((rc = canctl_set_config(dev_can, mode, CANBUS_MAX_BPS)) < 0)
 		printf("ERROR: An unknown problem occurred\n");
 
 	printf("Wrote config, now verifying\n");
-	canbus_cfg_t c = canctl_get_config(fd_can);
+	canbus_cfg_t c = canctl_get_config(dev_can);
 	if (c == mode)
 		printf("Success. New configuration: %s\n", canctl_config_to_string(c));
 	else
@@ -546,7 +590,9 @@ void mnu_set_config(void)
  */
 void mnu_read(void)
 {
-	int rc, nbytes;
+	int rc, nbytes, nframes;
+	canbus_frame_t frames[CANBUS_FRAMES_PER_REPORT];
+	struct timespec ts;
 	struct sigaction act, oldact;
 	act.sa_handler = handle_signal_while_reading_or_writing;
 	keep_reading_or_writing = 1;
@@ -573,33 +619,138 @@ void mnu_read(void)
 	// Read from the CANbus module. This do-while loop ends when
 	// the user presses Ctrl+c, or after one iteration if there was
 	// an error setting the signal handler above.
+	// When --rx-thread was given, a background thread drains the module
+	// instead, so a slow terminal can not make the kernel drop reports.
+	if (cfg.rx_thread)
+		read_with_reader_thread();
+	else
+	{
+		do
+		{
+			unsigned char buf[CANBUS_MSG_SIZE];
+			service_signal_requests(NULL);
+			if (session_can != NULL)
+				nbytes = session_read(session_can, buf, sizeof(buf));
+			else
+				nbytes = canctl_read(dev_can, buf, sizeof(buf));
+			if (nbytes < 0)
+			{
+				if (errno == EINTR &&
+					(filter_reload_requested || hist_dump_requested))
+					continue; // SIGHUP or SIGUSR1, not Ctrl+c
+				if (errno != EINTR)
+					printf("ERROR: A problem occurred: %s\n", strerror(errno));
+				else
+					printf("\nLeaving read mode\n");
+				break;
+			}
+			else if (nbytes == 0)
+			{
+				printf("Timeout\n");
+			}
+			else if (canctl_get_rx_time(dev_can, &ts) == 0 &&
+				(nframes = canctl_decode_report(buf, nbytes, frames,
+				CANBUS_FRAMES_PER_REPORT, &ts)) >= 0)
+			{
+				// Drop unwanted IDs before spending any time printing them
+				nframes = canctl_filter_frames(dev_can, frames, nframes);
+				for (int i = 0; i < nframes; i++)
+					print_frame(stdout, &frames[i]);
+			}
+			else
+			{
+				// Not a data report (or a malformed one), so dump it raw
+				printf("Read %d bytes:\n", nbytes);
+				print_bytes(stdout, buf, nbytes, 2);
+			}
+		} while (keep_reading_or_writing);
+	}
+	// Reset the old SIGINT action, if it was originally changed
+	if (rc == 0)
+		sigaction(SIGINT, &oldact, NULL);
+	return;
+} // mnu_read()
+
+/**
+ * canctl_ring_consume() callback for read_with_reader_thread(): prints the
+ * frames straight out of the receive ring.
+ */
+static size_t print_ring_frames(const canbus_frame_t *frames, size_t n,
+	void *arg)
+{
+	for (size_t i = 0; i < n; i++)
+		print_frame(arg, &frames[i]);
+	return (n);
+} // print_ring_frames()
+
+/**
+ * The body of "Read" mode when --rx-thread is given. A background reader
+ * thread drains the CANbus module into a ring of decoded frames, and this
+ * thread prints them at whatever pace the terminal allows. Frames that
+ * arrive while the ring is full are counted and reported on exit.
+ */
+void read_with_reader_thread(void)
+{
+	static canctl_ring_t ring; // Too big for the stack
+	canctl_reader_t *reader;
+	struct timeval tv, *tvptr;
+	fd_set rdset;
+	uint64_t events;
+	ssize_t nbytes;
+	int rc, efd, timeout_ms;
+
+	if ((reader = canctl_reader_start(dev_can, &ring)) == NULL)
+	{
+		printf("ERROR: Could not start the reader thread: %s\n",
+			strerror(errno));
+		return;
+	}
+	efd = canctl_reader_event_fd(reader);
+
 	do
 	{
-		unsigned char buf[CANBUS_MSG_SIZE];
-		memset(buf, 0, sizeof(buf));
-		if ((nbytes = canctl_read(fd_can, buf, sizeof(buf))) < 0)
+		service_signal_requests(NULL);
+		FD_ZERO(&rdset);
+		FD_SET(efd, &rdset);
+		timeout_ms = cfg.timeout_ms;
+		tv.tv_sec = timeout_ms / 1000;
+		tv.tv_usec = (timeout_ms % 1000) * 1000;
+		tvptr = timeout_ms < 0 ? NULL : &tv;
+
+		if ((rc = select(efd+1, &rdset, NULL, NULL, tvptr)) < 0)
 		{
+			if (errno == EINTR &&
+				(filter_reload_requested || hist_dump_requested))
+				continue; // SIGHUP or SIGUSR1, not Ctrl+c
 			if (errno != EINTR)
 				printf("ERROR: A problem occurred: %s\n", strerror(errno));
 			else
 				printf("\nLeaving read mode\n");
 			break;
 		}
-		else if (nbytes == 0)
+		else if (rc == 0)
 		{
 			printf("Timeout\n");
+			continue;
 		}
-		else
+
+		// Clear the event counter, then drain everything that is queued
+		nbytes = read(efd, &events, sizeof(events));
+		(void)nbytes;
+		canctl_ring_consume(&ring, print_ring_frames, stdout, 0);
+
+		if ((rc = canctl_reader_error(reader)) != 0)
 		{
-			printf("Read %d bytes:\n", nbytes);
-			print_bytes(stdout, buf, nbytes, 2);
+			printf("ERROR: A problem occurred: %s\n", strerror(rc));
+			break;
 		}
 	} while (keep_reading_or_writing);
-	// Reset the old SIGINT action, if it was originally changed
-	if (rc == 0)
-		sigaction(SIGINT, &oldact, NULL);
-	return;
-} // mnu_read()
+
+	canctl_reader_stop(reader);
+	if (canctl_ring_overflows(&ring) > 0)
+		printf("WARNING: %lu frames were dropped because the receive "
+			"ring was full\n", canctl_ring_overflows(&ring));
+} // read_with_reader_thread()
 
 /**
  * Enters into "Write" mode -- an interactive mode where the user can execute
@@ -608,13 +759,13 @@ void mnu_read(void)
  */
 void mnu_write(void)
 {
-	int rc, nbytes, c, msg_valid;
+	int rc, nbytes, c, n;
 	size_t i; // For indexing through loops
+	size_t errpos; // Where the user input stopped making sense
 	struct sigaction act, oldact;
-	char userinput[CANBUS_MSG_SIZE * 2]; // Arbitrarily big enough
+	char userinput[WRITE_LINE_SIZE];
 	unsigned char msg[CANBUS_MSG_SIZE]; // CANbus message output
-	char *tok; // A token of user input
-	long num; // The potential number returned from strtol()
+	canbus_frame_t frame;
 	fd_set rdset;
 
 	act.sa_handler = handle_signal_while_reading_or_writing;
@@ -642,10 +793,12 @@ void mnu_write(void)
 			"  - at least 2 bytes\n"
 			"  - no longer than 64 bytes\n"
 			"  - in hex format\n"
-			"  - space-delimited per byte\n"
+			"  - space- or comma-delimited per byte\n"
 			"  - first byte is the report descriptor (the command)\n"
 			"  - second byte begins the payload, or 0 if no payload\n"
 			"e.g. To get the firmware version you would issue 'ec 0'\n"
+			"To send one CAN frame, give its ID, a colon and up to 8 data\n"
+			"bytes instead, e.g. '123: de ad be ef'\n"
 			"\n"
 			"Now entering write mode. Press Ctrl+c to exit...\n");
 	}
@@ -683,8 +836,15 @@ void mnu_write(void)
 			// as soon as it's full, but we continue flush stdin regardless
 			i = 0;
 			while ((c = fgetc(stdin)) != EOF && c != '\n')
-				if (i < sizeof(userinput)-1) // -1 because last byte is '\0'
+				if (i < sizeof(userinput)) // Count what does not fit
 					userinput[i++] = c;
+				else
+					i = sizeof(userinput) + 1;
+			if (c == EOF && i == 0)
+			{ // stdin was closed, e.g. the end of a pipe
+				printf("\nLeaving write mode\n");
+				break;
+			}
 		}
 		else
 		{ // This should never happen with only stdin in the select()
@@ -692,52 +852,47 @@ void mnu_write(void)
 			break;
 		}
 
-		// At this point, the user has entered something and it's in the
-		// buffer, but we don't know what it is exactly, so now loop over
-		// its contents and validate the string is a worthy CAN message.
-		// Only loop over sizeof(msg), however, and not sizeof(userinput)
-		// because it is msg we are ultimately going to send, and thus can
-		// accomodate this amount of data.
-
-		memset(msg, 0, sizeof(msg));
-		msg_valid = 1; // Assume valid until proven otherwise
-		for (i = 0; i < sizeof(msg); i++)
+		if (i > sizeof(userinput))
 		{
-			if (i == 0)
-				// The first time through strtok() needs the input string
-				tok = strtok(userinput, " "); // Parse once a space is found
-			else
-				// All subsequent times strtok() just needs NULL as input
-				tok = strtok(NULL, " ");  // Parse once a space is found
-
-			// If tok is NULL then we're done with the user input
-			if (tok == NULL)
-				break;
-
-			// Get rid of all instances of '\r' and '\n', independently
-			tok[strcspn(tok, "\r\n")] = 0;
+			printf("ERROR: The message is longer than %zu characters.\n",
+				sizeof(userinput));
+			continue;
+		}
 
-			// Do the conversion to hex
-			char *endptr;
-			num = strtol(tok, &endptr, 16);
-			if (endptr == tok || num > 255 || num < 0)
+		// At this point, the user has entered something and it's in the
+		// buffer. Parse it as a CAN frame if it starts with an ID and a
+		// colon, and as the bytes of a report otherwise.
+		if (hex_is_frame(userinput, i))
+		{
+			if (hex_parse_frame(userinput, i, &frame, &errpos) < 0)
 			{
-				printf("ERROR: Index [%ld] '%s' is invalid. Try again.\n",
-					i, tok);
-				msg_valid = 0;
-				break;
+				print_parse_error(userinput, i, errpos, errno);
+				continue;
 			}
-			msg[i] = (unsigned char)num;
-		} // for (i = 0; i<sizeof(msg); i++)
-		// If the message is not valid, loop back to top
-		if (!msg_valid)
+			if (write_frames(&frame, 1) < 0)
+			{
+				printf("ERROR: Could not send frame\n");
+				continue;
+			}
+			printf("Sent 1 frame\n");
+			continue;
+		}
+		if ((n = hex_parse_bytes(userinput, i, msg, sizeof(msg),
+			&errpos)) < 0)
 		{
-			printf("ERROR: The message was not valid.\n");
+			print_parse_error(userinput, i, errpos, errno);
 			continue;
 		}
+		if (n == 0)
+			continue; // Nothing entered
+
 		// Finally, to get to this point we've verified the user input
 		// was correct and put all the bytes into 'msg'. Now write it.
-		if ((nbytes = canctl_write(fd_can, msg, i)) < 0)
+		if (session_can != NULL)
+			nbytes = session_write(session_can, msg, n);
+		else
+			nbytes = canctl_write(dev_can, msg, n);
+		if (nbytes < 0)
 		{
 			printf("ERROR: Could not send message\n");
 			continue;
@@ -802,7 +957,7 @@ void mnu_set_led(void)
 		}
 	}
 
-	if (canctl_set_led(fd_can, mode) < 0)
+	if (canctl_set_led(dev_can, mode) < 0)
 		printf("ERROR: A problem occurred setting the LED mode\n");
 	else
 		printf("Success\n");
@@ -831,217 +986,496 @@ const char *bus_to_str(int bus)
 } // bus_to_str()
 
 /**
- * @todo Document
+ * Prints bytes in hex. On stdout they are laid out in labelled rows of 16
+ * indented by @c pad spaces; other streams get a single line. A report is
+ * rendered with hex.h and written with one fwrite().
+ * @param fs Stream to print to
+ * @param buf Bytes to print
+ * @param len Number of bytes in @c buf
+ * @param pad Spaces before each row on stdout
  */
 void print_bytes(FILE *fs, unsigned char *buf, size_t len, char pad)
 {
-	if (pad < 0) pad *= -1;
-	char spaces[pad+1];
-	memset(spaces, ' ', sizeof(spaces));
-	spaces[sizeof(spaces)-1] = 0;
+	char out[4096];
+	size_t chunk, n;
 
-	size_t ncols = 16;
-	size_t nrows = len / ncols;
-	size_t rem = len % ncols;
-	if (rem > 0) nrows++;
+	if (pad < 0) pad *= -1;
 
 	// @todo Add color to stdout output
 	if (fs == stdout)
 	{
-		for (size_t r = 0; r < nrows; r++)
+		// Long buffers such as report descriptors go out in chunks of rows
+		chunk = sizeof(out) / HEX_ROW_SIZE(pad) * HEX_ROW_BYTES;
+		for (size_t i = 0; i < len; i += chunk)
 		{
-			printf("%s[%02ld-%02ld] ", spaces, r*ncols, r*ncols + ncols - 1);
-			size_t i;
-			for (size_t c = 0; c < ncols; c++)
-			{
-				i = r * ncols + c;
-				if (i < len)
-					printf("%02x ", buf[i]);
-			}
-			printf("\n");
+			n = len - i < chunk ? len - i : chunk;
+			fwrite(out, 1, hex_format_rows(out, sizeof(out), &buf[i], n, i,
+				pad), fs);
 		}
 	}
 	else
 	{
-		for (size_t i = 0; i < len; i++)
-			fprintf(fs, "%02x ", buf[i]);
-		if (len > 0)
-			fprintf(fs, "\n");
+		chunk = (sizeof(out) - 1) / 3;
+		for (size_t i = 0; i < len; i += chunk)
+		{
+			n = len - i < chunk ? len - i : chunk;
+			n = hex_format_bytes(out, sizeof(out), &buf[i], n);
+			if (i + chunk >= len)
+				out[n++] = '\n';
+			fwrite(out, 1, n, fs);
+		}
 	}
 } // print_bytes()
 
 /**
- * @todo Document
+ * Prints one decoded CAN frame on a single line: the ID (3 hex digits for
+ * standard IDs, 8 for extended), the DLC and the data payload.
+ * @param fs Stream to print to
+ * @param frame Frame to print
+ */
+void print_frame(FILE *fs, const canbus_frame_t *frame)
+{
+	char out[HEX_FRAME_SIZE];
+
+	fwrite(out, 1, hex_format_frame(out, sizeof(out), frame), fs);
+} // print_frame()
+
+/**
+ * Prints what udev knows about a HID: its device node, name, IDs and
+ * physical address.
+ * @param dev The device to print
+ */
+void print_device(const discover_device_t *dev)
+{
+	printf("  %*s: %s\n", PAD, "File path", dev->devnode);
+	printf("  %*s: %s\n", PAD, "Description", dev->name);
+	printf("  %*s: %d (%s)\n", PAD, "Bus type",
+		dev->bustype, bus_to_str(dev->bustype));
+	printf("  %*s: 0x%04x\n", PAD, "Vendor ID", dev->vendor);
+	printf("  %*s: 0x%04x\n", PAD, "Product ID", dev->product);
+	printf("  %*s: %s\n", PAD, "Phys. Address",
+		dev->phys[0] ? dev->phys : "unknown");
+} // print_device()
+
+/**
+ * Picks the module of the given kind to use. A lone module is used without
+ * asking; if there are several, the user is asked about each in turn.
+ * @param found Modules returned by discover_find()
+ * @param nfound Number of elements in @c found
+ * @param kind Which kind of module to pick
+ * @returns Returns the opened module, or NULL if none was found or chosen
+ */
+canctl_dev_t *select_device(const discover_device_t *found, int nfound,
+	discover_kind_t kind)
+{
+	int count = 0, ans;
+	canctl_dev_t *dev;
+
+	for (int i = 0; i < nfound; i++)
+		count += found[i].kind == kind;
+
+	for (int i = 0; i < nfound; i++)
+	{
+		if (found[i].kind != kind)
+			continue;
+		printf("Found %s device:\n", discover_kind_to_string(kind));
+		print_device(&found[i]);
+		if (count > 1)
+		{
+			printf("\nDo you want to use this device (y/n)? ");
+			ans = getchar();
+			flush_stdin();
+			if (ans != 'y' && ans != 'Y')
+			{
+				if (ans != 'n' && ans != 'N')
+					printf("ERROR: Invalid input. Skipping device.\n");
+				continue;
+			}
+		}
+		if ((dev = canctl_open(found[i].devnode)) == NULL)
+		{
+			printf("WARNING: Could not open %s: %s\n", found[i].devnode,
+				strerror(errno));
+			continue;
+		}
+		return (dev);
+	}
+	return (NULL);
+} // select_device()
+
+/**
+ * Lists every HID on the system as reported by udev, including each one's
+ * report descriptor if the device node can be opened.
  */
 void list_hids(void)
 {
-	int rc, tmpfd;
-	DIR *dir;
-	struct dirent *ent;
-	char *devdir = "/dev/";
-	unsigned char buf[256];
+	int rc, tmpfd, nfound;
+	discover_device_t found[DISCOVER_MAX_DEVICES];
 
-	if ((dir = opendir(devdir)) == NULL)
+	if ((nfound = discover_find(found, DISCOVER_MAX_DEVICES, 0)) < 0)
 	{
-		printf("ERROR: Could not search /dev directory: %s",
-			strerror(errno));
+		printf("ERROR: Could not search for HIDs: %s\n", strerror(errno));
 		return;
 	}
 
-	// Loop through all the entries in this directory looking for hidraw
-	while ((ent = readdir(dir)) != NULL)
+	for (int i = 0; i < nfound; i++)
 	{
-		// Found a directory entry. Parse it to see if it's hidraw*
-		if (strstr(ent->d_name, "hidraw") != NULL)
+		printf("\nFound device:\n");
+		print_device(&found[i]);
+
+		// The report descriptor needs the device node itself
+		if ((tmpfd = open(found[i].devnode, O_RDONLY|O_NONBLOCK)) < 0)
 		{
-			// This directory is /dev/hidraw*
-			char devpath[strlen(devdir) + strlen(ent->d_name) + 1];
-			memset(devpath, 0, sizeof(devpath));
-			strncpy(devpath, devdir, strlen(devdir));
-			strncat(devpath, ent->d_name, strlen(ent->d_name));
-			// Open the device in non-blocking mode
-			if ((tmpfd = open(devpath, O_RDONLY|O_NONBLOCK)) < 0)
-			{
-				printf("WARNING: Found HID at %s, but could not open it: %s\n",
-					devpath, strerror(errno));
-				errno = 0; // Clear error just in case
-				continue;
-			}
-			// Device is now open. Get device's raw name
-			memset(buf, 0, sizeof(buf));
-			rc = ioctl(tmpfd, HIDIOCGRAWNAME(sizeof(buf)), buf);
-			if (rc < 0)
-			{
-				close(tmpfd);
-				tmpfd = -1;
-				continue;
-			}
-			// Print information to the user.
-			printf("\nFound device:\n");
-			printf("  %*s: %s\n", PAD, "File path", devpath);
-			printf("  %*s: %s\n", PAD, "Description", buf);
-			// Get some other information about this device.
-			// First get the bus type, vendor and product ids
-			struct hidraw_devinfo info;
-			memset(&info, 0, sizeof(info));
-			if ((rc = ioctl(tmpfd, HIDIOCGRAWINFO, &info)) < 0)
-			{
-				printf("  %*s: unknown\n", PAD, "Bus type");
-				printf("  %*s: unknown\n", PAD, "Vendor ID");
-				printf("  %*s: unknown\n", PAD, "Product ID");
-			}
-			else
-			{
-				printf("  %*s: %d (%s)\n", PAD, "Bus type",
-					info.bustype, bus_to_str(info.bustype));
-				printf("  %*s: 0x%04x\n", PAD, "Vendor ID", info.vendor);
-				printf("  %*s: 0x%04x\n", PAD, "Product ID", info.product);
-			}
-			// Now get the physical address
-			memset(buf, 0, sizeof(buf));
-			if ((rc = ioctl(tmpfd, HIDIOCGRAWPHYS(256), buf)) < 0)
-				printf("  %*s: unknown\n", PAD, "Phys. Address");
-			else
-				printf("  %*s: %s\n", PAD, "Phys. Address", buf);
+			printf("  %*s: unknown (%s)\n", PAD, "Rpt Desc",
+				strerror(errno));
+			continue;
+		}
 
-			// Now get the report descriptor size
-			int desc_size = 0;
-			if ((rc = ioctl(tmpfd, HIDIOCGRDESCSIZE, &desc_size)) < 0)
-				printf("  %*s: unknown\n", PAD, "Rpt Desc Size");
-			else
-				printf("  %*s: %d\n", PAD, "Rpt Desc Size", desc_size);
+		// Now get the report descriptor size
+		int desc_size = 0;
+		if ((rc = ioctl(tmpfd, HIDIOCGRDESCSIZE, &desc_size)) < 0)
+			printf("  %*s: unknown\n", PAD, "Rpt Desc Size");
+		else
+			printf("  %*s: %d\n", PAD, "Rpt Desc Size", desc_size);
 
-			// Now get the report descriptor
-			struct hidraw_report_descriptor rpt_desc;
-			rpt_desc.size = desc_size;
-			if ((rc = ioctl(tmpfd, HIDIOCGRDESC, &rpt_desc)) < 0)
-				printf("  %*s: unknown\n", PAD, "Rpt Desc");
-			else
-			{
-				printf("  %*s:\n", PAD, "Rpt Descriptor");
-				print_bytes(stdout, rpt_desc.value, rpt_desc.size, 4);
-			}
-		} // if (strstr(ent->d_name, "hidraw") != NULL)
-	} // while ((ent = readdir(dir)) != NULL && keep_going)
-	closedir(dir);
+		// Now get the report descriptor
+		struct hidraw_report_descriptor rpt_desc;
+		rpt_desc.size = desc_size;
+		if ((rc = ioctl(tmpfd, HIDIOCGRDESC, &rpt_desc)) < 0)
+			printf("  %*s: unknown\n", PAD, "Rpt Desc");
+		else
+		{
+			printf("  %*s:\n", PAD, "Rpt Descriptor");
+			print_bytes(stdout, rpt_desc.value, rpt_desc.size, 4);
+		}
+		close(tmpfd);
+	}
 } // list_hids()
 
 /**
- * Presents a menu to the user to change the current read timeout.
+ * Tells the user what the --supervise session is doing.
  */
-void mnu_set_timeout(void)
+void on_session_event(session_t *s, session_event_t event, void *arg)
 {
-	int rc;
-	int current_timeout_ms = canctl_get_timeout_ms();
-	int userinput;
-	while (1)
+	(void)arg;
+	switch (event)
 	{
-		printf(
-			"\nSET TIMEOUT:\n"
-			"- Current timeout (ms): %d\n"
-			"> ", current_timeout_ms);
-		if ((rc = scanf("%d.*[^\n]", &userinput)) == EOF || rc == 0)
-		{ // An error occurred or no matches were found
-			flush_stdin();
-			printf("ERROR: Invalid value. Try again.\n");
-			continue;
-		}
-		canctl_set_timeout_ms(userinput);
-		// cfg.timeout_ms = userinput;
-		printf("Success\n");
-		break;
+		case SESSION_EVENT_LOST:
+			printf("WARNING: CANBus device lost. Reconnecting (Ctrl+c to "
+				"give up)...\n");
+			break;
+		case SESSION_EVENT_RESTORED:
+			printf("CANBus device is back (reconnect #%lu)\n",
+				session_reconnects(s));
+			break;
+		case SESSION_EVENT_GAVE_UP:
+			printf("ERROR: CANBus device did not come back\n");
+			break;
 	}
-} // mnu_set_timeout()
+} // on_session_event()
 
 /**
- * Performs a USB self test.
+ * Runs the benchmark named by --bench with the --count, --depth, --rate and
+ * --json settings. Ctrl+c (SIGINT) ends the run early but still prints results.
+ * @returns Returns 0 on success, -1 on error
  */
-void mnu_usb_self_test(void)
+int run_bench(void)
 {
 	int rc;
-	unsigned char buf_tx[CANBUS_MSG_SIZE];
-	unsigned char buf_rx[CANBUS_MSG_SIZE];
-	unsigned long num_bins = 256;
-	unsigned long num_rand = (unsigned long) RAND_MAX + 1;
-	unsigned long bin_size = num_rand / num_bins;
-	unsigned long defect = num_rand % num_bins;
+	bench_opts_t opts;
+	struct sigaction act, oldact;
 
-	printf("\n");
+	memset(&opts, 0, sizeof(opts));
+	opts.count = cfg.bench_count;
+	opts.depth = cfg.bench_depth;
+	opts.rate = cfg.bench_rate;
+	opts.speed = cfg.bus_speed;
+	opts.timeout_ms = cfg.timeout_ms;
+	opts.json = cfg.json;
+	opts.stop = &stop_requested;
 
-	// Fill up the buffer with random bytes
-	memset(buf_tx, 0, sizeof(buf_tx));
-	buf_tx[0] = CANBUS_OUT_USB_TEST;
-	srand(time(NULL));
-	for (size_t i = 1; i < sizeof(buf_tx); i++)
+	if (dev_can == NULL && strcmp(cfg.bench, "hexfmt") != 0)
 	{
-		long x;
-		do
-		{
-			x = random();
-		} while (num_rand - defect <= (unsigned long)x);
-		buf_tx[i] = (unsigned char)(x / bin_size);
+		printf("ERROR: The %s benchmark needs the CANBus device\n", cfg.bench);
+		return (-1);
 	}
-	printf("Writing %ld random bytes:\n", sizeof(buf_tx));
-	print_bytes(stdout, buf_tx, sizeof(buf_tx), 2);
 
-	// Write
-	if ((rc = canctl_write(fd_can, buf_tx, sizeof(buf_tx))) < 0)
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = handle_signal_while_benchmarking;
+	sigaction(SIGINT, &act, &oldact);
+	if (strcmp(cfg.bench, "usb") == 0)
+		rc = bench_usb_echo(dev_can, &opts, stdout);
+	else if (strcmp(cfg.bench, "can") == 0)
+		rc = bench_can_loopback(dev_can, &opts, stdout);
+	else if (strcmp(cfg.bench, "hexfmt") == 0)
+		rc = bench_hexfmt(&opts, stdout);
+	else
 	{
-		printf("ERROR: A problem occurred: %s\n", strerror(errno));
-		return;
+		printf("ERROR: Unknown benchmark '%s'\n", cfg.bench);
+		rc = -1;
 	}
-	else if (rc != sizeof(buf_tx))
+	sigaction(SIGINT, &oldact, NULL);
+	return (rc);
+} // run_bench()
+
+/**
+ * Handles SIGINT during a benchmark by asking it to stop and report.
+ */
+void handle_signal_while_benchmarking(int signo)
+{
+	(void)signo;
+	stop_requested = 1;
+} // handle_signal_while_benchmarking()
+
+/**
+ * Loads the acceptance filter named by --filter and arranges for SIGHUP to
+ * reload it.
+ * @returns Returns 0 on success, -1 on error
+ */
+int load_filter(void)
+{
+	int line;
+	struct sigaction act;
+
+	if ((filter = canfilter_load(cfg.filter_path, &line)) == NULL)
 	{
-		printf("ERROR: Wrote an unexected number of bytes: "
-			"expected %ld, wrote %d\n", sizeof(buf_tx), rc);
-		return;
+		if (line > 0)
+			printf("ERROR: %s:%d: Invalid filter rule\n", cfg.filter_path,
+				line);
+		else
+			printf("ERROR: Could not load filter %s: %s\n", cfg.filter_path,
+				strerror(errno));
+		return (-1);
 	}
 
-	// Read
-	memset(buf_rx, 0, sizeof(buf_rx));
-	if ((rc = canctl_read(fd_can, buf_rx, sizeof(buf_rx))) < 0)
-	{
-		printf("ERROR: A problem occurred: %s\n", strerror(errno));
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = handle_sighup;
+	act.sa_flags = SA_RESTART; // Menus keep working; select() still wakes
+	if (sigaction(SIGHUP, &act, NULL) < 0)
+		printf("WARNING: Could not set SIGHUP handler. The filter can not "
+			"be reloaded.\n");
+	return (0);
+} // load_filter()
+
+/**
+ * Reloads the acceptance filter if SIGHUP asked for it and swaps it into
+ * every open CANbus module. If the file is now invalid, the old filter is
+ * kept.
+ * @param mgr The --all mode manager, or NULL outside of --all mode
+ */
+void reload_filter(canmgr_t *mgr)
+{
+	canfilter_t *fresh;
+	int line;
+
+	if (!filter_reload_requested)
+		return;
+	filter_reload_requested = 0;
+
+	if ((fresh = canfilter_load(cfg.filter_path, &line)) == NULL)
+	{
+		printf("WARNING: Could not reload filter %s (line %d), keeping the "
+			"old one\n", cfg.filter_path, line);
+		return;
+	}
+	if (dev_can != NULL)
+		canctl_set_filter(dev_can, fresh);
+	for (int i = 0; mgr != NULL && i < canmgr_count(mgr); i++)
+		if (canmgr_get(mgr, i) != NULL)
+			canctl_set_filter(canmgr_get(mgr, i)->dev, fresh);
+	// No receive path can be using the old filter any more
+	canfilter_destroy(filter);
+	filter = fresh;
+	printf("Reloaded filter %s\n", cfg.filter_path);
+} // reload_filter()
+
+/**
+ * Prints the CANbus module's receive latency histograms. Inter-arrival time
+ * shows how fast the USB path delivers reports; select-to-read time shows
+ * how long the read itself takes once the report is there.
+ * @param fs Stream to print to
+ * @param dev The CANbus module's handle
+ */
+void print_hists(FILE *fs, canctl_dev_t *dev)
+{
+	canctl_hist_t hist;
+
+	if (dev == NULL)
+		return;
+	canctl_get_hist(dev, CANCTL_HIST_INTERARRIVAL, &hist);
+	print_hist(fs, "Report inter-arrival", &hist);
+	canctl_get_hist(dev, CANCTL_HIST_SELECT_TO_READ, &hist);
+	print_hist(fs, "Select-to-read", &hist);
+} // print_hists()
+
+/**
+ * Prints one latency histogram with a bar per non-empty bucket.
+ * @param fs Stream to print to
+ * @param name Title of the histogram
+ * @param hist The histogram to print
+ */
+void print_hist(FILE *fs, const char *name, const canctl_hist_t *hist)
+{
+	unsigned long peak = 0;
+
+	fprintf(fs, "\n%s (us): count %lu, mean %lu, max %lu\n", name,
+		hist->count, hist->count ? hist->sum_us / hist->count : 0,
+		hist->max_us);
+	for (int i = 0; i < CANCTL_HIST_BUCKETS; i++)
+		if (hist->buckets[i] > peak)
+			peak = hist->buckets[i];
+	for (int i = 0; i < CANCTL_HIST_BUCKETS; i++)
+	{
+		if (hist->buckets[i] == 0)
+			continue;
+		fprintf(fs, "  %10lu - %-10lu %10lu ",
+			i == 0 ? 0 : 1UL << (i - 1), (1UL << i) - 1, hist->buckets[i]);
+		for (unsigned long j = 0; j < (hist->buckets[i] * 40 + peak - 1) / peak;
+			j++)
+			fputc('#', fs);
+		fputc('\n', fs);
+	}
+} // print_hist()
+
+/**
+ * Does what SIGHUP and SIGUSR1 asked for. Called from the receive loops,
+ * never from the signal handlers themselves.
+ * @param mgr The --all mode manager, or NULL outside of --all mode
+ */
+void service_signal_requests(canmgr_t *mgr)
+{
+	reload_filter(mgr);
+	if (!hist_dump_requested)
+		return;
+	hist_dump_requested = 0;
+	print_hists(stdout, dev_can);
+	for (int i = 0; mgr != NULL && i < canmgr_count(mgr); i++)
+	{
+		if (canmgr_get(mgr, i) == NULL ||
+			canmgr_get(mgr, i)->kind != CANMGR_KIND_CAN)
+			continue;
+		printf("\n[%d] %s:", i, canmgr_get(mgr, i)->path);
+		print_hists(stdout, canmgr_get(mgr, i)->dev);
+	}
+} // service_signal_requests()
+
+/**
+ * Handles SIGUSR1 by asking the receive loop to dump the histograms.
+ */
+void handle_sigusr1(int signo)
+{
+	(void)signo;
+	hist_dump_requested = 1;
+} // handle_sigusr1()
+
+/**
+ * Handles SIGHUP by asking the receive loop to reload the filter.
+ */
+void handle_sighup(int signo)
+{
+	(void)signo;
+	filter_reload_requested = 1;
+} // handle_sighup()
+
+/**
+ * Applies the read timeout in cfg.timeout_ms to every open module.
+ */
+void apply_timeout(void)
+{
+	if (dev_can != NULL)
+		canctl_set_timeout_ms(dev_can, cfg.timeout_ms);
+	if (dev_gpio != NULL)
+		canctl_set_timeout_ms(dev_gpio, cfg.timeout_ms);
+} // apply_timeout()
+
+/**
+ * Switches a CANbus module to the io_uring backend if --io-uring was given.
+ * @param dev The CANbus module's handle
+ * @param name What to call the module in messages
+ */
+void apply_io(canctl_dev_t *dev, const char *name)
+{
+	if (cfg.io_uring && canctl_set_io(dev, CANCTL_IO_URING) < 0)
+		printf("WARNING: Could not use io_uring for %s, using read() and "
+			"write(): %s\n", name, strerror(errno));
+} // apply_io()
+
+/**
+ * Presents a menu to the user to change the current read timeout.
+ */
+void mnu_set_timeout(void)
+{
+	int rc;
+	int current_timeout_ms = cfg.timeout_ms;
+	int userinput;
+	while (1)
+	{
+		printf(
+			"\nSET TIMEOUT:\n"
+			"- Current timeout (ms): %d\n"
+			"> ", current_timeout_ms);
+		if ((rc = scanf("%d.*[^\n]", &userinput)) == EOF || rc == 0)
+		{ // An error occurred or no matches were found
+			flush_stdin();
+			printf("ERROR: Invalid value. Try again.\n");
+			continue;
+		}
+		cfg.timeout_ms = userinput;
+		apply_timeout();
+		printf("Success\n");
+		break;
+	}
+} // mnu_set_timeout()
+
+/**
+ * Performs a USB self test.
+ */
+void mnu_usb_self_test(void)
+{
+	int rc;
+	unsigned char buf_tx[CANBUS_MSG_SIZE];
+	unsigned char buf_rx[CANBUS_MSG_SIZE];
+	unsigned long num_bins = 256;
+	unsigned long num_rand = (unsigned long) RAND_MAX + 1;
+	unsigned long bin_size = num_rand / num_bins;
+	unsigned long defect = num_rand % num_bins;
+
+	printf("\n");
+
+	// Fill up the buffer with random bytes
+	memset(buf_tx, 0, sizeof(buf_tx));
+	buf_tx[0] = CANBUS_OUT_USB_TEST;
+	srand(time(NULL));
+	for (size_t i = 1; i < sizeof(buf_tx); i++)
+	{
+		long x;
+		do
+		{
+			x = random();
+		} while (num_rand - defect <= (unsigned long)x);
+		buf_tx[i] = (unsigned char)(x / bin_size);
+	}
+	printf("Writing %ld random bytes:\n", sizeof(buf_tx));
+	print_bytes(stdout, buf_tx, sizeof(buf_tx), 2);
+
+	// Write
+	if ((rc = canctl_write(dev_can, buf_tx, sizeof(buf_tx))) < 0)
+	{
+		printf("ERROR: A problem occurred: %s\n", strerror(errno));
+		return;
+	}
+	else if (rc != sizeof(buf_tx))
+	{
+		printf("ERROR: Wrote an unexected number of bytes: "
+			"expected %ld, wrote %d\n", sizeof(buf_tx), rc);
+		return;
+	}
+
+	// Read
+	memset(buf_rx, 0, sizeof(buf_rx));
+	if ((rc = canctl_read(dev_can, buf_rx, sizeof(buf_rx))) < 0)
+	{
+		printf("ERROR: A problem occurred: %s\n", strerror(errno));
 		return;
 	}
 	else if (rc != sizeof(buf_rx))
@@ -1100,7 +1534,7 @@ void mnu_can_loopback_test()
 	printf("\n");
 
 	// Step 1 and 2
-	if (canctl_set_config(fd_can, CANBUS_CFG_CONFIGURATION, CANBUS_MAX_BPS) < 0)
+	if (canctl_set_config(dev_can, CANBUS_CFG_CONFIGURATION, CANBUS_MAX_BPS) < 0)
 	{
 		printf("ERROR: A problem occurred setting the configuration to %s\n",
 			canctl_config_to_string(CANBUS_CFG_CONFIGURATION));
@@ -1108,36 +1542,31 @@ void mnu_can_loopback_test()
 	}
 
 	// Step 3 and 4
-	if (canctl_set_config(fd_can, CANBUS_CFG_LOOPBACK, CANBUS_MAX_BPS) < 0)
+	if (canctl_set_config(dev_can, CANBUS_CFG_LOOPBACK, CANBUS_MAX_BPS) < 0)
 	{
 		printf("ERROR: A problem occurred setting the configuration to %s\n",
 			canctl_config_to_string(CANBUS_CFG_LOOPBACK));
 		return;
 	}
 
+	// Send one frame with a 29-bit ID and an 8 byte payload
+	canbus_frame_t frame = {
+		.id = 0x1fffffff,
+		.ext = 1,
+		.dlc = 8,
+		.data = { 0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01 }
+	};
 	memset(buf_tx, 0, sizeof(buf_tx));
-	buf_tx[0] = CANBUS_OUT_SEND_DATA;
-	buf_tx[1] = 0x01; // Send one frame
-	buf_tx[2] = 0x1d; // Start of frame, 29-bit ID size
-	buf_tx[3] = 0x1f; // ID[31:24]
-	buf_tx[4] = 0xff; // ID[23:16]
-	buf_tx[5] = 0xff; // ID[15:8]
-	buf_tx[6] = 0xff; // ID[7:0]
-	buf_tx[7] = 0x08; // Data payload size, 8 bytes
-	buf_tx[8] = 0x08; // Data
-	buf_tx[9] = 0x07; // Data
-	buf_tx[10] = 0x06; // Data
-	buf_tx[11] = 0x05; // Data
-	buf_tx[12] = 0x04; // Data
-	buf_tx[13] = 0x03; // Data
-	buf_tx[14] = 0x02; // Data
-	buf_tx[15] = 0x01; // Data
-	txlen = 16;
+	if ((txlen = canctl_encode_frames(buf_tx, sizeof(buf_tx), &frame, 1)) < 0)
+	{
+		printf("ERROR: Could not encode the test frame\n");
+		return;
+	}
 	printf("Writing %d bytes:\n", txlen);
 	print_bytes(stdout, buf_tx, txlen, 2);
 
 	// Step 5 - Write
-	if ((rc = canctl_write(fd_can, buf_tx, txlen)) < 0)
+	if ((rc = canctl_write(dev_can, buf_tx, txlen)) < 0)
 	{
 		printf("ERROR: A problem occurred: %s\n", strerror(errno));
 		return;
@@ -1151,7 +1580,7 @@ void mnu_can_loopback_test()
 
 	// Step 6 - Read
 	memset(buf_rx, 0, sizeof(buf_rx));
-	if ((rc = canctl_read(fd_can, buf_rx, sizeof(buf_rx))) < 0)
+	if ((rc = canctl_read(dev_can, buf_rx, sizeof(buf_rx))) < 0)
 	{
 		printf("ERROR: A problem occurred: %s\n", strerror(errno));
 		return;
@@ -1181,7 +1610,7 @@ void mnu_can_loopback_test()
 	printf("Success. Bytes are valid.\n");
 
 	// Step 7 and 8
-	if (canctl_set_config(fd_can, CANBUS_CFG_CONFIGURATION, CANBUS_MAX_BPS) < 0)
+	if (canctl_set_config(dev_can, CANBUS_CFG_CONFIGURATION, CANBUS_MAX_BPS) < 0)
 	{
 		printf("ERROR: A problem occurred setting the configuration to %s\n",
 			canctl_config_to_string(CANBUS_CFG_CONFIGURATION));
@@ -1189,7 +1618,7 @@ void mnu_can_loopback_test()
 	}
 
 	// Step 9 and 10
-	if (canctl_set_config(fd_can, CANBUS_CFG_NORMAL, CANBUS_MAX_BPS) < 0)
+	if (canctl_set_config(dev_can, CANBUS_CFG_NORMAL, CANBUS_MAX_BPS) < 0)
 	{
 		printf("ERROR: A problem occurred setting the configuration to %s\n",
 			canctl_config_to_string(CANBUS_CFG_NORMAL));
@@ -1262,7 +1691,7 @@ void mnu_gpio_set_pin(int type_or_data)
 	} // end while (keep_going)
 
 	// 
-	if (gpio_set_pin(fd_gpio, type_or_data, buf) < 0)
+	if (gpio_set_pin(dev_gpio, type_or_data, buf) < 0)
 	{
 		(type_or_data == PIN_TYPE) ? printf("ERROR: A problem occurred setting the GPIO pin types.\n") : printf("ERROR: A problem occurred setting the GPIO pin Data.\n");
 		return;
@@ -1274,7 +1703,7 @@ void list_gpio_pin(int type_or_data) {
 
 	unsigned char buf[GPIO_PIN_COUNT];
 	memset(buf, 0, sizeof(buf));
-	if(gpio_read_pin(fd_gpio, type_or_data, buf) < 0) {
+	if(gpio_read_pin(dev_gpio, type_or_data, buf) < 0) {
 		printf("ERROR: A problem occurred retrieving GPIO pin status.\n");
 		return;
         
@@ -1306,7 +1735,7 @@ void mnu_gpio_get_iom_or_sku(int op_select) {
 unsigned char buf[CANBUS_MSG_SIZE];
 
 memset(buf, 0, sizeof(buf));
-	if(gpio_get_iom_or_sku(fd_gpio, op_select, buf) < 0) {
+	if(gpio_get_iom_or_sku(dev_gpio, op_select, buf) < 0) {
 		printf("ERROR: A problem occurred getting board ID or IOM SKU.\n");
 		return;
 	} else {
@@ -1315,3 +1744,946 @@ memset(buf, 0, sizeof(buf));
 	}
 
 }//end mnu_gpio_get_iom_or_sku()
+
+/**
+ * Drives or flips one GPIO output pin, leaving the others alone. Unlike
+ * mnu_gpio_set_pin(), this takes one transaction and no walk through the
+ * other seven pins.
+ */
+void mnu_gpio_set_one(void)
+{
+	int rc, pin, action;
+
+	if (dev_gpio == NULL)
+	{
+		printf("GPIO Device Not Selected\n");
+		return;
+	}
+	printf("\nPin (1-%d): ", GPIO_PIN_COUNT);
+	if ((rc = scanf("%d", &pin)) == EOF || rc == 0 || pin < 1 ||
+		pin > GPIO_PIN_COUNT)
+	{
+		flush_stdin();
+		printf("ERROR: Invalid pin\n");
+		return;
+	}
+	printf("Set Pin [%d] (0 = Set to 0/LOW, 1 = Set to 1/HIGH, 2 = Toggle, "
+		"5 = Exit): ", pin);
+	if ((rc = scanf("%d", &action)) == EOF || rc == 0)
+	{
+		flush_stdin();
+		action = -1;
+	}
+	switch (action)
+	{
+		case 0:
+		case 1:
+			rc = gpio_write_pins(dev_gpio, GPIO_PIN_BIT(pin),
+				action ? GPIO_PIN_BIT(pin) : 0);
+			break;
+		case 2:
+			rc = gpio_toggle_pins(dev_gpio, GPIO_PIN_BIT(pin));
+			break;
+		case 5:
+			return;
+		default:
+			printf("ERROR: Invalid input\n");
+			return;
+	}
+	if (rc < 0)
+		printf("ERROR: A problem occurred setting the GPIO pin Data.\n");
+	else
+		printf("Pin %d updated\n", pin);
+} // mnu_gpio_set_one()
+
+/**
+ * Prints every edge on the GPIO module's pins until the user presses
+ * Ctrl+c (SIGINT). The pins are polled at the --gpio-poll rates.
+ */
+void mnu_gpio_watch(void)
+{
+	gpiowatch_opts_t opts;
+	gpiowatch_event_t events[GPIOWATCH_QUEUE_SIZE];
+	gpiowatch_stats_t stats;
+	gpiowatch_t *w;
+	struct pollfd pfd;
+	struct sigaction act, oldact;
+	uint64_t count;
+	size_t n;
+	int rc;
+
+	if (dev_gpio == NULL)
+	{
+		printf("GPIO Device Not Selected\n");
+		return;
+	}
+	memset(&opts, 0, sizeof(opts));
+	opts.min_interval_us = cfg.gpio_min_us;
+	opts.max_interval_us = cfg.gpio_max_us;
+	if ((w = gpiowatch_start(dev_gpio, &opts, NULL, NULL)) == NULL)
+	{
+		printf("ERROR: Could not watch the GPIO pins: %s\n",
+			strerror(errno));
+		return;
+	}
+
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = handle_signal_while_reading_or_writing;
+	keep_reading_or_writing = 1;
+	if ((rc = sigaction(SIGINT, &act, &oldact)) < 0)
+	{
+		printf("ERROR: Could not set stop signal for watch mode\n");
+		gpiowatch_stop(w);
+		return;
+	}
+	printf("Now watching GPIO inputs. Press Ctrl+c to exit...\n");
+
+	pfd.fd = gpiowatch_event_fd(w);
+	pfd.events = POLLIN;
+	while (keep_reading_or_writing)
+	{
+		if (poll(&pfd, 1, -1) < 0)
+		{
+			if (errno != EINTR)
+				printf("ERROR: A problem occurred: %s\n", strerror(errno));
+			continue;
+		}
+		if (read(pfd.fd, &count, sizeof(count)) < 0)
+			continue;
+		while ((n = gpiowatch_read(w, events, GPIOWATCH_QUEUE_SIZE)) > 0)
+		{
+			for (size_t i = 0; i < n; i++)
+				printf("  (%ld.%06ld) GPIO pin %d: %s (within %lu us)\n",
+					(long)events[i].ts.tv_sec, events[i].ts.tv_nsec / 1000,
+					events[i].pin, events[i].level ? "0->1 RISING" :
+					"1->0 FALLING", events[i].window_us);
+		}
+		if ((rc = gpiowatch_error(w)) != 0)
+		{
+			printf("ERROR: GPIO device stopped responding: %s\n",
+				strerror(rc));
+			break;
+		}
+	}
+	sigaction(SIGINT, &oldact, NULL);
+
+	gpiowatch_get_stats(w, &stats);
+	gpiowatch_stop(w);
+	printf("\nLeaving watch mode: %lu polls, %lu edges", stats.polls,
+		stats.events);
+	if (stats.overflows > 0)
+		printf(", %lu lost", stats.overflows);
+	printf("\n");
+} // mnu_gpio_watch()
+
+/**
+ * Monitor mode handler: the CANbus module has a report waiting. mnu_monitor()
+ * claims the module's reads, so --errmon replies arrive here as well.
+ */
+static void monitor_on_can(evloop_t *loop, int fd, uint32_t events, void *arg)
+{
+	int *claimed = arg; // Set while this handler claims the reads
+	unsigned char buf[CANBUS_MSG_SIZE];
+	canbus_frame_t frames[CANBUS_FRAMES_PER_REPORT];
+	struct timespec ts;
+	int nbytes, nframes;
+
+	if ((events & (EPOLLERR|EPOLLHUP)) ||
+		((nbytes = canctl_recv(dev_can, buf, sizeof(buf))) < 0 &&
+		errno != EAGAIN))
+	{
+		printf("ERROR: CANBus device stopped responding\n");
+		evloop_del_fd(loop, fd);
+		// Nobody reads the module now, so commands have to
+		canctl_reader_unclaim(dev_can);
+		*claimed = 0;
+		return;
+	}
+	if (nbytes <= 0 ||
+		canctl_dispatch(dev_can, buf, nbytes) == CANCTL_ROUTE_COMMAND)
+		return; // e.g. an --errmon reply
+
+	canctl_get_rx_time(dev_can, &ts);
+	if ((nframes = canctl_decode_report(buf, nbytes, frames,
+		CANBUS_FRAMES_PER_REPORT, &ts)) >= 0)
+	{
+		nframes = canctl_filter_frames(dev_can, frames, nframes);
+		for (int i = 0; i < nframes; i++)
+			print_frame(stdout, &frames[i]);
+	}
+	else
+	{
+		printf("Read %d bytes:\n", nbytes);
+		print_bytes(stdout, buf, nbytes, 2);
+	}
+} // monitor_on_can()
+
+/**
+ * Monitor mode handler: time to ask the GPIO module for its pin data. The
+ * reply is picked up by monitor_on_gpio() so the loop never blocks on it.
+ */
+static void monitor_on_gpio_timer(evloop_t *loop, int id, void *arg)
+{
+	(void)loop;
+	(void)id;
+	(void)arg;
+	if (gpio_request_pin(dev_gpio, PIN_DATA) < 0)
+		printf("ERROR: A problem occurred requesting GPIO pin data\n");
+} // monitor_on_gpio_timer()
+
+/**
+ * Monitor mode handler: the GPIO module replied. Prints pins that changed
+ * since the previous reply.
+ */
+static void monitor_on_gpio(evloop_t *loop, int fd, uint32_t events,
+	void *arg)
+{
+	unsigned char *last = arg; // GPIO_PIN_COUNT bytes, 0xff until known
+	unsigned char buf[CANBUS_MSG_SIZE];
+	unsigned char pins[GPIO_PIN_COUNT];
+	int nbytes;
+
+	if ((events & (EPOLLERR|EPOLLHUP)) ||
+		((nbytes = canctl_recv(dev_gpio, buf, sizeof(buf))) < 0 &&
+		errno != EAGAIN))
+	{
+		printf("ERROR: GPIO device stopped responding\n");
+		evloop_del_fd(loop, fd);
+		return;
+	}
+	if (nbytes <= 0 || gpio_parse_pin(buf, nbytes, PIN_DATA, pins) < 0)
+		return;
+
+	for (int i = 0; i < GPIO_PIN_COUNT; i++)
+	{
+		if (pins[i] != last[i])
+			printf("  GPIO pin %d: %s\n", i+1,
+				pins[i] ? "1/HIGH" : "0/LOW");
+		last[i] = pins[i];
+	}
+} // monitor_on_gpio()
+
+/**
+ * Monitor mode handler: udev reported a hidraw device arriving or leaving.
+ * Prints the module events; other HIDs are ignored.
+ */
+static void monitor_on_hotplug(evloop_t *loop, int fd, uint32_t events,
+	void *arg)
+{
+	discover_monitor_t *mon = arg;
+	discover_action_t action;
+	discover_device_t dev;
+	(void)loop;
+	(void)fd;
+	(void)events;
+
+	while (discover_monitor_read(mon, &action, &dev) > 0)
+		printf("%s module %s: %s\n", discover_kind_to_string(dev.kind),
+			action == DISCOVER_ACTION_ADD ? "arrived" : "removed",
+			dev.devnode);
+} // monitor_on_hotplug()
+
+/**
+ * Monitor mode handler: the user typed a line. "q" leaves monitor mode.
+ */
+static void monitor_on_stdin(evloop_t *loop, int fd, uint32_t events,
+	void *arg)
+{
+	int c, quit = 0;
+	(void)fd;
+	(void)events;
+	(void)arg;
+
+	while ((c = fgetc(stdin)) != EOF && c != '\n')
+		if (c == 'q' || c == 'Q')
+			quit = 1;
+	if (quit || c == EOF)
+		evloop_stop(loop);
+} // monitor_on_stdin()
+
+/**
+ * Enters into "Monitor" mode -- a hands off mode that watches the CANbus
+ * module, the GPIO module and stdin with a single event loop. CAN frames are
+ * printed as they arrive and GPIO pins are sampled every
+ * GPIO_MONITOR_INTERVAL_MS, printing a line whenever one changes. Modules
+ * plugged in or removed while monitoring are reported as well. This mode
+ * ends when the user enters "q" or presses Ctrl+c (SIGINT).
+ */
+void mnu_monitor(void)
+{
+	int rc;
+	evloop_t *loop;
+	discover_monitor_t *hotplug;
+	unsigned char last_pins[GPIO_PIN_COUNT];
+	int can_claimed = 0;
+	struct sigaction act, oldact;
+	act.sa_handler = handle_signal_while_reading_or_writing;
+	keep_reading_or_writing = 1;
+
+	printf("\n");
+	memset(last_pins, 0xff, sizeof(last_pins));
+
+	if ((loop = evloop_create()) == NULL)
+	{
+		printf("ERROR: Could not create event loop: %s\n", strerror(errno));
+		return;
+	}
+
+	if (dev_can != NULL)
+	{
+		// The loop reads the CANbus module, so --errmon samples must not:
+		// they would keep the frames they come across from the loop
+		if (evloop_add_fd(loop, canctl_get_fd(dev_can), EPOLLIN,
+			monitor_on_can, &can_claimed) < 0)
+			printf("WARNING: Could not watch the CANBus device: %s\n",
+				strerror(errno));
+		else
+		{
+			canctl_reader_claim(dev_can);
+			can_claimed = 1;
+		}
+	}
+	if (dev_gpio != NULL &&
+		(evloop_add_fd(loop, canctl_get_fd(dev_gpio), EPOLLIN, monitor_on_gpio,
+			last_pins) < 0 ||
+		evloop_add_timer(loop, GPIO_MONITOR_INTERVAL_MS, 1,
+			monitor_on_gpio_timer, NULL) < 0))
+		printf("WARNING: Could not watch the GPIO device: %s\n",
+			strerror(errno));
+	if ((hotplug = discover_monitor_create()) == NULL ||
+		evloop_add_fd(loop, discover_monitor_fd(hotplug), EPOLLIN,
+			monitor_on_hotplug, hotplug) < 0)
+		printf("WARNING: Could not watch for modules being plugged in or "
+			"removed\n");
+	flush_stdin();
+	evloop_add_fd(loop, STDIN_FILENO, EPOLLIN, monitor_on_stdin, NULL);
+
+	// Same Ctrl+c handling as read and write mode
+	if ((rc = sigaction(SIGINT, &act, &oldact)) < 0)
+		printf("WARNING: Could not set stop signal for monitor mode. "
+			"Enter q to exit...\n");
+	else
+		printf("Now entering monitor mode. Enter q or press Ctrl+c to "
+			"exit...\n");
+
+	while (keep_reading_or_writing)
+	{
+		service_signal_requests(NULL);
+		if (evloop_run(loop) == 0)
+			break; // "q" was entered
+		if (errno != EINTR)
+		{
+			printf("ERROR: A problem occurred: %s\n", strerror(errno));
+			break;
+		}
+	}
+	printf("\nLeaving monitor mode\n");
+
+	if (can_claimed)
+		canctl_reader_unclaim(dev_can);
+	evloop_destroy(loop);
+	discover_monitor_destroy(hotplug);
+	// Reset the old SIGINT action, if it was originally changed
+	if (rc == 0)
+		sigaction(SIGINT, &oldact, NULL);
+} // mnu_monitor()
+
+/**
+ * Runs the --all mode: opens every CANbus and GPIO module on the host, gives
+ * each CANbus module its own reader thread and prints the merged frame
+ * stream, each frame tagged with the index of the module it came from.
+ * Modules plugged in while reading are added and started on the fly. This
+ * mode ends when the user presses Ctrl+c (SIGINT).
+ * @returns Returns 0 on success, -1 on error
+ */
+int run_all_devices(void)
+{
+	int rc, n;
+	unsigned int failed = 0; // Modules whose reader error was reported
+	canmgr_t *mgr;
+	discover_monitor_t *hotplug;
+	discover_action_t action;
+	discover_device_t found;
+	canmgr_frame_t frames[256];
+	errmon_t *errmons[CANMGR_MAX_DEVICES] = { NULL }; // Only with --errmon
+	canctl_dev_t *devs[CANMGR_MAX_DEVICES];
+	canctl_info_t info[CANMGR_MAX_DEVICES];
+	struct sigaction act, oldact;
+	act.sa_handler = handle_signal_while_reading_or_writing;
+	keep_reading_or_writing = 1;
+
+	printf("Searching for CANbus and GPIO modules\n");
+	if ((mgr = canmgr_create()) == NULL || canmgr_open_all(mgr) < 0)
+	{
+		printf("ERROR: Could not search for modules: %s\n", strerror(errno));
+		canmgr_destroy(mgr);
+		return (-1);
+	}
+	if (canmgr_count(mgr) == 0)
+	{
+		printf("ERROR: No CANbus or GPIO devices found\n");
+		canmgr_destroy(mgr);
+		return (-1);
+	}
+	// Ask every module who it is in one round trip, before the readers start
+	for (int i = 0; i < canmgr_count(mgr); i++)
+	{
+		devs[i] = canmgr_get(mgr, i)->dev;
+		info[i].gpio = canmgr_get(mgr, i)->kind == CANMGR_KIND_GPIO;
+		canctl_set_timeout_ms(devs[i], cfg.timeout_ms);
+	}
+	canctl_query_info(devs, info, canmgr_count(mgr));
+	for (int i = 0; i < canmgr_count(mgr); i++)
+	{
+		const canmgr_device_t *d = canmgr_get(mgr, i);
+		printf("  [%d] %s (%s)", i, d->path,
+			d->kind == CANMGR_KIND_CAN ? "CANBus" : "GPIO");
+		if (info[i].err != 0)
+			printf(": %s\n", strerror(info[i].err));
+		else if (info[i].gpio)
+			printf(": firmware %02x %02x %02x, board ID %02x, SKU %02x\n",
+				info[i].fw[0], info[i].fw[1], info[i].fw[2],
+				info[i].board_id, info[i].sku);
+		else
+			printf(": firmware %02x %02x %02x, %s, Tx/Rx errors %d/%d\n",
+				info[i].fw[0], info[i].fw[1], info[i].fw[2],
+				canctl_config_to_string(info[i].cfg), info[i].estate[0],
+				info[i].estate[1]);
+		canctl_set_filter(d->dev, filter);
+		if (cfg.realtime)
+			canctl_set_clock(d->dev, CLOCK_REALTIME);
+		if (d->kind == CANMGR_KIND_CAN)
+		{
+			apply_io(d->dev, d->path);
+			errmons[i] = start_errmon(d->dev, d->path);
+		}
+	}
+	if (canmgr_start(mgr) < 0)
+		printf("WARNING: Could not start a reader for every CANBus device\n");
+	start_metrics(mgr);
+	if ((hotplug = discover_monitor_create()) == NULL)
+		printf("WARNING: Could not watch for modules being plugged in\n");
+
+	if ((rc = sigaction(SIGINT, &act, &oldact)) < 0)
+	{
+		printf("WARNING: Could not set stop signal for read "
+			"mode. Will only read once.\n");
+		keep_reading_or_writing = 0;
+	}
+	else
+	{
+		printf("Now entering read mode. Press Ctrl+c to exit...\n");
+	}
+	do
+	{
+		service_signal_requests(mgr);
+		if ((n = canmgr_read(mgr, frames, 256, cfg.timeout_ms)) < 0)
+		{
+			if (errno == EINTR &&
+				(filter_reload_requested || hist_dump_requested))
+				continue; // SIGHUP or SIGUSR1, not Ctrl+c
+			if (errno != EINTR)
+				printf("ERROR: A problem occurred: %s\n", strerror(errno));
+			else
+				printf("\nLeaving read mode\n");
+			break;
+		}
+		else if (n == 0)
+		{
+			printf("Timeout\n");
+		}
+		for (int i = 0; i < n; i++)
+		{
+			printf("[%d]", frames[i].src);
+			print_frame(stdout, &frames[i].frame);
+		}
+		for (int i = 0; i < canmgr_count(mgr); i++)
+		{
+			if ((failed & (1u << i)) || canmgr_error(mgr, i) == 0)
+				continue;
+			printf("ERROR: Stopped reading [%d]: %s\n", i,
+				strerror(canmgr_error(mgr, i)));
+			failed |= 1u << i;
+		}
+		// Pick up modules plugged in since the last pass
+		while (hotplug != NULL &&
+			discover_monitor_read(hotplug, &action, &found) > 0)
+		{
+			if (action == DISCOVER_ACTION_REMOVE)
+			{
+				printf("%s module removed: %s\n",
+					discover_kind_to_string(found.kind), found.devnode);
+				// Free its slot, so it comes back as a new module with
+				// fresh counters instead of a duplicate
+				if ((n = canmgr_find(mgr, found.devnode)) < 0)
+					continue;
+				metrics_remove_device(metrics, canmgr_get(mgr, n)->dev);
+				errmon_stop(errmons[n]);
+				errmons[n] = NULL;
+				failed &= ~(1u << n);
+				canmgr_remove(mgr, n);
+				continue;
+			}
+			if ((n = canmgr_add(mgr, found.devnode,
+				found.kind == DISCOVER_KIND_CAN ?
+				CANMGR_KIND_CAN : CANMGR_KIND_GPIO)) < 0)
+			{
+				printf("WARNING: Could not add %s: %s\n", found.devnode,
+					strerror(errno));
+				continue;
+			}
+			printf("  [%d] %s (%s) arrived\n", n, found.devnode,
+				discover_kind_to_string(found.kind));
+			canctl_set_timeout_ms(canmgr_get(mgr, n)->dev, cfg.timeout_ms);
+			canctl_set_filter(canmgr_get(mgr, n)->dev, filter);
+			if (cfg.realtime)
+				canctl_set_clock(canmgr_get(mgr, n)->dev, CLOCK_REALTIME);
+			if (metrics != NULL)
+				metrics_add_device(metrics, canmgr_get(mgr, n)->dev,
+					found.devnode);
+			if (found.kind == DISCOVER_KIND_CAN)
+			{
+				apply_io(canmgr_get(mgr, n)->dev, found.devnode);
+				errmons[n] = start_errmon(canmgr_get(mgr, n)->dev,
+					canmgr_get(mgr, n)->path);
+			}
+			canmgr_start(mgr);
+		}
+	} while (keep_reading_or_writing);
+	if (rc == 0)
+		sigaction(SIGINT, &oldact, NULL);
+
+	discover_monitor_destroy(hotplug);
+	for (int i = 0; i < CANMGR_MAX_DEVICES; i++)
+		errmon_stop(errmons[i]);
+	metrics_destroy(metrics);
+	canmgr_destroy(mgr);
+	canfilter_destroy(filter);
+	return (0);
+} // run_all_devices()
+
+/**
+ * Starts an emulated CANbus module and an emulated GPIO module for
+ * --emulate and attaches dev_can and dev_gpio to them.
+ * @returns Returns 0 on success, -1 on error
+ */
+int start_emulators(void)
+{
+	emu_opts_t opts;
+	emu_t **emus[2] = { &emu_can, &emu_gpio };
+	canctl_dev_t **devs[2] = { &dev_can, &dev_gpio };
+	int fd;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.latency_us = cfg.emu_latency_us;
+	opts.bandwidth = cfg.emu_bandwidth;
+	opts.fw[0] = 0x01; // Firmware 1.0.0
+	opts.board_id = 0x01;
+	opts.sku = 0x01;
+	for (int i = 0; i < 2; i++)
+	{
+		opts.kind = i == 0 ? EMU_KIND_CAN : EMU_KIND_GPIO;
+		if ((*emus[i] = emu_start(&opts, &fd)) == NULL)
+		{
+			printf("ERROR: Could not start the emulator: %s\n",
+				strerror(errno));
+			return (-1);
+		}
+		if ((*devs[i] = canctl_attach(fd)) == NULL)
+		{
+			printf("ERROR: Could not attach to the emulator\n");
+			close(fd);
+			return (-1);
+		}
+	}
+	printf("Using emulated CANbus and GPIO modules\n");
+	printf("CANBus Device Status: EMULATED\n");
+	printf("GPIO Device Status: EMULATED\n");
+	return (0);
+} // start_emulators()
+
+/**
+ * Stops the emulators started by start_emulators(), after the module
+ * handles attached to them were closed.
+ */
+void stop_emulators(void)
+{
+	emu_stop(emu_can);
+	emu_stop(emu_gpio);
+	emu_can = emu_gpio = NULL;
+} // stop_emulators()
+
+/**
+ * Starts exporting the modules' counters for --metrics-file and
+ * --metrics-socket. Failing to is only a warning, the tool works without.
+ * @param mgr With --all, the manager whose modules to export, labelled by
+ * path. NULL exports dev_can and dev_gpio as "can" and "gpio".
+ */
+void start_metrics(canmgr_t *mgr)
+{
+	if (cfg.metrics_file[0] == '\0' && cfg.metrics_socket[0] == '\0')
+		return;
+	if ((metrics = metrics_create()) == NULL)
+		goto err;
+	if (mgr != NULL)
+	{
+		for (int i = 0; i < canmgr_count(mgr); i++)
+			metrics_add_device(metrics, canmgr_get(mgr, i)->dev,
+				canmgr_get(mgr, i)->path);
+	}
+	else
+	{
+		if (dev_can != NULL)
+			metrics_add_device(metrics, dev_can, "can");
+		if (dev_gpio != NULL)
+			metrics_add_device(metrics, dev_gpio, "gpio");
+	}
+	if (metrics_start(metrics, cfg.metrics_file[0] != '\0' ?
+		cfg.metrics_file : NULL, cfg.metrics_socket[0] != '\0' ?
+		cfg.metrics_socket : NULL, cfg.metrics_interval_ms) < 0)
+		goto err;
+	return;
+
+err:
+	printf("WARNING: Could not export metrics: %s\n", strerror(errno));
+	metrics_destroy(metrics);
+	metrics = NULL;
+} // start_metrics()
+
+/**
+ * Starts watching a CANbus module's error state for --errmon.
+ * @param dev The CANbus module's handle
+ * @param name What to call the module in messages. Must outlive the monitor.
+ * @returns Returns the monitor, or NULL if --errmon is off or it could not
+ * be started
+ */
+errmon_t *start_errmon(canctl_dev_t *dev, const char *name)
+{
+	errmon_opts_t opts;
+	errmon_t *mon;
+
+	if (cfg.errmon_interval_ms <= 0)
+		return (NULL);
+	memset(&opts, 0, sizeof(opts));
+	opts.interval_ms = cfg.errmon_interval_ms;
+	opts.auto_recover = cfg.errmon_recover;
+	if ((mon = errmon_start(dev, &opts, on_errmon_event, (void *)name)) ==
+		NULL)
+		printf("WARNING: Could not watch %s's error state: %s\n", name,
+			strerror(errno));
+	return (mon);
+} // start_errmon()
+
+/**
+ * Tells the user what an --errmon monitor saw. Runs on the monitor's thread.
+ */
+void on_errmon_event(errmon_t *mon, const errmon_event_t *event, void *arg)
+{
+	const char *name = arg;
+	const errmon_sample_t *s = &event->sample;
+	errmon_stats_t stats;
+
+	switch (event->type)
+	{
+		case ERRMON_EVENT_LEVEL:
+			printf("%s: %s %s -> %s (Tx errors %u %+.1f/s, Rx errors %u "
+				"%+.1f/s)\n", s->level > event->old_level ? "WARNING" :
+				"NOTICE", name, errmon_level_to_string(event->old_level),
+				errmon_level_to_string(s->level), s->tx_errors, s->tx_rate,
+				s->rx_errors, s->rx_rate);
+			break;
+		case ERRMON_EVENT_RECOVERING:
+			errmon_get_stats(mon, &stats);
+			printf("WARNING: %s is bus-off, recovering (attempt #%lu)\n",
+				name, stats.recoveries + stats.recover_failures + 1);
+			break;
+		case ERRMON_EVENT_RECOVER_FAILED:
+			printf("ERROR: Could not recover %s from bus-off: %s\n", name,
+				event->err == ENODATA ? "Set its configuration first" :
+				strerror(event->err));
+			break;
+		case ERRMON_EVENT_SAMPLE_FAILED:
+			if (cfg.verbose)
+				printf("WARNING: Could not read %s's error state: %s\n",
+					name, strerror(event->err));
+			break;
+	}
+	fflush(stdout);
+} // on_errmon_event()
+
+/**
+ * Sends CAN frames through the supervised session if there is one.
+ * @param frames Frames to send
+ * @param n Number of frames in @c frames
+ * @returns Returns @c n on success, -1 on error
+ */
+int write_frames(const canbus_frame_t *frames, size_t n)
+{
+	if (session_can != NULL)
+		return (session_send_frames(session_can, frames, n));
+	return (canctl_send_frames(dev_can, frames, n));
+} // write_frames()
+
+/**
+ * Shows where a line of hex stopped making sense.
+ * @param line The line, need not be NUL terminated
+ * @param len Number of characters in @c line
+ * @param pos Offset of the problem, from hex_parse_bytes() or
+ * hex_parse_frame()
+ * @param err errno from the parser
+ */
+void print_parse_error(const char *line, size_t len, size_t pos, int err)
+{
+	printf("ERROR: %s at column %zu. Try again.\n", hex_error_to_string(err),
+		pos + 1);
+	printf("  %.*s\n  %*s^\n", (int)len, line, (int)pos, "");
+} // print_parse_error()
+
+/**
+ * Writes every line of the --script file (or stdin for "-") to the CANbus
+ * module, using the same syntax as write mode. Lines may carry '#'
+ * comments. Consecutive frame lines are packed four to a report; a report
+ * line first sends the frames before it, so the order is kept. Stops at the
+ * first line that does not parse or can not be written.
+ * @returns Returns 0 on success, -1 on error
+ */
+int run_script(void)
+{
+	FILE *fp;
+	char line[WRITE_LINE_SIZE + 2]; // Room for "\n" and '\0'
+	unsigned char msg[CANBUS_MSG_SIZE];
+	canbus_frame_t frames[CANBUS_FRAMES_PER_REPORT];
+	size_t len, nframes = 0, errpos;
+	unsigned long lineno = 0, reports = 0, nsent = 0;
+	struct timespec start, end;
+	double elapsed;
+	int n, rc = 0;
+
+	if (dev_can == NULL)
+	{
+		printf("ERROR: --script needs the CANBus device\n");
+		return (-1);
+	}
+	if (strcmp(cfg.script, "-") == 0)
+		fp = stdin;
+	else if ((fp = fopen(cfg.script, "r")) == NULL)
+	{
+		printf("ERROR: Could not open %s: %s\n", cfg.script, strerror(errno));
+		return (-1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (rc == 0 && fgets(line, sizeof(line), fp) != NULL)
+	{
+		lineno++;
+		len = strlen(line);
+		if (len == sizeof(line) - 1 && line[len - 1] != '\n')
+		{
+			printf("ERROR: %s:%lu: Line longer than %d characters\n",
+				cfg.script, lineno, WRITE_LINE_SIZE);
+			rc = -1;
+			break;
+		}
+		len = strcspn(line, "#\r\n"); // Drop comments and EOL
+
+		if (hex_is_frame(line, len))
+		{
+			if (hex_parse_frame(line, len, &frames[nframes], &errpos) < 0)
+				rc = -1;
+			else if (++nframes == CANBUS_FRAMES_PER_REPORT)
+			{
+				if (write_frames(frames, nframes) < 0)
+					rc = -2;
+				else
+				{
+					nsent += nframes;
+					reports++;
+				}
+				nframes = 0;
+			}
+		}
+		else if ((n = hex_parse_bytes(line, len, msg, sizeof(msg),
+			&errpos)) < 0)
+			rc = -1;
+		else if (n > 0)
+		{
+			// Frames collected so far go out first to keep the order
+			if (nframes > 0 && write_frames(frames, nframes) < 0)
+				rc = -2;
+			else
+			{
+				nsent += nframes;
+				reports += nframes > 0;
+				if ((session_can != NULL ?
+					session_write(session_can, msg, n) :
+					canctl_write(dev_can, msg, n)) != n)
+					rc = -2;
+				else
+					reports++;
+			}
+			nframes = 0;
+		}
+
+		if (rc == -1)
+		{
+			printf("%s:%lu: ", cfg.script, lineno);
+			print_parse_error(line, len, errpos, errno);
+		}
+	}
+	if (rc == 0 && nframes > 0)
+	{
+		if (write_frames(frames, nframes) < 0)
+			rc = -2;
+		else
+		{
+			nsent += nframes;
+			reports++;
+		}
+	}
+	if (rc == -2)
+		printf("ERROR: %s:%lu: Could not write to the CANBus device: %s\n",
+			cfg.script, lineno, strerror(errno));
+	if (fp != stdin)
+		fclose(fp);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("Script: %lu lines, %lu reports, %lu frames in %.3f s "
+		"(%.0f reports/s)\n", lineno, reports, nsent, elapsed,
+		elapsed > 0 ? reports / elapsed : 0.0);
+	return (rc == 0 ? 0 : -1);
+} // run_script()
+
+/**
+ * Builds the sequence for --gpio-seq FILE or --gpio-pwm MASK,PERIOD_US,DUTY.
+ * @returns Returns the sequence on success, NULL on error
+ */
+gpioseq_t *load_gpioseq(void)
+{
+	char line[WRITE_LINE_SIZE];
+	unsigned long lineno = 0, offset, mask, value, period, duty;
+	char *p, *end;
+	gpioseq_t *seq;
+	FILE *fp;
+
+	if ((seq = gpioseq_create()) == NULL)
+		return (NULL);
+	if (cfg.gpio_pwm[0] != '\0')
+	{
+		mask = strtoul(cfg.gpio_pwm, &p, 16);
+		period = *p == ',' ? strtoul(p + 1, &p, 10) : 0;
+		duty = *p == ',' ? strtoul(p + 1, &p, 10) : 101;
+		if (*p != '\0' || mask == 0 || mask > 0xff ||
+			gpioseq_add_pwm(seq, mask, period, duty) < 0)
+		{
+			printf("ERROR: --gpio-pwm wants MASK,PERIOD_US,DUTY, e.g. "
+				"03,20000,25\n");
+			gpioseq_destroy(seq);
+			return (NULL);
+		}
+		return (seq);
+	}
+
+	if ((fp = fopen(cfg.gpio_seq, "r")) == NULL)
+	{
+		printf("ERROR: Could not open %s: %s\n", cfg.gpio_seq,
+			strerror(errno));
+		gpioseq_destroy(seq);
+		return (NULL);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		lineno++;
+		line[strcspn(line, "#\r\n")] = '\0'; // Drop comments and EOL
+		p = line + strspn(line, " \t");
+		if (*p == '\0')
+			continue;
+		if (strncmp(p, "period", 6) == 0)
+		{
+			if ((period = strtoul(p + 6, &end, 10)) == 0)
+				end = p; // Flag the line below
+			gpioseq_set_period(seq, period);
+		}
+		else
+		{
+			offset = strtoul(p, &end, 10);
+			if (end != p)
+				mask = strtoul(p = end, &end, 16);
+			if (end != p)
+				value = strtoul(p = end, &end, 16);
+			if (end == p || mask > 0xff || value > 0xff ||
+				gpioseq_add(seq, offset, mask, value) < 0)
+				end = p; // Flag the line below
+		}
+		if (end == p || end[strspn(end, " \t")] != '\0')
+		{
+			printf("ERROR: %s:%lu: Expected 'OFFSET_US MASK VALUE' or "
+				"'period USEC'\n", cfg.gpio_seq, lineno);
+			fclose(fp);
+			gpioseq_destroy(seq);
+			return (NULL);
+		}
+	}
+	fclose(fp);
+	return (seq);
+} // load_gpioseq()
+
+/**
+ * Plays --gpio-seq or --gpio-pwm on the GPIO module, making the pins it
+ * drives outputs first, and reports the timing it achieved. Ctrl+c (SIGINT)
+ * stops early but still reports.
+ * @returns Returns 0 on success, -1 on error
+ */
+int run_gpioseq(void)
+{
+	gpioseq_opts_t opts;
+	gpioseq_result_t res;
+	struct sigaction act, oldact;
+	gpioseq_t *seq;
+	uint8_t types, mask;
+	int rc;
+
+	if (dev_gpio == NULL)
+	{
+		printf("ERROR: --gpio-seq and --gpio-pwm need the GPIO device\n");
+		return (-1);
+	}
+	if ((seq = load_gpioseq()) == NULL)
+		return (-1);
+
+	// The pins must be outputs for their data to show
+	mask = gpioseq_get_mask(seq);
+	if (gpio_read_pins(dev_gpio, PIN_TYPE, &types) < 0 ||
+		((types & mask) != 0 &&
+		gpio_set_pins(dev_gpio, PIN_TYPE, types & ~mask) < 0))
+	{
+		printf("ERROR: Could not make GPIO pins %02x outputs\n", mask);
+		gpioseq_destroy(seq);
+		return (-1);
+	}
+
+	memset(&opts, 0, sizeof(opts));
+	opts.cycles = cfg.gpio_cycles != ULONG_MAX ? cfg.gpio_cycles :
+		cfg.gpio_pwm[0] != '\0' ? 0 : 1;
+	opts.merge_us = cfg.gpio_merge_us;
+	opts.stop = &stop_requested;
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = handle_signal_while_benchmarking;
+	sigaction(SIGINT, &act, &oldact);
+	if (opts.cycles == 0)
+		printf("Playing until Ctrl+c...\n");
+	rc = gpioseq_play(dev_gpio, seq, &opts, &res);
+	sigaction(SIGINT, &oldact, NULL);
+	if (rc < 0)
+		printf("ERROR: GPIO sequence stopped: %s\n", strerror(errno));
+
+	printf("GPIO sequence: %lu periods, %lu steps in %lu transactions "
+		"(%lu skipped), %.3f s (%.1f transactions/s)\n", res.cycles,
+		res.steps, res.transactions, res.skipped, res.elapsed_s,
+		res.elapsed_s > 0 ? res.transactions / res.elapsed_s : 0.0);
+	printf("  Late:         %lu\n", res.late);
+	print_hist(stdout, "  Deadline to done", &res.error);
+	gpioseq_destroy(seq);
+	return (rc);
+} // run_gpioseq()
@@ -0,0 +1,425 @@
+/**
+ * @file metrics.c
+ * @date 2026-10-16
+ */
+
+#define _GNU_SOURCE // accept4()
+#include "metrics.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+struct metrics
+{
+	pthread_mutex_t lock; // Guards the device list
+	int count;
+	struct
+	{
+		canctl_dev_t *dev;
+		char label[METRICS_LABEL_SIZE]; // Already escaped
+	} devices[METRICS_MAX_DEVICES];
+
+	int running;
+	pthread_t thread;
+	int efd; // eventfd that stops the thread
+	int lfd; // Listening socket, -1 if none
+	char sockpath[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	char *textfile; // NULL if none
+	int interval_ms;
+};
+
+/**
+ * Creates an exporter with no modules.
+ * @returns Returns the new exporter on success, NULL on error
+ */
+metrics_t *metrics_create(void)
+{
+	metrics_t *m;
+
+	if ((m = calloc(1, sizeof(*m))) == NULL)
+		return (NULL);
+	pthread_mutex_init(&m->lock, NULL);
+	m->efd = -1;
+	m->lfd = -1;
+	return (m);
+} // metrics_create()
+
+/**
+ * Stops the exporter's thread, removes its socket and frees it. The
+ * textfile is left in place for the collector to find.
+ * @param m The exporter to destroy, may be NULL
+ */
+void metrics_destroy(metrics_t *m)
+{
+	uint64_t one = 1;
+
+	if (m == NULL)
+		return;
+	if (m->running)
+	{
+		if (write(m->efd, &one, sizeof(one)) < 0)
+			perror("metrics: eventfd");
+		pthread_join(m->thread, NULL);
+	}
+	if (m->efd >= 0)
+		close(m->efd);
+	if (m->lfd >= 0)
+	{
+		close(m->lfd);
+		unlink(m->sockpath);
+	}
+	free(m->textfile);
+	pthread_mutex_destroy(&m->lock);
+	free(m);
+} // metrics_destroy()
+
+/**
+ * Adds a module to the export. May be called while the exporter runs, e.g.
+ * for hotplugged modules. The handle must stay open until
+ * metrics_remove_device() or metrics_destroy().
+ * @param m The exporter
+ * @param dev The module's handle
+ * @param label Value of the module's device label, e.g. its device path
+ * @returns Returns 0 on success, -1 on error
+ */
+int metrics_add_device(metrics_t *m, canctl_dev_t *dev, const char *label)
+{
+	char *p;
+
+	if (m == NULL || dev == NULL || label == NULL)
+		return (-1); // @todo Return a better error indicator
+	pthread_mutex_lock(&m->lock);
+	if (m->count >= METRICS_MAX_DEVICES)
+	{
+		pthread_mutex_unlock(&m->lock);
+		errno = ENOSPC;
+		return (-1);
+	}
+	m->devices[m->count].dev = dev;
+
+	// Label values escape '\', '"' and newlines
+	p = m->devices[m->count].label;
+	for (; *label != '\0' && p < &m->devices[m->count].label[
+		METRICS_LABEL_SIZE - 2]; label++)
+	{
+		if (*label == '\\' || *label == '"' || *label == '\n')
+			*p++ = '\\';
+		*p++ = *label == '\n' ? 'n' : *label;
+	}
+	*p = '\0';
+	m->count++;
+	pthread_mutex_unlock(&m->lock);
+	return (0);
+} // metrics_add_device()
+
+/**
+ * Takes a module out of the export, e.g. when it was unplugged, so a module
+ * that comes back under the same label does not repeat its series. The
+ * handle may be closed afterwards.
+ * @param m The exporter
+ * @param dev The module's handle
+ * @returns Returns 0 on success, -1 on error (errno is ENOENT if the module
+ * was not exported)
+ */
+int metrics_remove_device(metrics_t *m, const canctl_dev_t *dev)
+{
+	if (m == NULL || dev == NULL)
+		return (-1); // @todo Return a better error indicator
+	pthread_mutex_lock(&m->lock);
+	for (int i = 0; i < m->count; i++)
+	{
+		if (m->devices[i].dev != dev)
+			continue;
+		memmove(&m->devices[i], &m->devices[i + 1],
+			(m->count - i - 1) * sizeof(m->devices[0]));
+		m->count--;
+		pthread_mutex_unlock(&m->lock);
+		return (0);
+	}
+	pthread_mutex_unlock(&m->lock);
+	errno = ENOENT;
+	return (-1);
+} // metrics_remove_device()
+
+/**
+ * Renders every module's counters in the Prometheus text format.
+ * @param m The exporter
+ * @param buf Buffer to render into, NUL terminated if @c size is nonzero
+ * @param size Length of buffer @c buf
+ * @returns Returns the length of the whole export, like snprintf(). If it is
+ * @c size or more, the output was cut short.
+ */
+size_t metrics_format(metrics_t *m, char *buf, size_t size)
+{
+	canctl_stats_t stats[METRICS_MAX_DEVICES];
+	const canctl_stat_desc_t *descs;
+	size_t ndescs, len = 0;
+	int count, n;
+
+	// Snapshot all the modules at once so the series line up
+	pthread_mutex_lock(&m->lock);
+	count = m->count;
+	for (int i = 0; i < count; i++)
+		canctl_get_stats(m->devices[i].dev, &stats[i]);
+
+	descs = canctl_stat_descs(&ndescs);
+	for (size_t d = 0; d < ndescs; d++)
+	{
+		n = snprintf(len < size ? &buf[len] : NULL, len < size ?
+			size - len : 0, "# HELP " METRICS_PREFIX "%s %s\n"
+			"# TYPE " METRICS_PREFIX "%s %s\n", descs[d].name, descs[d].help,
+			descs[d].name, descs[d].type == CANCTL_STAT_COUNTER ? "counter" :
+			"gauge");
+		len += n;
+		for (int i = 0; i < count; i++)
+		{
+			n = snprintf(len < size ? &buf[len] : NULL, len < size ?
+				size - len : 0, METRICS_PREFIX "%s{device=\"%s\"} %lu\n",
+				descs[d].name, m->devices[i].label,
+				*(unsigned long *)((char *)&stats[i] + descs[d].offset));
+			len += n;
+		}
+	}
+	pthread_mutex_unlock(&m->lock);
+	return (len);
+} // metrics_format()
+
+/**
+ * Renders the export into a buffer big enough for it.
+ * @param m The exporter
+ * @param len Set to the export's length
+ * @returns Returns the export, to be freed by the caller, or NULL on error
+ */
+static char *metrics_render(metrics_t *m, size_t *len)
+{
+	size_t size = 4096;
+	char *buf = NULL, *p;
+
+	for (;;)
+	{
+		if ((p = realloc(buf, size)) == NULL)
+		{
+			free(buf);
+			return (NULL);
+		}
+		buf = p;
+		if ((*len = metrics_format(m, buf, size)) < size)
+			return (buf);
+		size = *len + 1024; // Room for a module added meanwhile
+	}
+} // metrics_render()
+
+/**
+ * Writes all of a buffer.
+ * @returns Returns 0 on success, -1 on error
+ */
+static int metrics_write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0)
+	{
+		if ((n = write(fd, buf, len)) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+		buf += n;
+		len -= n;
+	}
+	return (0);
+} // metrics_write_all()
+
+/**
+ * Writes the export to a file for node_exporter's textfile collector. The
+ * file is written beside @c path and renamed over it, so the collector never
+ * sees it half written.
+ * @param m The exporter
+ * @param path The file, which should end in .prom
+ * @returns Returns 0 on success, -1 on error
+ */
+int metrics_write_textfile(metrics_t *m, const char *path)
+{
+	char tmp[PATH_MAX];
+	size_t len;
+	char *buf;
+	int fd, rc = -1;
+
+	if (m == NULL || path == NULL)
+		return (-1); // @todo Return a better error indicator
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+	{
+		errno = ENAMETOOLONG;
+		return (-1);
+	}
+	if ((buf = metrics_render(m, &len)) == NULL)
+		return (-1);
+	if ((fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644)) < 0)
+		goto out;
+	if (metrics_write_all(fd, buf, len) < 0 || fsync(fd) < 0)
+	{
+		close(fd);
+		unlink(tmp);
+		goto out;
+	}
+	close(fd);
+	if ((rc = rename(tmp, path)) < 0)
+		unlink(tmp);
+
+out:
+	free(buf);
+	return (rc);
+} // metrics_write_textfile()
+
+/**
+ * Answers one connection on the exporter's socket with the export.
+ * @param m The exporter
+ */
+static void metrics_serve(metrics_t *m)
+{
+	struct timeval tv = { .tv_sec = 1 };
+	size_t len;
+	char *buf;
+	int fd;
+
+	if ((fd = accept4(m->lfd, NULL, NULL, SOCK_CLOEXEC)) < 0)
+		return;
+	// Don't let a client that never reads hold up the thread
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	if ((buf = metrics_render(m, &len)) != NULL)
+	{
+		metrics_write_all(fd, buf, len);
+		free(buf);
+	}
+	close(fd);
+} // metrics_serve()
+
+/**
+ * @returns Returns CLOCK_MONOTONIC in milliseconds
+ */
+static long long metrics_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+} // metrics_now_ms()
+
+/**
+ * Exporter thread: rewrites the textfile every interval and serves the
+ * socket in between.
+ * @param arg The exporter
+ * @returns Returns NULL
+ */
+static void *metrics_thread(void *arg)
+{
+	metrics_t *m = arg;
+	struct pollfd pfd[2];
+	long long due = metrics_now_ms(), now;
+	int timeout;
+
+	pfd[0].fd = m->efd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = m->lfd;
+	pfd[1].events = POLLIN;
+	for (;;)
+	{
+		timeout = -1;
+		if (m->textfile != NULL)
+		{
+			if ((now = metrics_now_ms()) >= due)
+			{
+				if (metrics_write_textfile(m, m->textfile) < 0)
+					perror(m->textfile);
+				due += m->interval_ms;
+				if (due <= now) // Fell behind, don't catch up in a burst
+					due = now + m->interval_ms;
+			}
+			timeout = due - now;
+		}
+		if (poll(pfd, m->lfd >= 0 ? 2 : 1, timeout) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("metrics: poll");
+			break;
+		}
+		if (pfd[0].revents & POLLIN)
+			break;
+		if (m->lfd >= 0 && (pfd[1].revents & POLLIN))
+			metrics_serve(m);
+	}
+	if (m->textfile != NULL && metrics_write_textfile(m, m->textfile) < 0)
+		perror(m->textfile); // Leave the final counts behind
+	return (NULL);
+} // metrics_thread()
+
+/**
+ * Opens the exporter's Unix socket. A stale socket left at @c path by an
+ * earlier run is replaced; any other file there is an error.
+ * @returns Returns 0 on success, -1 on error
+ */
+static int metrics_listen(metrics_t *m, const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct stat st;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return (-1);
+	}
+	strcpy(addr.sun_path, path);
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+	if ((m->lfd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK,
+		0)) < 0)
+		return (-1);
+	if (bind(m->lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		listen(m->lfd, 8) < 0)
+	{
+		close(m->lfd);
+		m->lfd = -1;
+		return (-1);
+	}
+	strcpy(m->sockpath, path);
+	return (0);
+} // metrics_listen()
+
+/**
+ * Starts exporting in the background until metrics_destroy().
+ * @param m The exporter
+ * @param textfile File to rewrite every @c interval_ms, or NULL for none
+ * @param sockpath Unix socket to serve, or NULL for none
+ * @param interval_ms Time between textfile updates, 0 for the default
+ * @returns Returns 0 on success, -1 on error
+ */
+int metrics_start(metrics_t *m, const char *textfile, const char *sockpath,
+	int interval_ms)
+{
+	if (m == NULL || m->running || (textfile == NULL && sockpath == NULL))
+		return (-1); // @todo Return a better error indicator
+	m->interval_ms = interval_ms > 0 ? interval_ms : METRICS_INTERVAL_MS;
+	if (textfile != NULL && (m->textfile = strdup(textfile)) == NULL)
+		return (-1);
+	if (sockpath != NULL && metrics_listen(m, sockpath) < 0)
+		return (-1);
+	if ((m->efd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK)) < 0)
+		return (-1);
+	if (pthread_create(&m->thread, NULL, metrics_thread, m) != 0)
+		return (-1);
+	m->running = 1;
+	return (0);
+} // metrics_start()
@@ -0,0 +1,360 @@
+/**
+ * @file session.c
+ * @date 2026-10-16
+ */
+
+#include "session.h"
+#include "discover.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+struct session
+{
+	canctl_dev_t *dev;
+	int reconnect_ms; // How long to keep trying, negative tries forever
+	char phys[SESSION_PHYS_SIZE]; // Where the module is plugged in
+	unsigned long reconnects;
+	session_notify_cb notify;
+	void *notify_arg;
+
+	// Reports waiting to be written, oldest at tx_tail
+	struct
+	{
+		int len;
+		unsigned char buf[CANBUS_MSG_SIZE];
+	} txq[SESSION_TX_QUEUE_SIZE];
+	size_t tx_head, tx_tail;
+};
+
+/**
+ * @param err An errno value from a failed read or write
+ * @returns Returns nonzero if @c err means the module itself went away
+ */
+static int session_is_lost(int err)
+{
+	return (err == ENODEV || err == EIO || err == ENXIO || err == ESHUTDOWN);
+} // session_is_lost()
+
+/**
+ * Starts supervising a CANbus module. The module's physical address is
+ * recorded now, so this must be called while the module is present.
+ * @param dev The CANbus module's handle. The session does not own it.
+ * @param reconnect_ms How long session_recover() keeps looking for the
+ * module, or negative to keep looking until interrupted by a signal
+ * @returns Returns the new session on success, NULL on error
+ */
+session_t *session_create(canctl_dev_t *dev, int reconnect_ms)
+{
+	session_t *s;
+
+	if (dev == NULL)
+		return (NULL); // @todo Return a better error indicator
+	if ((s = calloc(1, sizeof(*s))) == NULL)
+		return (NULL);
+	s->dev = dev;
+	s->reconnect_ms = reconnect_ms;
+	if (ioctl(canctl_get_fd(dev), HIDIOCGRAWPHYS(sizeof(s->phys) - 1),
+		s->phys) < 0 || s->phys[0] == '\0')
+	{
+		free(s);
+		return (NULL);
+	}
+	return (s);
+} // session_create()
+
+/**
+ * Frees the session. Reports still queued are discarded; the module's handle
+ * stays open.
+ * @param s The session to destroy, may be NULL
+ */
+void session_destroy(session_t *s)
+{
+	free(s);
+} // session_destroy()
+
+/**
+ * Sets a callback that is told when the module is lost and when it is back.
+ * @param s The session
+ * @param cb The callback, or NULL for none
+ * @param arg Passed to @c cb as is
+ */
+void session_set_notify(session_t *s, session_notify_cb cb, void *arg)
+{
+	s->notify = cb;
+	s->notify_arg = arg;
+} // session_set_notify()
+
+/**
+ * Looks for a CANbus module plugged in at the session's physical address.
+ * @param s The session
+ * @returns Returns the module's newly opened fd, or -1 if it is not there
+ */
+static int session_find(session_t *s)
+{
+	discover_device_t found[DISCOVER_MAX_DEVICES];
+	char phys[SESSION_PHYS_SIZE];
+	int nfound, fd;
+
+	if ((nfound = discover_find(found, DISCOVER_MAX_DEVICES, 1)) < 0)
+		return (-1);
+	for (int i = 0; i < nfound; i++)
+	{
+		if (found[i].kind != DISCOVER_KIND_CAN)
+			continue;
+		if ((fd = open(found[i].devnode, O_RDWR|O_NONBLOCK|O_CLOEXEC)) < 0)
+			continue;
+		memset(phys, 0, sizeof(phys));
+		if (ioctl(fd, HIDIOCGRAWPHYS(sizeof(phys) - 1), phys) >= 0 &&
+			strcmp(phys, s->phys) == 0)
+			return (fd);
+		close(fd);
+	}
+	return (-1);
+} // session_find()
+
+/**
+ * Writes queued reports oldest first. A report leaves the queue only once
+ * it was written in full.
+ * @param s The session
+ * @returns Returns 0 if the queue is empty, -1 on error (errno is set)
+ */
+int session_flush(session_t *s)
+{
+	while (s->tx_tail != s->tx_head)
+	{
+		size_t idx = s->tx_tail % SESSION_TX_QUEUE_SIZE;
+		int len = s->txq[idx].len;
+		int nbytes = canctl_write(s->dev, s->txq[idx].buf, len);
+
+		if (nbytes < 0)
+			return (-1);
+		if (nbytes != len)
+		{
+			errno = EIO;
+			return (-1);
+		}
+		s->tx_tail++;
+	}
+	return (0);
+} // session_flush()
+
+/**
+ * @param s The session
+ * @returns Returns the number of reports waiting to be written
+ */
+size_t session_pending(const session_t *s)
+{
+	return (s->tx_head - s->tx_tail);
+} // session_pending()
+
+/**
+ * @param s The session
+ * @returns Returns how many times the module was found again
+ */
+unsigned long session_reconnects(const session_t *s)
+{
+	return (s->reconnects);
+} // session_reconnects()
+
+/**
+ * Puts the module back into the mode it was in before it was lost.
+ * @param s The session
+ * @param cfg The configuration mode to restore, or NULL if none was set
+ * @param speed The bus speed to restore, or 0 if none was set
+ * @returns Returns 0 on success, -1 on error
+ */
+static int session_restore(session_t *s, const canbus_cfg_t *cfg,
+	unsigned int speed)
+{
+	if (cfg == NULL)
+		return (0);
+	// The speed can only be set in CONFIGURATION mode
+	if (speed != 0 &&
+		canctl_set_config(s->dev, CANBUS_CFG_CONFIGURATION, speed) < 0)
+		return (-1);
+	if (*cfg != CANBUS_CFG_CONFIGURATION &&
+		canctl_set_config(s->dev, *cfg, 0) < 0)
+		return (-1);
+	return (0);
+} // session_restore()
+
+/**
+ * Waits for the module to come back, attaches the handle to it, restores
+ * the bus speed and configuration mode last set through the handle, and
+ * writes the reports that queued up in the meantime.
+ * @param s The session
+ * @returns Returns 0 on success, -1 on error (errno is ETIMEDOUT if the
+ * module did not come back in time, EINTR if a signal interrupted the wait)
+ */
+int session_recover(session_t *s)
+{
+	struct timespec start, now;
+	struct timespec retry = {
+		.tv_sec = SESSION_RETRY_MS / 1000,
+		.tv_nsec = (SESSION_RETRY_MS % 1000) * 1000000L
+	};
+	canbus_cfg_t cfg;
+	unsigned int speed;
+	int fd, have_cfg;
+
+	if (s->notify != NULL)
+		s->notify(s, SESSION_EVENT_LOST, s->notify_arg);
+
+	// Restoring the speed passes through CONFIGURATION mode, which changes
+	// what the handle remembers, so take a copy first
+	have_cfg = canctl_get_last_config(s->dev, &cfg, &speed) == 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (;;)
+	{
+		if ((fd = session_find(s)) >= 0)
+		{
+			if (canctl_reattach(s->dev, fd) < 0)
+			{
+				close(fd);
+				return (-1); // A reader thread owns the handle
+			}
+			if (session_restore(s, have_cfg ? &cfg : NULL, speed) == 0)
+			{
+				if (session_flush(s) == 0)
+				{
+					s->reconnects++;
+					if (s->notify != NULL)
+						s->notify(s, SESSION_EVENT_RESTORED, s->notify_arg);
+					return (0);
+				}
+				if (!session_is_lost(errno))
+					return (-1);
+			}
+		}
+		// Not back yet, or it went away again while being reconfigured
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (s->reconnect_ms >= 0 &&
+			(now.tv_sec - start.tv_sec) * 1000 +
+			(now.tv_nsec - start.tv_nsec) / 1000000L >= s->reconnect_ms)
+		{
+			if (s->notify != NULL)
+				s->notify(s, SESSION_EVENT_GAVE_UP, s->notify_arg);
+			errno = ETIMEDOUT;
+			return (-1);
+		}
+		if (nanosleep(&retry, NULL) < 0)
+			return (-1); // errno is EINTR
+	}
+} // session_recover()
+
+/**
+ * Writes the queued reports, reconnecting first if the module went away.
+ * @param s The session
+ * @returns Returns 0 on success, -1 on error
+ */
+static int session_push(session_t *s)
+{
+	if (session_flush(s) == 0)
+		return (0);
+	if (!session_is_lost(errno))
+		return (-1);
+	return (session_recover(s));
+} // session_push()
+
+/**
+ * Reads one report like canctl_read(). If the module went away, blocks in
+ * session_recover() until it is back and then reads from it.
+ * @param s The session
+ * @param buf Buffer to read data into
+ * @param len Length of buffer @c buf
+ * @returns Returns the number of bytes read on success, 0 on timeout,
+ * -1 on error
+ */
+int session_read(session_t *s, unsigned char *buf, size_t len)
+{
+	int nbytes;
+
+	for (;;)
+	{
+		if ((nbytes = canctl_read(s->dev, buf, len)) >= 0 ||
+			!session_is_lost(errno))
+			return (nbytes);
+		if (session_recover(s) < 0)
+			return (-1);
+	}
+} // session_read()
+
+/**
+ * Queues one report and writes everything queued. If the module went away,
+ * blocks in session_recover() until it is back. If it does not come back,
+ * the report stays queued for the next write or recovery.
+ * @param s The session
+ * @param buf The report to write
+ * @param len Number of bytes in @c buf
+ * @returns Returns @c len once the report is queued and the queue written,
+ * -1 on error (errno is ENOBUFS if the queue is full)
+ */
+int session_write(session_t *s, const unsigned char *buf, size_t len)
+{
+	size_t idx;
+
+	if (buf == NULL || len == 0 || len > CANBUS_MSG_SIZE)
+	{
+		errno = EINVAL;
+		return (-1);
+	}
+	if (session_pending(s) >= SESSION_TX_QUEUE_SIZE)
+	{
+		errno = ENOBUFS;
+		return (-1);
+	}
+	idx = s->tx_head % SESSION_TX_QUEUE_SIZE;
+	memcpy(s->txq[idx].buf, buf, len);
+	s->txq[idx].len = len;
+	s->tx_head++;
+	if (session_push(s) < 0)
+		return (-1);
+	return ((int)len);
+} // session_write()
+
+/**
+ * Packs frames into reports like canctl_send_frames(), queues them and
+ * writes everything queued, reconnecting as session_write() does.
+ * @param s The session
+ * @param frames Frames to send
+ * @param n Number of frames in @c frames
+ * @returns Returns @c n once all frames are queued and the queue written,
+ * -1 on error (errno is ENOBUFS if the frames do not fit in the queue)
+ */
+int session_send_frames(session_t *s, const canbus_frame_t *frames,
+	size_t n)
+{
+	size_t reports = (n + CANBUS_FRAMES_PER_REPORT - 1) /
+		CANBUS_FRAMES_PER_REPORT;
+
+	if (frames == NULL)
+		return (-1); // @todo Return a better error indicator
+	if (session_pending(s) + reports > SESSION_TX_QUEUE_SIZE)
+	{
+		errno = ENOBUFS;
+		return (-1);
+	}
+	for (size_t sent = 0; sent < n; sent += CANBUS_FRAMES_PER_REPORT)
+	{
+		size_t idx = s->tx_head % SESSION_TX_QUEUE_SIZE;
+		size_t batch = n - sent;
+		int len;
+
+		if (batch > CANBUS_FRAMES_PER_REPORT)
+			batch = CANBUS_FRAMES_PER_REPORT;
+		if ((len = canctl_encode_frames(s->txq[idx].buf,
+			sizeof(s->txq[idx].buf), &frames[sent], batch)) < 0)
+			return (-1); // @todo Return a better error indicator
+		s->txq[idx].len = len;
+		s->tx_head++;
+	}
+	if (session_push(s) < 0)
+		return (-1);
+	return ((int)n);
+} // session_send_frames()
@@ -0,0 +1,687 @@
+/**
+ * @file uring.c
+ * @date 2026-10-16
+ */
+
+#define _GNU_SOURCE // syscall()
+#include "uring.h"
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#if defined(__NR_io_uring_setup) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define URING_SUPPORTED 1
+#endif
+#endif
+
+#ifdef URING_SUPPORTED
+
+// user_data of the requests; reads and writes carry their buffer index
+#define URING_UD_POLL               (1ULL << 32) // Poll for parked reads
+#define URING_UD_WRITE              (2ULL << 32)
+#define URING_UD_CANCEL             (3ULL << 32)
+#define URING_UD_KIND(ud)           ((ud) & (3ULL << 32))
+#define URING_UD_INDEX(ud)          ((unsigned int)((ud) & 0xffffffffULL))
+
+#ifndef IORING_CQE_F_MORE
+#define IORING_CQE_F_MORE           0 // Every poll is single shot
+#endif
+
+#define URING_DRAIN_MS              1000 // Most uring_destroy() waits
+
+struct uring
+{
+	int ring_fd;
+	int fd; // The file the I/O is for
+	unsigned int nreads; // Reads kept posted, 0 for a transmit ring
+	uring_stats_t stats;
+
+	// Submission queue, shared with the kernel. Its index array maps slot
+	// i to SQE i for good, so only the tail moves.
+	unsigned int *sq_head, *sq_tail;
+	unsigned int sq_mask, sq_entries;
+	struct io_uring_sqe *sqes;
+
+	// Completion queue, shared with the kernel
+	unsigned int *cq_head, *cq_tail;
+	unsigned int cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_map, *cq_map, *sqe_map;
+	size_t sq_len, cq_len, sqe_len;
+	unsigned char (*bufs)[CANBUS_MSG_SIZE]; // One per posted read
+
+	// Reads a non-blocking file bounced with EAGAIN are parked instead of
+	// reposted, and a single poll wakes one of them per report
+	unsigned int parked; // Bit i set while buffer i has no read posted
+	unsigned int posted; // Reads posted and not reaped yet
+	int poll_armed;
+	int poll_single; // Multishot polls are not supported
+
+	// uring_drain() state: reads not finished yet since the cancellation
+	int draining;
+	unsigned int outstanding;
+	int64_t drain_deadline_ns;
+};
+
+/**
+ * @returns Returns the current CLOCK_MONOTONIC time in nanoseconds
+ */
+static int64_t uring_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec);
+} // uring_now_ns()
+
+/**
+ * Queues one request in the submission queue. It reaches the kernel with
+ * the next uring_enter(). The queue is sized so it can not fill up.
+ * @returns Returns the request to fill in, already zeroed
+ */
+static struct io_uring_sqe *uring_get_sqe(uring_t *u)
+{
+	struct io_uring_sqe *sqe = &u->sqes[*u->sq_tail & u->sq_mask];
+
+	memset(sqe, 0, sizeof(*sqe));
+	return (sqe);
+} // uring_get_sqe()
+
+/**
+ * Publishes the request uring_get_sqe() returned once it is filled in.
+ */
+static void uring_commit_sqe(uring_t *u)
+{
+	__atomic_store_n(u->sq_tail, *u->sq_tail + 1, __ATOMIC_RELEASE);
+} // uring_commit_sqe()
+
+/**
+ * Submits the queued requests and optionally waits for completions.
+ * @param u The ring
+ * @param wait Nonzero to wait for at least one completion
+ * @param deadline_ns When to stop waiting on CLOCK_MONOTONIC, negative to
+ * wait forever
+ * @returns Returns the number of requests submitted, -1 on error (errno is
+ * ETIME if the deadline passed, EINTR for a signal)
+ */
+static int uring_enter(uring_t *u, int wait, int64_t deadline_ns)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned int to_submit, flags = 0;
+	int64_t left_ns;
+	int rc;
+
+	to_submit = *u->sq_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+	memset(&arg, 0, sizeof(arg));
+	if (wait)
+	{
+		flags |= IORING_ENTER_GETEVENTS;
+		if (deadline_ns >= 0)
+		{
+			left_ns = deadline_ns - uring_now_ns();
+			if (left_ns < 0)
+				left_ns = 0;
+			ts.tv_sec = left_ns / 1000000000LL;
+			ts.tv_nsec = left_ns % 1000000000LL;
+			arg.sigmask_sz = 8; // Kernel _NSIG / 8; no mask is passed
+			arg.ts = (uintptr_t)&ts;
+			flags |= IORING_ENTER_EXT_ARG;
+		}
+	}
+	u->stats.enters++;
+	rc = syscall(__NR_io_uring_enter, u->ring_fd, to_submit, wait ? 1 : 0,
+		flags, (flags & IORING_ENTER_EXT_ARG) ? (void *)&arg : NULL,
+		(flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : 0);
+	return (rc);
+} // uring_enter()
+
+/**
+ * Takes the oldest completion off the completion queue.
+ * @returns Returns 1 and fills @c cqe if there was one, 0 if the queue is
+ * empty
+ */
+static int uring_reap(uring_t *u, struct io_uring_cqe *cqe)
+{
+	unsigned int head = *u->cq_head; // Only this thread writes head
+
+	if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+		return (0);
+	*cqe = u->cqes[head & u->cq_mask];
+	__atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+	u->stats.completions++;
+	return (1);
+} // uring_reap()
+
+/**
+ * Posts a read of one report into buffer @c slot.
+ * @param u The receive ring
+ * @param slot Buffer to read into
+ */
+static void uring_post_read(uring_t *u, unsigned int slot)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(u);
+
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = u->fd;
+	sqe->addr = (uintptr_t)u->bufs[slot];
+	sqe->len = CANBUS_MSG_SIZE;
+	sqe->off = (uint64_t)-1; // Current position, the fd is not seekable
+	sqe->user_data = slot;
+	uring_commit_sqe(u);
+	u->parked &= ~(1U << slot);
+	u->posted++;
+} // uring_post_read()
+
+/**
+ * Posts the poll that stands in for the parked reads. It stays armed and
+ * completes once per report where multishot polls are supported (5.13),
+ * otherwise it is posted again after each completion.
+ * @param u The receive ring
+ */
+static void uring_post_poll(uring_t *u)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(u);
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = u->fd;
+	sqe->poll32_events = POLLIN; // Little endian, like the gateway
+#ifdef IORING_POLL_ADD_MULTI
+	if (!u->poll_single)
+		sqe->len = IORING_POLL_ADD_MULTI;
+#endif
+	sqe->user_data = URING_UD_POLL;
+	uring_commit_sqe(u);
+	u->poll_armed = 1;
+} // uring_post_poll()
+
+/**
+ * Posts a cancellation of the request with @c user_data.
+ */
+static void uring_post_cancel(uring_t *u, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(u);
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = user_data;
+	sqe->user_data = URING_UD_CANCEL;
+	uring_commit_sqe(u);
+} // uring_post_cancel()
+
+/**
+ * Probes once whether the kernel supports io_uring with the features used
+ * here.
+ * @returns Returns nonzero if uring_create() can work
+ */
+int uring_available(void)
+{
+	static int available = -1;
+	struct io_uring_params p;
+	int fd;
+
+	if (__atomic_load_n(&available, __ATOMIC_RELAXED) < 0)
+	{
+		memset(&p, 0, sizeof(p));
+		fd = syscall(__NR_io_uring_setup, 1, &p);
+		if (fd >= 0)
+			close(fd);
+		__atomic_store_n(&available,
+			fd >= 0 && (p.features & IORING_FEAT_EXT_ARG) != 0,
+			__ATOMIC_RELAXED);
+	}
+	return (__atomic_load_n(&available, __ATOMIC_RELAXED));
+} // uring_available()
+
+/**
+ * Sets up a ring for @c fd. A receive ring posts its reads right away.
+ * @param fd The module's file descriptor. The ring does not take ownership;
+ * destroy the ring before closing it.
+ * @param nreads Reads to keep posted for a receive ring, at most
+ * URING_READ_DEPTH, or 0 for a transmit ring
+ * @returns Returns the new ring on success, NULL on error (errno is ENOSYS
+ * if io_uring is not available)
+ */
+uring_t *uring_create(int fd, unsigned int nreads)
+{
+	struct io_uring_params p;
+	unsigned int entries;
+	uring_t *u;
+	int err;
+
+	if (fd < 0 || nreads > URING_READ_DEPTH)
+	{
+		errno = EINVAL;
+		return (NULL);
+	}
+	if (!uring_available())
+	{
+		errno = ENOSYS;
+		return (NULL);
+	}
+	if ((u = calloc(1, sizeof(*u))) == NULL)
+		return (NULL);
+	u->fd = fd;
+	u->nreads = nreads;
+	u->ring_fd = -1;
+	u->sq_map = u->cq_map = u->sqe_map = MAP_FAILED;
+
+	// Room for a read per buffer and the poll, or a batch of writes, plus
+	// a cancellation for each
+	entries = 2 * (nreads > 0 ? nreads + 1 : URING_WRITE_BATCH);
+	memset(&p, 0, sizeof(p));
+#ifdef IORING_SETUP_COOP_TASKRUN
+	// Completions are only reaped by this thread, so spare it the IPIs
+	p.flags = IORING_SETUP_COOP_TASKRUN;
+	if ((u->ring_fd = syscall(__NR_io_uring_setup, entries, &p)) < 0 &&
+		errno == EINVAL)
+	{
+		memset(&p, 0, sizeof(p));
+		u->ring_fd = syscall(__NR_io_uring_setup, entries, &p);
+	}
+#else
+	u->ring_fd = syscall(__NR_io_uring_setup, entries, &p);
+#endif
+	if (u->ring_fd < 0)
+		goto err;
+
+	u->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	u->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (u->cq_len > u->sq_len)
+			u->sq_len = u->cq_len;
+		u->cq_len = 0;
+	}
+	u->sqe_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	if ((u->sq_map = mmap(NULL, u->sq_len, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, u->ring_fd, IORING_OFF_SQ_RING)) ==
+		MAP_FAILED)
+		goto err;
+	if (u->cq_len == 0)
+		u->cq_map = u->sq_map;
+	else if ((u->cq_map = mmap(NULL, u->cq_len, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, u->ring_fd, IORING_OFF_CQ_RING)) ==
+		MAP_FAILED)
+		goto err;
+	if ((u->sqe_map = mmap(NULL, u->sqe_len, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, u->ring_fd, IORING_OFF_SQES)) == MAP_FAILED)
+		goto err;
+
+	u->sq_head = (unsigned int *)((char *)u->sq_map + p.sq_off.head);
+	u->sq_tail = (unsigned int *)((char *)u->sq_map + p.sq_off.tail);
+	u->sq_mask = *(unsigned int *)((char *)u->sq_map + p.sq_off.ring_mask);
+	u->sq_entries = p.sq_entries;
+	for (unsigned int i = 0; i < p.sq_entries; i++)
+		((unsigned int *)((char *)u->sq_map + p.sq_off.array))[i] = i;
+	u->sqes = u->sqe_map;
+	u->cq_head = (unsigned int *)((char *)u->cq_map + p.cq_off.head);
+	u->cq_tail = (unsigned int *)((char *)u->cq_map + p.cq_off.tail);
+	u->cq_mask = *(unsigned int *)((char *)u->cq_map + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)((char *)u->cq_map + p.cq_off.cqes);
+
+	if (nreads > 0)
+	{
+		if ((u->bufs = calloc(nreads, sizeof(*u->bufs))) == NULL)
+			goto err;
+		for (unsigned int i = 0; i < nreads; i++)
+			uring_post_read(u, i);
+		if (uring_enter(u, 0, -1) < 0)
+		{
+			free(u->bufs);
+			u->bufs = NULL;
+			goto err;
+		}
+	}
+	return (u);
+
+err:
+	err = errno;
+	u->nreads = 0; // Nothing was posted
+	uring_destroy(u);
+	errno = err;
+	return (NULL);
+} // uring_create()
+
+/**
+ * Cancels the reads still posted, waits for the kernel to let go of their
+ * buffers and frees the ring. Reports already read in and not taken with
+ * uring_drain() are discarded.
+ * @param u The ring to destroy, may be NULL
+ */
+void uring_destroy(uring_t *u)
+{
+	unsigned char buf[CANBUS_MSG_SIZE];
+
+	if (u == NULL)
+		return;
+
+	// Every posted read must finish before the buffers can go
+	if (u->nreads > 0)
+		while (uring_drain(u, buf, sizeof(buf)) > 0)
+			;
+
+	if (u->sqe_map != MAP_FAILED)
+		munmap(u->sqe_map, u->sqe_len);
+	if (u->cq_map != MAP_FAILED && u->cq_map != u->sq_map)
+		munmap(u->cq_map, u->cq_len);
+	if (u->sq_map != MAP_FAILED)
+		munmap(u->sq_map, u->sq_len);
+	if (u->ring_fd >= 0)
+		close(u->ring_fd);
+	free(u->bufs);
+	free(u);
+} // uring_destroy()
+
+/**
+ * Returns the next report a posted read brought in, in the order they
+ * arrived, and posts the read again. Reports that are already in are
+ * picked up without a system call; otherwise a single io_uring_enter()
+ * hands over the reposted reads and waits. On a non-blocking file the
+ * reads that find nothing are parked, and the ring's poll posts one of
+ * them per report, so an idle module costs one poll rather than a bounced
+ * read per buffer.
+ * @param u The receive ring
+ * @param buf Buffer for the report
+ * @param len Length of buffer @c buf
+ * @param timeout_ms Milliseconds to wait, or negative to wait forever
+ * @returns Returns the number of bytes read on success, 0 on timeout, -1 on
+ * error
+ */
+int uring_read(uring_t *u, unsigned char *buf, size_t len, int timeout_ms)
+{
+	struct io_uring_cqe cqe;
+	unsigned int slot;
+	int64_t deadline_ns;
+	size_t n;
+
+	if (u == NULL || buf == NULL || u->nreads == 0 || u->draining)
+	{
+		errno = EINVAL;
+		return (-1);
+	}
+	deadline_ns = timeout_ms < 0 ? -1 :
+		uring_now_ns() + timeout_ms * 1000000LL;
+
+	for (;;)
+	{
+		while (uring_reap(u, &cqe))
+		{
+			if (URING_UD_KIND(cqe.user_data) == URING_UD_POLL)
+			{
+				if (!(cqe.flags & IORING_CQE_F_MORE))
+					u->poll_armed = 0;
+				if (cqe.res == -EINVAL && !u->poll_single)
+				{
+					u->poll_single = 1; // Before 5.13, poll one at a time
+					continue;
+				}
+				if (cqe.res < 0)
+				{
+					errno = -cqe.res;
+					return (-1);
+				}
+				// Readable: wake one parked read. If more reports are
+				// queued, the read reposted after it picks them up.
+				if (u->parked != 0)
+					uring_post_read(u, __builtin_ctz(u->parked));
+				continue;
+			}
+			if (URING_UD_KIND(cqe.user_data) != 0)
+				continue; // A cancellation
+			u->posted--;
+			slot = URING_UD_INDEX(cqe.user_data);
+			if (cqe.res == -EAGAIN)
+			{
+				// A non-blocking file had nothing, park the read until
+				// the poll says otherwise
+				u->stats.retries++;
+				u->parked |= 1U << slot;
+				continue;
+			}
+			if (cqe.res < 0)
+			{
+				uring_post_read(u, slot);
+				errno = -cqe.res;
+				return (-1);
+			}
+			n = (size_t)cqe.res < len ? (size_t)cqe.res : len;
+			memcpy(buf, u->bufs[slot], n);
+			uring_post_read(u, slot);
+			u->stats.reads++;
+			return ((int)n);
+		}
+		if (u->parked != 0 && !u->poll_armed)
+			uring_post_poll(u);
+		if (uring_enter(u, 1, deadline_ns) < 0)
+		{
+			if (errno == ETIME)
+				return (0);
+			return (-1);
+		}
+		if (deadline_ns >= 0 && uring_now_ns() >= deadline_ns &&
+			*u->cq_head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+			return (0); // It returned for the submissions, then timed out
+	}
+} // uring_read()
+
+/**
+ * Stops a receive ring: cancels the posted reads, then returns the reports
+ * that came in anyway, one per call, so none are lost with the ring. After
+ * the first call the ring only drains; uring_read() must not be called.
+ * @param u The receive ring
+ * @param buf Buffer for the report
+ * @param len Length of buffer @c buf
+ * @returns Returns the number of bytes read, or 0 once every read has
+ * finished (or URING_DRAIN_MS passed waiting for them)
+ */
+int uring_drain(uring_t *u, unsigned char *buf, size_t len)
+{
+	struct io_uring_cqe cqe;
+	size_t n;
+
+	if (u == NULL || buf == NULL || u->nreads == 0)
+		return (0);
+	if (!u->draining)
+	{
+		uring_enter(u, 0, -1); // Reposts not handed over yet
+		for (unsigned int i = 0; i < u->nreads; i++)
+			if (!(u->parked & (1U << i)))
+				uring_post_cancel(u, i);
+		if (u->poll_armed)
+			uring_post_cancel(u, URING_UD_POLL);
+		u->draining = 1;
+		u->outstanding = u->posted;
+		u->drain_deadline_ns = uring_now_ns() + URING_DRAIN_MS * 1000000LL;
+	}
+
+	while (u->outstanding > 0)
+	{
+		while (u->outstanding > 0 && uring_reap(u, &cqe))
+		{
+			if (URING_UD_KIND(cqe.user_data) != 0)
+				continue; // The poll, or a cancellation
+			u->outstanding--;
+			if (cqe.res <= 0)
+				continue; // Cancelled, or failed
+			n = (size_t)cqe.res < len ? (size_t)cqe.res : len;
+			memcpy(buf, u->bufs[URING_UD_INDEX(cqe.user_data)], n);
+			u->stats.reads++;
+			return ((int)n);
+		}
+		if (u->outstanding > 0 &&
+			uring_enter(u, 1, u->drain_deadline_ns) < 0 && errno == ETIME)
+			u->outstanding = 0; // Give up on them
+	}
+	return (0);
+} // uring_drain()
+
+/**
+ * Writes up to URING_WRITE_BATCH reports in one system call. The writes
+ * are linked, so they go out in order and the ones after a failed write
+ * are not attempted. Returns only once the kernel is done with every
+ * buffer in @c iov.
+ * @param u The transmit ring
+ * @param iov One report per element
+ * @param n Number of reports in @c iov
+ * @param timeout_ms Milliseconds to wait for the writes, or negative to
+ * wait forever
+ * @returns Returns the number of reports written in full, -1 if not even
+ * the first one was. When short, errno says why the next one failed
+ * (ETIMEDOUT on timeout, EIO for a short write).
+ */
+int uring_write(uring_t *u, const struct iovec *iov, size_t n,
+	int timeout_ms)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe cqe;
+	int res[URING_WRITE_BATCH];
+	unsigned int pending, cancelled = 0;
+	int64_t deadline_ns;
+	size_t i, written;
+
+	if (u == NULL || iov == NULL || n == 0 || u->nreads != 0)
+	{
+		errno = EINVAL;
+		return (-1);
+	}
+	if (n > URING_WRITE_BATCH)
+		n = URING_WRITE_BATCH;
+
+	for (i = 0; i < n; i++)
+	{
+		sqe = uring_get_sqe(u);
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = u->fd;
+		sqe->addr = (uintptr_t)iov[i].iov_base;
+		sqe->len = iov[i].iov_len;
+		sqe->off = (uint64_t)-1;
+		sqe->flags = i + 1 < n ? IOSQE_IO_LINK : 0;
+		sqe->user_data = URING_UD_WRITE | i;
+		uring_commit_sqe(u);
+		res[i] = -ECANCELED;
+	}
+	pending = n;
+	deadline_ns = timeout_ms < 0 ? -1 :
+		uring_now_ns() + timeout_ms * 1000000LL;
+
+	while (pending > 0)
+	{
+		while (uring_reap(u, &cqe))
+		{
+			if (URING_UD_KIND(cqe.user_data) == URING_UD_WRITE)
+				res[URING_UD_INDEX(cqe.user_data)] = cqe.res;
+			pending--;
+		}
+		if (pending == 0)
+			break;
+		if (uring_enter(u, 1, cancelled ? -1 : deadline_ns) >= 0 ||
+			errno == EINTR || cancelled)
+			continue;
+
+		// Timed out (or worse): cancel the first write still out, which
+		// takes the rest of the chain with it, and wait for the kernel to
+		// hand the buffers back
+		for (i = 0; i < n && res[i] != -ECANCELED; i++)
+			;
+		uring_post_cancel(u, URING_UD_WRITE | i);
+		pending++;
+		cancelled = 1;
+	}
+
+	for (written = 0; written < n &&
+		res[written] == (int)iov[written].iov_len; written++)
+		;
+	u->stats.writes += written;
+	if (written < n)
+	{
+		// Say why the first write that did not make it failed
+		if (res[written] >= 0)
+			errno = EIO; // Short write
+		else if (cancelled && res[written] == -ECANCELED)
+			errno = ETIMEDOUT;
+		else
+			errno = -res[written];
+	}
+	return (written > 0 ? (int)written : -1);
+} // uring_write()
+
+/**
+ * @param u The ring to inspect
+ * @param stats Filled with the ring's counters
+ */
+void uring_get_stats(const uring_t *u, uring_stats_t *stats)
+{
+	*stats = u->stats;
+} // uring_get_stats()
+
+#else // !URING_SUPPORTED
+
+/**
+ * @returns Always 0, this build has no io_uring
+ */
+int uring_available(void)
+{
+	return (0);
+} // uring_available()
+
+/**
+ * @returns Always NULL with errno ENOSYS, this build has no io_uring
+ */
+uring_t *uring_create(int fd, unsigned int nreads)
+{
+	(void)fd;
+	(void)nreads;
+	errno = ENOSYS;
+	return (NULL);
+} // uring_create()
+
+void uring_destroy(uring_t *u)
+{
+	(void)u;
+} // uring_destroy()
+
+int uring_read(uring_t *u, unsigned char *buf, size_t len, int timeout_ms)
+{
+	(void)u;
+	(void)buf;
+	(void)len;
+	(void)timeout_ms;
+	errno = ENOSYS;
+	return (-1);
+} // uring_read()
+
+int uring_drain(uring_t *u, unsigned char *buf, size_t len)
+{
+	(void)u;
+	(void)buf;
+	(void)len;
+	return (0);
+} // uring_drain()
+
+int uring_write(uring_t *u, const struct iovec *iov, size_t n,
+	int timeout_ms)
+{
+	(void)u;
+	(void)iov;
+	(void)n;
+	(void)timeout_ms;
+	errno = ENOSYS;
+	return (-1);
+} // uring_write()
+
+void uring_get_stats(const uring_t *u, uring_stats_t *stats)
+{
+	(void)u;
+	memset(stats, 0, sizeof(*stats));
+} // uring_get_stats()
+
+#endif // URING_SUPPORTED